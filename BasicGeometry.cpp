@@ -1,4 +1,6 @@
 #include "BasicGeometry.h"
+#include "Effects.h"
+#include "MeshOptimizer.h"
 
 
 /********************************************************
@@ -109,6 +111,7 @@ std::unique_ptr<Drawable> createSphere(DrawContext *context,
     auto positions = createSpherePositions(longDivisions, latDivisions, radius);
     auto elements  = createSphereElements(longDivisions, latDivisions);
     auto normals   = createSphereNormals(positions, elements);
+    MeshOptimizer::optimize(elements, positions, normals);
 
     auto sphere = context->createDrawable<Geometry>(
         std::move(effectProperty),
@@ -119,3 +122,91 @@ std::unique_ptr<Drawable> createSphere(DrawContext *context,
     return std::move(sphere);
 }
 
+
+std::shared_ptr<EffectProperty> createMaterialEffectProperty(DrawContext *context, const MeshMaterial &material,
+                                                             const std::string &effectName)
+{
+    // the deferred effect names its parameters like the forward one
+    auto phongEffect = context->getEffect(effectName);
+    auto effectProperty = phongEffect->createEffectProperty();
+    effectProperty.setParam(ForwardPhongEffect::AMBIENT_COLOR, material.ambientColor);
+    effectProperty.setParam(ForwardPhongEffect::DIFFUSE_COLOR, material.diffuseColor);
+    effectProperty.setParam(ForwardPhongEffect::SPECULAR_COLOR, material.specularColor);
+    effectProperty.setParam(ForwardPhongEffect::SHININESS, material.shininess);
+
+    return std::make_shared<EffectProperty>(std::move(effectProperty));
+}
+
+
+std::vector<std::unique_ptr<Drawable>> createShapeGeometries(DrawContext *context,
+                                                             const MeshShape &shape,
+                                                             const std::vector<std::shared_ptr<EffectProperty>> &effectProperties,
+                                                             const std::shared_ptr<EffectProperty> &defaultEffectProperty)
+{
+    // pack the shape into the shared static mesh buffer, levels of detail follow the full elements
+    std::vector<unsigned> elements(shape.elements);
+    std::vector<unsigned> levelOffsets;
+    for (const auto &levelOfDetail : shape.levelsOfDetail) {
+        levelOffsets.push_back(static_cast<unsigned>(elements.size()));
+        elements.insert(elements.end(), levelOfDetail.elements.begin(), levelOfDetail.elements.end());
+    }
+
+    auto allocation = context->getMeshBuffer().allocate(elements, shape.positions, shape.normals);
+
+    // create geometries
+    std::vector<std::unique_ptr<Drawable>> geometries;
+    for (std::size_t rangeIdx = 0; rangeIdx < shape.materialRanges.size(); ++rangeIdx) {
+        const auto &range = shape.materialRanges[rangeIdx];
+        std::vector<Geometry::LevelOfDetail> levelsOfDetail;
+        for (std::size_t level = 0; level < shape.levelsOfDetail.size(); ++level) {
+            const auto &levelRange = shape.levelsOfDetail[level].materialRanges[rangeIdx];
+            levelsOfDetail.push_back({levelRange.numOfElements,
+                                      levelOffsets[level] + levelRange.elementOffset,
+                                      shape.levelsOfDetail[level].error});
+        }
+
+        std::vector<MeshCluster> clusters;
+        for (const auto &cluster : shape.clusters) {
+            if (cluster.elementOffset >= range.elementOffset && cluster.elementOffset < range.elementOffset + range.numOfElements)
+                clusters.push_back(cluster);
+        }
+
+        std::shared_ptr<EffectProperty> effectProperty;
+        if (range.materialId >= 0 && static_cast<std::size_t>(range.materialId) < effectProperties.size()) {
+            effectProperty = effectProperties[range.materialId];
+        }
+        else {
+            effectProperty = defaultEffectProperty;
+        }
+
+        auto drawable = context->createDrawable<Geometry>(std::move(effectProperty),
+                                                          allocation,
+                                                          range.numOfElements,
+                                                          range.elementOffset,
+                                                          range.boundingBox,
+                                                          levelsOfDetail,
+                                                          clusters);
+
+        // the finest level small enough to rasterize on the CPU occludes for the range
+        const unsigned *occluderElements = shape.elements.data() + range.elementOffset;
+        unsigned numOfOccluderElements = range.numOfElements;
+        for (std::size_t level = 0; level < shape.levelsOfDetail.size() &&
+             numOfOccluderElements > OcclusionCuller::MAX_OCCLUDER_TRIANGLES * 3; ++level)
+        {
+            const auto &levelRange = shape.levelsOfDetail[level].materialRanges[rangeIdx];
+            occluderElements = shape.levelsOfDetail[level].elements.data() + levelRange.elementOffset;
+            numOfOccluderElements = levelRange.numOfElements;
+        }
+
+        if (numOfOccluderElements <= OcclusionCuller::MAX_OCCLUDER_TRIANGLES * 3) {
+            drawable->setOccluder(std::make_shared<OccluderMesh>(
+                OccluderMesh::fromElements(occluderElements, numOfOccluderElements, shape.positions)));
+        }
+
+        drawable->setName(shape.name + "_mat" + std::to_string(range.elementOffset / 3));
+
+        geometries.push_back(std::move(drawable));
+    }
+
+    return geometries;
+}
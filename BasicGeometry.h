@@ -2,10 +2,23 @@
 #define BASICGEOMETRY_H
 
 #include "Drawables.h"
+#include "MeshLoader.h"
+#include "Effects.h"
 
 
 std::unique_ptr<Drawable> createSphere(DrawContext *context,
                                        std::shared_ptr<EffectProperty> effectProperty,
                                        unsigned longDivisions, unsigned latDivisions, float radius);
 
+// phong parameters of an imported material, for either phong effect
+std::shared_ptr<EffectProperty> createMaterialEffectProperty(DrawContext *context, const MeshMaterial &material,
+                                                             const std::string &effectName = ForwardPhongEffect::EFFECT_NAME);
+
+// one geometry per material range of an imported shape, packed into the context's mesh buffer.
+// Ranges without a material use the default effect property
+std::vector<std::unique_ptr<Drawable>> createShapeGeometries(DrawContext *context,
+                                                             const MeshShape &shape,
+                                                             const std::vector<std::shared_ptr<EffectProperty>> &effectProperties,
+                                                             const std::shared_ptr<EffectProperty> &defaultEffectProperty);
+
 #endif // BASICGEOMETRY_H
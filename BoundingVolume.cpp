@@ -0,0 +1,163 @@
+#include <limits>
+#include <glm/gtc/matrix_access.hpp>
+#include "BoundingVolume.h"
+
+
+/***************************************************
+ * BoundingBox definitions
+ ***************************************************/
+BoundingBox::BoundingBox()
+    : min{std::numeric_limits<float>::max()},
+    max{std::numeric_limits<float>::lowest()}
+{}
+
+
+BoundingBox::BoundingBox(glm::vec3 minCorner, glm::vec3 maxCorner)
+    : min{minCorner}, max{maxCorner}
+{}
+
+
+BoundingBox BoundingBox::fromPoints(const std::vector<glm::vec3> &points) {
+    BoundingBox box;
+    for (const auto &point : points) {
+        box.expand(point);
+    }
+
+    return box;
+}
+
+
+bool BoundingBox::isEmpty() const {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+
+void BoundingBox::expand(glm::vec3 point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+
+void BoundingBox::expand(const BoundingBox &box) {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+}
+
+
+BoundingBox BoundingBox::transform(const glm::mat4 &transformation) const {
+    if (isEmpty())
+        return *this;
+
+    // Arvo's method: project the box extent on every axis of the transformation
+    glm::vec3 newMin = glm::vec3(transformation[3]);
+    glm::vec3 newMax = newMin;
+    for (int col = 0; col < 3; ++col) {
+        for (int row = 0; row < 3; ++row) {
+            float a = transformation[col][row] * min[col];
+            float b = transformation[col][row] * max[col];
+            newMin[row] += glm::min(a, b);
+            newMax[row] += glm::max(a, b);
+        }
+    }
+
+    return {newMin, newMax};
+}
+
+
+/***************************************************
+ * BoundingSphere definitions
+ ***************************************************/
+BoundingSphere::BoundingSphere()
+    : center{0.0f}, radius{-1.0f}
+{}
+
+
+BoundingSphere::BoundingSphere(glm::vec3 center, float radius)
+    : center{center}, radius{radius}
+{}
+
+
+BoundingSphere BoundingSphere::fromBox(const BoundingBox &box) {
+    if (box.isEmpty())
+        return {};
+
+    return {box.center(), glm::length(box.extent()) * 0.5f};
+}
+
+
+BoundingSphere BoundingSphere::transform(const glm::mat4 &transformation) const {
+    float scaleX = glm::length(glm::vec3(transformation[0]));
+    float scaleY = glm::length(glm::vec3(transformation[1]));
+    float scaleZ = glm::length(glm::vec3(transformation[2]));
+    float maxScale = glm::max(scaleX, glm::max(scaleY, scaleZ));
+    return {glm::vec3(transformation * glm::vec4(center, 1.0f)), radius * maxScale};
+}
+
+
+/***************************************************
+ * Frustum definitions
+ ***************************************************/
+Frustum::Frustum(const glm::mat4 &viewProjMatrix) {
+    // Gribb and Hartmann plane extraction
+    glm::vec4 row0 = glm::row(viewProjMatrix, 0);
+    glm::vec4 row1 = glm::row(viewProjMatrix, 1);
+    glm::vec4 row2 = glm::row(viewProjMatrix, 2);
+    glm::vec4 row3 = glm::row(viewProjMatrix, 3);
+    _planes[0] = row3 + row0;
+    _planes[1] = row3 - row0;
+    _planes[2] = row3 + row1;
+    _planes[3] = row3 - row1;
+    _planes[4] = row3 + row2;
+    _planes[5] = row3 - row2;
+
+    for (auto &plane : _planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+
+bool Frustum::intersects(const BoundingSphere &sphere) const {
+    if (sphere.radius < 0.0f)
+        return false;
+
+    for (const auto &plane : _planes) {
+        if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+            return false;
+    }
+
+    return true;
+}
+
+
+bool Frustum::intersects(const BoundingBox &box) const {
+    if (box.isEmpty())
+        return false;
+
+    for (const auto &plane : _planes) {
+        // test the corner furthest along the plane normal
+        glm::vec3 positive{plane.x >= 0.0f ? box.max.x : box.min.x,
+                           plane.y >= 0.0f ? box.max.y : box.min.y,
+                           plane.z >= 0.0f ? box.max.z : box.min.z};
+        if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+            return false;
+    }
+
+    return true;
+}
+
+
+bool Frustum::contains(const BoundingBox &box) const {
+    if (box.isEmpty())
+        return false;
+
+    for (const auto &plane : _planes) {
+        // test the corner furthest against the plane normal
+        glm::vec3 negative{plane.x >= 0.0f ? box.min.x : box.max.x,
+                           plane.y >= 0.0f ? box.min.y : box.max.y,
+                           plane.z >= 0.0f ? box.min.z : box.max.z};
+        if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef BOUNDINGVOLUME_H
+#define BOUNDINGVOLUME_H
+
+#include <array>
+#include <vector>
+#include <glm/glm.hpp>
+
+
+struct BoundingBox {
+    BoundingBox();
+
+    BoundingBox(glm::vec3 minCorner, glm::vec3 maxCorner);
+
+    static BoundingBox fromPoints(const std::vector<glm::vec3> &points);
+
+    bool isEmpty() const;
+
+    void expand(glm::vec3 point);
+
+    void expand(const BoundingBox &box);
+
+    inline glm::vec3 center() const { return (min + max) * 0.5f; }
+
+    inline glm::vec3 extent() const { return max - min; }
+
+    BoundingBox transform(const glm::mat4 &transformation) const;
+
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+
+struct BoundingSphere {
+    BoundingSphere();
+
+    BoundingSphere(glm::vec3 center, float radius);
+
+    static BoundingSphere fromBox(const BoundingBox &box);
+
+    BoundingSphere transform(const glm::mat4 &transformation) const;
+
+    glm::vec3 center;
+    float radius;
+};
+
+
+class Frustum {
+public:
+    explicit Frustum(const glm::mat4 &viewProjMatrix);
+
+    bool intersects(const BoundingSphere &sphere) const;
+
+    bool intersects(const BoundingBox &box) const;
+
+    // true when the box is completely inside the frustum
+    bool contains(const BoundingBox &box) const;
+
+    inline const std::array<glm::vec4, 6> &getPlanes() const { return _planes; }
+
+private:
+    // planes are stored as (normal, distance) with normals pointing inside
+    std::array<glm::vec4, 6> _planes;
+};
+
+#endif // BOUNDINGVOLUME_H
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <array>
+#include "BoundingVolumeHierarchy.h"
+
+
+/***************************************************
+ * BoundingVolumeHierarchy definitions
+ ***************************************************/
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+{}
+
+
+void BoundingVolumeHierarchy::build(const std::vector<BoundingBox> &boxes) {
+    clear();
+    if (boxes.empty())
+        return;
+
+    _boxes = boxes;
+    _primitives.resize(boxes.size());
+    _primitiveLeaves.resize(boxes.size(), INVALID);
+    _centroids.resize(boxes.size());
+    for (std::size_t i = 0; i < boxes.size(); ++i) {
+        _primitives[i] = static_cast<unsigned>(i);
+        _centroids[i] = boxes[i].center();
+    }
+
+    _nodes.reserve(2 * boxes.size());
+    _nodes.push_back({BoundingBox{}, INVALID, 0, 0});
+
+    // split allocates both children side by side, so a node reaches them through first and first + 1
+    std::vector<std::pair<unsigned, std::pair<unsigned, unsigned>>> ranges;
+    ranges.push_back({0, {0, static_cast<unsigned>(boxes.size())}});
+    while (!ranges.empty()) {
+        auto [nodeIdx, range] = ranges.back();
+        ranges.pop_back();
+
+        auto mid = split(nodeIdx, range.first, range.second);
+        if (mid != INVALID) {
+            unsigned left = _nodes[nodeIdx].first;
+            ranges.push_back({left, {range.first, mid}});
+            ranges.push_back({left + 1, {mid, range.second}});
+        }
+    }
+}
+
+
+void BoundingVolumeHierarchy::clear() {
+    _nodes.clear();
+    _primitives.clear();
+    _primitiveLeaves.clear();
+    _boxes.clear();
+    _centroids.clear();
+    _dirtyLeaves.clear();
+}
+
+
+void BoundingVolumeHierarchy::updatePrimitive(std::size_t primitive, const BoundingBox &box) {
+    _boxes[primitive] = box;
+    _dirtyLeaves.push_back(_primitiveLeaves[primitive]);
+}
+
+
+void BoundingVolumeHierarchy::refit() {
+    for (auto leafIdx : _dirtyLeaves) {
+        auto &leaf = _nodes[leafIdx];
+        BoundingBox box;
+        for (unsigned i = leaf.first; i < leaf.first + leaf.numOfPrimitives; ++i) {
+            box.expand(_boxes[_primitives[i]]);
+        }
+        leaf.box = box;
+
+        // walk up until an ancestor does not change
+        auto nodeIdx = leaf.parent;
+        while (nodeIdx != INVALID) {
+            auto &node = _nodes[nodeIdx];
+            BoundingBox refitted = _nodes[node.first].box;
+            refitted.expand(_nodes[node.first + 1].box);
+            if (refitted.min == node.box.min && refitted.max == node.box.max)
+                break;
+
+            node.box = refitted;
+            nodeIdx = node.parent;
+        }
+    }
+
+    _dirtyLeaves.clear();
+}
+
+
+bool BoundingVolumeHierarchy::raycast(glm::vec3 origin, glm::vec3 direction, std::size_t &primitive, float &distance) {
+    if (_nodes.empty())
+        return false;
+
+    glm::vec3 invDirection = 1.0f / direction;
+    float nearest = std::numeric_limits<float>::max();
+    unsigned nearestPrimitive = INVALID;
+
+    _stack.clear();
+    _stack.push_back({0, false});
+    while (!_stack.empty()) {
+        auto nodeIdx = _stack.back().first;
+        _stack.pop_back();
+
+        const auto &node = _nodes[nodeIdx];
+        if (intersectRay(node.box, origin, invDirection, nearest) >= nearest)
+            continue;
+
+        if (node.numOfPrimitives > 0) {
+            for (unsigned i = node.first; i < node.first + node.numOfPrimitives; ++i) {
+                auto hit = intersectRay(_boxes[_primitives[i]], origin, invDirection, nearest);
+                if (hit < nearest) {
+                    nearest = hit;
+                    nearestPrimitive = _primitives[i];
+                }
+            }
+        }
+        else {
+            // visit the closer child first so farther subtrees get pruned
+            unsigned left = node.first;
+            unsigned right = node.first + 1;
+            float leftHit = intersectRay(_nodes[left].box, origin, invDirection, nearest);
+            float rightHit = intersectRay(_nodes[right].box, origin, invDirection, nearest);
+            if (leftHit < rightHit)
+                std::swap(left, right);
+
+            _stack.push_back({left, false});
+            _stack.push_back({right, false});
+        }
+    }
+
+    if (nearestPrimitive == INVALID)
+        return false;
+
+    primitive = nearestPrimitive;
+    distance = nearest;
+    return true;
+}
+
+
+float BoundingVolumeHierarchy::surfaceArea(const BoundingBox &box) {
+    if (box.isEmpty())
+        return 0.0f;
+
+    glm::vec3 extent = box.extent();
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+
+bool BoundingVolumeHierarchy::overlaps(const BoundingBox &a, const BoundingBox &b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+           a.min.y <= b.max.y && a.max.y >= b.min.y &&
+           a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+
+float BoundingVolumeHierarchy::intersectRay(const BoundingBox &box, glm::vec3 origin, glm::vec3 invDirection, float maxDistance) {
+    // slab test, returns max float on miss
+    glm::vec3 t0 = (box.min - origin) * invDirection;
+    glm::vec3 t1 = (box.max - origin) * invDirection;
+    glm::vec3 tMin = glm::min(t0, t1);
+    glm::vec3 tMax = glm::max(t0, t1);
+    float enter = glm::max(glm::max(tMin.x, tMin.y), glm::max(tMin.z, 0.0f));
+    float exit = glm::min(glm::min(tMax.x, tMax.y), glm::min(tMax.z, maxDistance));
+    if (enter > exit)
+        return std::numeric_limits<float>::max();
+
+    return enter;
+}
+
+
+unsigned BoundingVolumeHierarchy::split(unsigned nodeIdx, unsigned begin, unsigned end) {
+    BoundingBox nodeBox, centroidBox;
+    for (unsigned i = begin; i < end; ++i) {
+        nodeBox.expand(_boxes[_primitives[i]]);
+        centroidBox.expand(_centroids[_primitives[i]]);
+    }
+    _nodes[nodeIdx].box = nodeBox;
+
+    unsigned count = end - begin;
+    if (count <= 1) {
+        makeLeaf(nodeIdx, begin, end);
+        return INVALID;
+    }
+
+    // find the cheapest binned split over the three axes
+    struct Bin {
+        BoundingBox box;
+        unsigned count = 0;
+    };
+
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    unsigned bestBin = 0;
+    glm::vec3 centroidExtent = centroidBox.extent();
+    for (int axis = 0; axis < 3; ++axis) {
+        if (centroidExtent[axis] <= 0.0f)
+            continue;
+
+        std::array<Bin, NUM_OF_BINS> bins;
+        float binScale = NUM_OF_BINS / centroidExtent[axis];
+        for (unsigned i = begin; i < end; ++i) {
+            auto primitive = _primitives[i];
+            auto binIdx = std::min(NUM_OF_BINS - 1, static_cast<unsigned>((_centroids[primitive][axis] - centroidBox.min[axis]) * binScale));
+            bins[binIdx].box.expand(_boxes[primitive]);
+            ++bins[binIdx].count;
+        }
+
+        // sweep from the right to accumulate the cost of every right partition
+        std::array<float, NUM_OF_BINS> rightCosts{};
+        BoundingBox rightBox;
+        unsigned rightCount = 0;
+        for (unsigned binIdx = NUM_OF_BINS - 1; binIdx > 0; --binIdx) {
+            rightBox.expand(bins[binIdx].box);
+            rightCount += bins[binIdx].count;
+            rightCosts[binIdx] = surfaceArea(rightBox) * rightCount;
+        }
+
+        BoundingBox leftBox;
+        unsigned leftCount = 0;
+        for (unsigned binIdx = 0; binIdx < NUM_OF_BINS - 1; ++binIdx) {
+            leftBox.expand(bins[binIdx].box);
+            leftCount += bins[binIdx].count;
+            if (leftCount == 0 || leftCount == count)
+                continue;
+
+            float cost = surfaceArea(leftBox) * leftCount + rightCosts[binIdx + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = binIdx;
+            }
+        }
+    }
+
+    float leafCost = surfaceArea(nodeBox) * count;
+    if (count <= MAX_LEAF_PRIMITIVES && (bestAxis == -1 || bestCost >= leafCost)) {
+        makeLeaf(nodeIdx, begin, end);
+        return INVALID;
+    }
+
+    unsigned mid;
+    if (bestAxis == -1) {
+        // every centroid is at the same place, split the range in half
+        mid = begin + count / 2;
+    }
+    else {
+        float binScale = NUM_OF_BINS / centroidExtent[bestAxis];
+        auto midIt = std::partition(_primitives.begin() + begin, _primitives.begin() + end, [&](unsigned primitive) {
+            auto binIdx = std::min(NUM_OF_BINS - 1, static_cast<unsigned>((_centroids[primitive][bestAxis] - centroidBox.min[bestAxis]) * binScale));
+            return binIdx <= bestBin;
+        });
+        mid = static_cast<unsigned>(midIt - _primitives.begin());
+    }
+
+    _nodes[nodeIdx].first = static_cast<unsigned>(_nodes.size());
+    _nodes[nodeIdx].numOfPrimitives = 0;
+    _nodes.push_back({BoundingBox{}, nodeIdx, 0, 0});
+    _nodes.push_back({BoundingBox{}, nodeIdx, 0, 0});
+    return mid;
+}
+
+
+void BoundingVolumeHierarchy::makeLeaf(unsigned nodeIdx, unsigned begin, unsigned end) {
+    auto &node = _nodes[nodeIdx];
+    node.first = begin;
+    node.numOfPrimitives = end - begin;
+    for (unsigned i = begin; i < end; ++i) {
+        _primitiveLeaves[_primitives[i]] = nodeIdx;
+    }
+}
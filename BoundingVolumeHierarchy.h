@@ -0,0 +1,133 @@
+#ifndef BOUNDINGVOLUMEHIERARCHY_H
+#define BOUNDINGVOLUMEHIERARCHY_H
+
+#include <limits>
+#include <utility>
+#include <vector>
+#include "BoundingVolume.h"
+
+
+/***************************************************
+ * Binary BVH over axis aligned boxes, built with binned SAH.
+ * Primitives are referred to by their index in the array passed to build().
+ * Moving primitives are handled by refitting the ancestors of their leaves
+ ***************************************************/
+class BoundingVolumeHierarchy {
+public:
+    static constexpr unsigned INVALID = std::numeric_limits<unsigned>::max();
+
+    BoundingVolumeHierarchy();
+
+    void build(const std::vector<BoundingBox> &boxes);
+
+    void clear();
+
+    inline bool isEmpty() const { return _nodes.empty(); }
+
+    inline std::size_t getNumOfPrimitives() const { return _boxes.size(); }
+
+    inline const BoundingBox &getPrimitiveBox(std::size_t primitive) const { return _boxes[primitive]; }
+
+    // updates the box of a primitive. Ancestors are refitted on the next call to refit()
+    void updatePrimitive(std::size_t primitive, const BoundingBox &box);
+
+    void refit();
+
+    template<typename Func>
+    void queryFrustum(const Frustum &frustum, Func &&func) {
+        if (_nodes.empty())
+            return;
+
+        // nodes fully inside the frustum report their whole subtree without further tests
+        _stack.clear();
+        _stack.push_back({0, false});
+        while (!_stack.empty()) {
+            auto [nodeIdx, isInside] = _stack.back();
+            _stack.pop_back();
+
+            const auto &node = _nodes[nodeIdx];
+            if (!isInside) {
+                if (!frustum.intersects(node.box))
+                    continue;
+
+                isInside = frustum.contains(node.box);
+            }
+
+            if (node.numOfPrimitives > 0) {
+                for (unsigned i = node.first; i < node.first + node.numOfPrimitives; ++i) {
+                    auto primitive = _primitives[i];
+                    if (isInside || frustum.intersects(_boxes[primitive]))
+                        func(static_cast<std::size_t>(primitive));
+                }
+            }
+            else {
+                _stack.push_back({node.first, isInside});
+                _stack.push_back({node.first + 1, isInside});
+            }
+        }
+    }
+
+    template<typename Func>
+    void queryBox(const BoundingBox &box, Func &&func) {
+        if (_nodes.empty())
+            return;
+
+        _stack.clear();
+        _stack.push_back({0, false});
+        while (!_stack.empty()) {
+            auto nodeIdx = _stack.back().first;
+            _stack.pop_back();
+
+            const auto &node = _nodes[nodeIdx];
+            if (!overlaps(node.box, box))
+                continue;
+
+            if (node.numOfPrimitives > 0) {
+                for (unsigned i = node.first; i < node.first + node.numOfPrimitives; ++i) {
+                    auto primitive = _primitives[i];
+                    if (overlaps(_boxes[primitive], box))
+                        func(static_cast<std::size_t>(primitive));
+                }
+            }
+            else {
+                _stack.push_back({node.first, false});
+                _stack.push_back({node.first + 1, false});
+            }
+        }
+    }
+
+    // nearest primitive box hit by the ray. Returns false when nothing is hit
+    bool raycast(glm::vec3 origin, glm::vec3 direction, std::size_t &primitive, float &distance);
+
+private:
+    struct BVHNode {
+        BoundingBox box;
+        unsigned parent;
+        unsigned first;             // first child for internal nodes, first primitive for leaves
+        unsigned numOfPrimitives;   // 0 for internal nodes
+    };
+
+    static constexpr unsigned NUM_OF_BINS = 16;
+    static constexpr unsigned MAX_LEAF_PRIMITIVES = 4;
+
+    static float surfaceArea(const BoundingBox &box);
+
+    static bool overlaps(const BoundingBox &a, const BoundingBox &b);
+
+    static float intersectRay(const BoundingBox &box, glm::vec3 origin, glm::vec3 invDirection, float maxDistance);
+
+    // computes the node box and either turns it into a leaf (returns INVALID) or partitions the range and returns the split point
+    unsigned split(unsigned nodeIdx, unsigned begin, unsigned end);
+
+    void makeLeaf(unsigned nodeIdx, unsigned begin, unsigned end);
+
+    std::vector<BVHNode> _nodes;
+    std::vector<unsigned> _primitives;
+    std::vector<unsigned> _primitiveLeaves;
+    std::vector<BoundingBox> _boxes;
+    std::vector<glm::vec3> _centroids;
+    std::vector<unsigned> _dirtyLeaves;
+    std::vector<std::pair<unsigned, bool>> _stack;
+};
+
+#endif // BOUNDINGVOLUMEHIERARCHY_H
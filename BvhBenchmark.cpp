@@ -0,0 +1,137 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "BoundingVolumeHierarchy.h"
+
+
+// times the BVH against linear scans over synthetic scenes of random boxes. Needs no GL context
+
+static double elapsedMilliseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// boxes of 0.5 to 2 units scattered uniformly in a cube whose volume grows with their number
+static std::vector<BoundingBox> createBoxes(std::size_t numOfBoxes, float extent, std::mt19937 &random) {
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> size(0.5f, 2.0f);
+    std::vector<BoundingBox> boxes;
+    boxes.reserve(numOfBoxes);
+    for (std::size_t i = 0; i < numOfBoxes; ++i) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 halfSize(size(random) * 0.5f);
+        boxes.emplace_back(center - halfSize, center + halfSize);
+    }
+
+    return boxes;
+}
+
+
+static void runScene(std::size_t numOfBoxes) {
+    const int numOfQueries = 100;
+    std::mt19937 random(static_cast<unsigned>(numOfBoxes));
+    float extent = 10.0f * std::cbrt(static_cast<float>(numOfBoxes));
+    auto boxes = createBoxes(numOfBoxes, extent, random);
+
+    BoundingVolumeHierarchy bvh;
+    auto start = std::chrono::steady_clock::now();
+    bvh.build(boxes);
+    double buildTime = elapsedMilliseconds(start);
+
+    // a tenth of the boxes move a little, as animated nodes would
+    std::uniform_int_distribution<std::size_t> anyBox(0, numOfBoxes - 1);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < numOfBoxes / 10; ++i) {
+        auto primitive = anyBox(random);
+        glm::vec3 move(offset(random), offset(random), offset(random));
+        const auto &box = bvh.getPrimitiveBox(primitive);
+        bvh.updatePrimitive(primitive, BoundingBox(box.min + move, box.max + move));
+    }
+
+    bvh.refit();
+    double refitTime = elapsedMilliseconds(start);
+
+    // cameras inside the scene looking in random directions
+    std::uniform_real_distribution<float> eyePosition(-extent * 0.5f, extent * 0.5f);
+    glm::mat4 projMatrix = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, extent * 0.5f);
+    std::vector<Frustum> frustums;
+    std::vector<std::pair<glm::vec3, glm::vec3>> rays;
+    for (int i = 0; i < numOfQueries; ++i) {
+        glm::vec3 eye(eyePosition(random), eyePosition(random), eyePosition(random));
+        glm::vec3 direction = glm::normalize(glm::vec3(offset(random), offset(random), offset(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+        frustums.emplace_back(projMatrix * glm::lookAt(eye, eye + direction, glm::vec3(0.0f, 1.0f, 0.0f)));
+        rays.emplace_back(eye, direction);
+    }
+
+    std::size_t numOfVisible = 0;
+    start = std::chrono::steady_clock::now();
+    for (const auto &frustum : frustums) {
+        bvh.queryFrustum(frustum, [&](std::size_t) { ++numOfVisible; });
+    }
+
+    double frustumTime = elapsedMilliseconds(start) / numOfQueries;
+
+    std::size_t numOfLinearVisible = 0;
+    start = std::chrono::steady_clock::now();
+    for (const auto &frustum : frustums) {
+        for (std::size_t i = 0; i < numOfBoxes; ++i) {
+            if (frustum.intersects(bvh.getPrimitiveBox(i)))
+                ++numOfLinearVisible;
+        }
+    }
+
+    double linearFrustumTime = elapsedMilliseconds(start) / numOfQueries;
+
+    std::size_t numOfHits = 0;
+    start = std::chrono::steady_clock::now();
+    for (const auto &ray : rays) {
+        std::size_t primitive;
+        float distance;
+        if (bvh.raycast(ray.first, ray.second, primitive, distance))
+            ++numOfHits;
+    }
+
+    double raycastTime = elapsedMilliseconds(start) / numOfQueries;
+
+    std::size_t numOfInRange = 0;
+    start = std::chrono::steady_clock::now();
+    for (const auto &ray : rays) {
+        glm::vec3 halfSize(extent * 0.05f);
+        bvh.queryBox(BoundingBox(ray.first - halfSize, ray.first + halfSize), [&](std::size_t) { ++numOfInRange; });
+    }
+
+    double rangeTime = elapsedMilliseconds(start) / numOfQueries;
+
+    std::printf("boxes %zu build %.3f ms refit %.3f ms frustum %.4f ms linear %.4f ms raycast %.4f ms range %.4f ms"
+                " visible %zu linear visible %zu hits %zu in range %zu\n",
+                numOfBoxes, buildTime, refitTime, frustumTime, linearFrustumTime, raycastTime, rangeTime,
+                numOfVisible / numOfQueries, numOfLinearVisible / numOfQueries, numOfHits, numOfInRange / numOfQueries);
+}
+
+
+int main(int argc, char *argv[]) {
+    // box counts can be given on the command line, 10k to 1M by default
+    std::vector<std::size_t> sceneSizes;
+    for (int i = 1; i < argc; ++i) {
+        auto numOfBoxes = std::strtoull(argv[i], nullptr, 10);
+        if (numOfBoxes == 0) {
+            std::fprintf(stderr, "Usage: %s [number of boxes]...\n", argv[0]);
+            return 1;
+        }
+
+        sceneSizes.push_back(static_cast<std::size_t>(numOfBoxes));
+    }
+
+    if (sceneSizes.empty())
+        sceneSizes = {10000, 100000, 1000000};
+
+    for (auto numOfBoxes : sceneSizes)
+        runScene(numOfBoxes);
+
+    return 0;
+}
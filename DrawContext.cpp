@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
 #include <utility>
 #include <glm/gtc/matrix_transform.hpp>
 #include "DrawContext.h"
@@ -77,10 +80,51 @@ glm::mat4 Camera::getProjMatrix() const {
  * EffectProperty definitions
  ***************************************************************/
 EffectProperty::EffectProperty(Effect *effect, const std::map<std::string, GLUniform> &values)
-    : _effect{effect}, _values{values}
+    : _idPool{effect->getContext()->getEffectPropertyIds()},
+    _effect{effect},
+    _values{values},
+    _id{_idPool->acquire()}
 {}
 
 
+EffectProperty::EffectProperty(const EffectProperty &other)
+    : _idPool{other._idPool},
+    _effect{other._effect},
+    _values{other._values},
+    _id{_idPool->acquire()}
+{}
+
+
+EffectProperty::EffectProperty(EffectProperty &&other) noexcept
+    : _idPool{std::move(other._idPool)},
+    _effect{other._effect},
+    _values{std::move(other._values)},
+    _id{other._id}
+{}
+
+
+EffectProperty &EffectProperty::operator=(EffectProperty other) noexcept {
+    other.swap(*this);
+    return *this;
+}
+
+
+EffectProperty::~EffectProperty() {
+    // moved from properties hold no id
+    if (_idPool)
+        _idPool->release(_id);
+}
+
+
+void EffectProperty::swap(EffectProperty &other) noexcept {
+    using std::swap;
+    swap(_idPool, other._idPool);
+    swap(_effect, other._effect);
+    swap(_values, other._values);
+    swap(_id, other._id);
+}
+
+
 const GLUniform *EffectProperty::getParam(const std::string &name) const {
     auto uniform = _values.find(name);
     if (uniform == _values.end())
@@ -97,9 +141,119 @@ GLUniform *EffectProperty::getParam(const std::string &name) {
 }
 
 
+/***************************************************************
+ * Effect definitions
+ ***************************************************************/
+const std::size_t Effect::MIN_INSTANCES = 2;
+const std::size_t Effect::MIN_MULTI_DRAWS = 2;
+
+Effect::Effect(DrawContext *context)
+    : _context{context}, _id{context->getEffectIds().acquire()}
+{}
+
+
+// effects are owned by their context, which outlives them
+Effect::~Effect() {
+    _context->getEffectIds().release(_id);
+}
+
+
+std::size_t Effect::findInstanceRangeEnd(const std::vector<Drawable *> &drawables, std::size_t begin) {
+    auto meshRange = drawables[begin]->getMeshRange();
+    auto effectProperty = drawables[begin]->getEffectProperty();
+    std::size_t end = begin + 1;
+    if (!meshRange.vertexArray || drawables[begin]->getVisibleMeshRanges())
+        return end;
+
+    // the render queue sorts by effect then vertex array then effect property, so instances are adjacent.
+    // Cluster culled drawables draw different ranges and are never instanced
+    while (end < drawables.size() &&
+           drawables[end]->getEffectProperty() == effectProperty &&
+           drawables[end]->getMeshRange() == meshRange &&
+           !drawables[end]->getVisibleMeshRanges())
+    {
+        ++end;
+    }
+
+    return end;
+}
+
+
+std::size_t Effect::findMultiDrawRangeEnd(const std::vector<Drawable *> &drawables, std::size_t begin) const {
+    const auto &meshBuffer = _context->getMeshBuffer();
+    std::size_t end = begin;
+    while (end < drawables.size() && meshBuffer.isPacked(drawables[end]->getMeshRange().vertexArray)) {
+        ++end;
+    }
+
+    return end;
+}
+
+
+void Effect::flushInstances(Drawable &drawable, GLBuffer &instanceBuffer, int numOfInstanceMatrices, std::size_t instanceCount) {
+    assert(_instanceData.size() == instanceCount * static_cast<std::size_t>(numOfInstanceMatrices) && "INSTANCE MATRIX COUNT MISMATCH");
+    instanceBuffer.bind();
+    instanceBuffer.loadData(_instanceData.data(), static_cast<int>(_instanceData.size() * sizeof(glm::mat4)));
+    drawable.drawInstanced(instanceBuffer, numOfInstanceMatrices, static_cast<int>(instanceCount));
+}
+
+
+void Effect::appendDrawCommands(const Drawable &drawable, unsigned drawId) {
+    // every visible run of a cluster culled drawable is a command reading the same draw id
+    auto visibleMeshRanges = drawable.getVisibleMeshRanges();
+    if (visibleMeshRanges) {
+        for (const auto &meshRange : *visibleMeshRanges) {
+            auto firstIndex = meshRange.elementOffset / static_cast<unsigned>(sizeof(unsigned));
+            _drawCommands.push_back({meshRange.numOfElements, 1, firstIndex, 0, drawId});
+        }
+
+        return;
+    }
+
+    auto meshRange = drawable.getMeshRange();
+    auto firstIndex = meshRange.elementOffset / static_cast<unsigned>(sizeof(unsigned));
+    if (!_drawCommands.empty() &&
+        _drawCommands.back().firstIndex == firstIndex &&
+        _drawCommands.back().count == meshRange.numOfElements &&
+        _drawCommands.back().baseInstance + _drawCommands.back().instanceCount == drawId)
+    {
+        ++_drawCommands.back().instanceCount;
+    }
+    else {
+        _drawCommands.push_back({meshRange.numOfElements, 1, firstIndex, 0, drawId});
+    }
+}
+
+
+void Effect::flushMultiDraw(GLBufferTexture &drawData, unsigned drawDataUnit) {
+    drawData.loadData(_drawDataTexels.data(), static_cast<int>(_drawDataTexels.size() * sizeof(glm::vec4)));
+    drawData.bind(drawDataUnit);
+    _context->getMeshBuffer().multiDraw(_drawCommands);
+}
+
+
 /***************************************************************
  * DrawContext definitions
  ***************************************************************/
+void DrawContext::enableOcclusionCulling(bool enable) {
+    if (!enable)
+        _occlusionCuller.reset();
+    else if (!_occlusionCuller)
+        _occlusionCuller = std::make_unique<OcclusionCuller>(&_threadPool);
+}
+
+
+void DrawContext::enableDepthPrepass(bool enable) {
+    if (!enable) {
+        _depthPrepassEffect.reset();
+    }
+    else if (!_depthPrepassEffect) {
+        _depthPrepassEffect = std::make_unique<DepthPrepassEffect>(this);
+        _depthPrepassEffect->setName(DepthPrepassEffect::EFFECT_NAME);
+    }
+}
+
+
 Drawable *DrawContext::getPointLightGeometry() {
     if (!_pointLightGeometry) {
         _pointLightGeometry = createPointLightGeometry();
@@ -125,74 +279,449 @@ std::unique_ptr<Drawable> DrawContext::createPointLightGeometry() {
 }
 
 
+#ifdef SCENE_NODE_TREE
+static void collectPickBoxes(DrawContext::SceneNode &node, const glm::mat4 &parentTransformation, bool isParentChanged,
+                             std::vector<BoundingBox> &boxes, std::vector<Drawable *> &drawables)
+{
+    bool isChanged = node.updateWorldTransformation(parentTransformation, isParentChanged);
+    const auto &drawable = node.getDrawable();
+    if (drawable && drawable->getEffectProperty()) {
+        auto box = drawable->getBoundingBox();
+        if (box && !box->isEmpty()) {
+            boxes.push_back(box->transform(node.getWorldTransformation()));
+            drawables.push_back(drawable.get());
+        }
+    }
+
+    for (auto child = node.childBegin(); child != node.childEnd(); ++child) {
+        collectPickBoxes(*child, node.getWorldTransformation(), isChanged, boxes, drawables);
+    }
+}
+
+
+// the tree keeps no BVH between frames, picking is rare enough to build one for the ray
+Drawable *DrawContext::pick(glm::vec3 origin, glm::vec3 direction) {
+    std::vector<BoundingBox> boxes;
+    std::vector<Drawable *> drawables;
+    collectPickBoxes(_root, glm::mat4(1.0f), false, boxes, drawables);
+    _bvh.build(boxes);
+
+    std::size_t primitive;
+    float distance;
+    if (!_bvh.raycast(origin, direction, primitive, distance))
+        return nullptr;
+
+    return drawables[primitive];
+}
+#else
+void DrawContext::updateBoundingVolumeHierarchy() {
+    if (_bvhStructureVersion != _scene.getStructureVersion()) {
+        buildBoundingVolumeHierarchy();
+        return;
+    }
+
+    if (_scene.getChangedIndices().empty())
+        return;
+
+    for (auto nodeIdx : _scene.getChangedIndices()) {
+        auto primitive = _nodePrimitives[nodeIdx];
+        if (primitive == BoundingVolumeHierarchy::INVALID)
+            continue;
+
+        const auto &drawable = _scene.drawableAt(nodeIdx);
+        _bvh.updatePrimitive(primitive, drawable->getBoundingBox()->transform(_scene.worldTransformationAt(nodeIdx)));
+    }
+
+    _bvh.refit();
+}
+
+
+Drawable *DrawContext::pick(glm::vec3 origin, glm::vec3 direction) {
+    _scene.updateTransformations();
+    updateBoundingVolumeHierarchy();
+
+    std::size_t primitive;
+    float distance;
+    if (!_bvh.raycast(origin, direction, primitive, distance))
+        return nullptr;
+
+    return _scene.drawableAt(_primitiveNodes[primitive]).get();
+}
+
+
+void DrawContext::buildBoundingVolumeHierarchy() {
+    _primitiveNodes.clear();
+    _unboundedNodes.clear();
+    _pointLightNodes.clear();
+    _nodePrimitives.assign(_scene.size(), BoundingVolumeHierarchy::INVALID);
+
+    std::vector<BoundingBox> boxes;
+    for (std::size_t i = 0; i < _scene.size(); ++i) {
+        const auto &drawable = _scene.drawableAt(i);
+        if (!drawable)
+            continue;
+
+        if (drawable->asPointLight())
+            _pointLightNodes.push_back(static_cast<unsigned>(i));
+
+        if (!drawable->getEffectProperty())
+            continue;
+
+        auto box = drawable->getBoundingBox();
+        if (!box || box->isEmpty()) {
+            _unboundedNodes.push_back(static_cast<unsigned>(i));
+            continue;
+        }
+
+        _nodePrimitives[i] = static_cast<unsigned>(boxes.size());
+        _primitiveNodes.push_back(static_cast<unsigned>(i));
+        boxes.push_back(box->transform(_scene.worldTransformationAt(i)));
+    }
+
+    _bvh.build(boxes);
+    _bvhStructureVersion = _scene.getStructureVersion();
+}
+#endif
+
+
 
 
 /***************************************************
  * NodeAction definitions
  ***************************************************/
-static void createDrawRequest(DrawContext::SceneNode &node, glm::mat4 transformation,
-                              std::map<Effect *, std::vector<Drawable *>> &drawRequests,
-                              std::vector<PointLight *> &pointLights)
+static bool isVisible(const Drawable &drawable, const glm::mat4 &transformation, const Frustum &frustum) {
+    // drawables without bounds are never culled, like the unbounded nodes of the BVH
+    auto box = drawable.getBoundingBox();
+    if (!box || box->isEmpty())
+        return true;
+
+    // cheap sphere rejection first, then the tighter box test
+    auto sphere = drawable.getBoundingSphere();
+    if (sphere && !frustum.intersects(sphere->transform(transformation)))
+        return false;
+
+    return frustum.intersects(box->transform(transformation));
+}
+
+
+// camera state shared by the draw requests of a frame
+struct DrawView {
+    glm::mat4 viewMatrix;
+    glm::mat4 projMatrix;
+    Frustum frustum;
+    glm::vec3 cameraPosition;
+};
+
+
+static float selectLevelOfDetail(Drawable &drawable, const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix) {
+    auto boundingSphere = drawable.getBoundingSphere();
+    if (drawable.getNumOfLevelsOfDetail() < 2 || !boundingSphere)
+        return 0.0f;
+
+    // the error is projected at the nearest point of the bounds. The projection scales view space
+    // heights at unit depth by proj[1][1] into normalized coordinates spanning two viewport heights
+    auto sphere = boundingSphere->transform(drawable.getTransformation());
+    float scale = boundingSphere->radius > 0.0f ? sphere.radius / boundingSphere->radius : 1.0f;
+    float distance = glm::length(glm::vec3(viewMatrix * glm::vec4(sphere.center, 1.0f))) - sphere.radius;
+    if (distance > 0.0f)
+        return drawable.selectLevelOfDetail(0.5f * projMatrix[1][1] * scale / distance);
+
+    return drawable.selectLevelOfDetail(std::numeric_limits<float>::infinity());
+}
+
+
+static void queueDrawable(Drawable &drawable, const DrawView &view,
+                          RenderQueue &renderQueue, CullingStatistics &cullingStatistics)
 {
-    transformation = glm::scale(transformation, node.scale());
-    transformation = glm::rotate(transformation, glm::angle(node.rotation()), glm::axis(node.rotation()));
-    transformation = glm::translate(transformation, node.position());
-
-    auto &drawable = node.getDrawable();
-    if (drawable) {
-        drawable->setTransformation(transformation);
-
-        // check if it is point light
-        auto pointLight = drawable->asPointLight();
-        if (pointLight) {
-            pointLights.push_back(pointLight);
+    float levelOfDetailError = selectLevelOfDetail(drawable, view.viewMatrix, view.projMatrix);
+    cullingStatistics.levelOfDetailError = std::max(cullingStatistics.levelOfDetailError, levelOfDetailError);
+    cullingStatistics.culledClusters += drawable.cullClusters(view.frustum, view.cameraPosition);
+
+    // a drawable whose clusters are all culled is skipped
+    auto visibleMeshRanges = drawable.getVisibleMeshRanges();
+    if (visibleMeshRanges) {
+        if (visibleMeshRanges->empty())
+            return;
+
+        for (const auto &meshRange : *visibleMeshRanges) {
+            cullingStatistics.triangles += meshRange.numOfElements / 3;
         }
+    }
+    else {
+        cullingStatistics.triangles += drawable.getMeshRange().numOfElements / 3;
+    }
+
+    auto effectProperty = drawable.getEffectProperty();
+    auto effect = effectProperty->getEffect();
+    auto vao = drawable.getVertexArray();
+    float viewDepth = -(view.viewMatrix * drawable.getTransformation()[3]).z;
+    auto key = RenderQueue::createKey(RenderQueue::OPAQUE_PASS,
+                                      effect->getId(),
+                                      effectProperty->getId(),
+                                      vao ? vao->getId() : 0,
+                                      viewDepth);
+
+    renderQueue.pushDrawable(key, effect, &drawable);
+}
+
+
+// removes the drawables hidden behind the largest visible occluders
+static void cullOccluded(OcclusionCuller &occlusionCuller, const DrawView &view,
+                         std::vector<Drawable *> &drawables, std::vector<std::pair<float, Drawable *>> &occluders,
+                         CullingStatistics &cullingStatistics)
+{
+    // the occluders covering the most of the screen, by bounding sphere radius over distance
+    occluders.clear();
+    for (auto drawable : drawables) {
+        auto boundingSphere = drawable->getBoundingSphere();
+        if (!drawable->getOccluder() || !boundingSphere)
+            continue;
+
+        auto sphere = boundingSphere->transform(drawable->getTransformation());
+        float distance = glm::length(sphere.center - view.cameraPosition);
+        float size = distance > sphere.radius ? sphere.radius / distance : std::numeric_limits<float>::max();
+        if (size >= OcclusionCuller::MIN_OCCLUDER_SIZE)
+            occluders.emplace_back(size, drawable);
+    }
+
+    if (occluders.empty())
+        return;
+
+    auto numOfOccluders = std::min(occluders.size(), OcclusionCuller::MAX_OCCLUDERS);
+    std::partial_sort(occluders.begin(), occluders.begin() + static_cast<std::ptrdiff_t>(numOfOccluders), occluders.end(),
+                      [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    occlusionCuller.begin(view.projMatrix * view.viewMatrix);
+    for (std::size_t i = 0; i < numOfOccluders; ++i) {
+        auto drawable = occluders[i].second;
+        occlusionCuller.addOccluder(*drawable->getOccluder(), drawable->getTransformation());
+    }
+
+    occlusionCuller.rasterize();
+    cullingStatistics.occluders = numOfOccluders;
+
+    // an occluder lies behind its own depth, so only other occluders can hide it
+    auto end = std::remove_if(drawables.begin(), drawables.end(), [&](const Drawable *drawable) {
+        auto box = drawable->getBoundingBox();
+        return box && !box->isEmpty() && occlusionCuller.isOccluded(box->transform(drawable->getTransformation()));
+    });
+
+    cullingStatistics.occluded = static_cast<std::size_t>(drawables.end() - end);
+    drawables.erase(end, drawables.end());
+}
+
+
+static void createDrawRequest(const std::unique_ptr<Drawable> &drawable, const glm::mat4 &transformation,
+                              const DrawView &view, RenderQueue &renderQueue, std::vector<Drawable *> &visibleDrawables,
+                              CullingStatistics &cullingStatistics)
+{
+    if (!drawable)
+        return;
+
+    drawable->setTransformation(transformation);
+
+    // check if it is point light
+    auto pointLight = drawable->asPointLight();
+    if (pointLight) {
+        renderQueue.pushPointLight(pointLight);
+    }
 
-        // map drawable to effects
-        auto effectProperty = drawable->getEffectProperty();
-        if (effectProperty) {
-            auto effect = effectProperty->getEffect();
-            drawRequests[effect].push_back(drawable.get());
+    // visible drawables are queued after occlusion culling
+    auto effectProperty = drawable->getEffectProperty();
+    if (effectProperty) {
+        if (!isVisible(*drawable, transformation, view.frustum)) {
+            ++cullingStatistics.culled;
+            return;
         }
+
+        ++cullingStatistics.visible;
+        visibleDrawables.push_back(drawable.get());
     }
+}
+
+
+#ifdef SCENE_NODE_TREE
+static void createDrawRequests(DrawContext::SceneNode &node, const glm::mat4 &parentTransformation, bool isParentChanged,
+                               const DrawView &view, RenderQueue &renderQueue, std::vector<Drawable *> &visibleDrawables,
+                               CullingStatistics &cullingStatistics)
+{
+    bool isChanged = node.updateWorldTransformation(parentTransformation, isParentChanged);
+    const auto &transformation = node.getWorldTransformation();
+    createDrawRequest(node.getDrawable(), transformation, view, renderQueue, visibleDrawables, cullingStatistics);
 
     for (auto child = node.childBegin(); child != node.childEnd(); ++child) {
-        createDrawRequest(*child, transformation, drawRequests, pointLights);
+        createDrawRequests(*child, transformation, isChanged, view, renderQueue, visibleDrawables, cullingStatistics);
     }
 }
 
 
-static glm::mat4 parentTransformation(DrawContext::SceneNode *node) {
+static bool updateParentTransformation(DrawContext::SceneNode *node) {
     if (node == nullptr)
-        return glm::mat4(1.0f);
+        return false;
+
+    auto parent = node->getParent();
+    bool isParentChanged = updateParentTransformation(parent);
+    return node->updateWorldTransformation(parent ? parent->getWorldTransformation() : glm::mat4(1.0f), isParentChanged);
+}
+#else
+static void createDrawRequests(DrawContext &context, const DrawView &view, RenderQueue &renderQueue,
+                               std::vector<Drawable *> &visibleDrawables, CullingStatistics &cullingStatistics)
+{
+    auto &scene = context.getScene();
+    for (auto nodeIdx : context.getPointLightNodeIndices()) {
+        auto &drawable = scene.drawableAt(nodeIdx);
+        drawable->setTransformation(scene.worldTransformationAt(nodeIdx));
+        renderQueue.pushPointLight(drawable->asPointLight());
+    }
+
+    auto queueNode = [&](std::size_t nodeIdx) {
+        auto &drawable = scene.drawableAt(nodeIdx);
+        drawable->setTransformation(scene.worldTransformationAt(nodeIdx));
+        visibleDrawables.push_back(drawable.get());
+    };
+
+    for (auto nodeIdx : context.getUnboundedNodeIndices()) {
+        queueNode(nodeIdx);
+    }
+
+    auto &bvh = context.getBoundingVolumeHierarchy();
+    std::size_t numOfVisible = 0;
+    bvh.queryFrustum(view.frustum, [&](std::size_t primitive) {
+        queueNode(context.getPrimitiveNodeIndex(primitive));
+        ++numOfVisible;
+    });
+
+    cullingStatistics.visible = context.getUnboundedNodeIndices().size() + numOfVisible;
+    cullingStatistics.culled = bvh.getNumOfPrimitives() - numOfVisible;
+}
+#endif
+
+
+// entries of the same effect are contiguous after sorting
+static std::size_t findEffectRunEnd(const std::vector<RenderQueue::Entry> &entries, std::size_t begin) {
+    std::size_t end = begin + 1;
+    while (end < entries.size() && entries[end].effect == entries[begin].effect) {
+        ++end;
+    }
+
+    return end;
+}
 
-    auto transformation = parentTransformation(node->getParent());
-    transformation = glm::scale(transformation, node->scale());
-    transformation = glm::rotate(transformation, glm::angle(node->rotation()), glm::axis(node->rotation()));
-    transformation = glm::translate(transformation, node->position());
 
-    return transformation;
+// writes the depth of every drawable whose effect supports the prepass, without color
+static void drawDepthPrepass(DrawContext &context, Effect &depthPrepassEffect, RenderQueue &renderQueue) {
+    auto &driver = context.getDriver();
+    driver.setColorMask(false, false, false, false);
+    driver.enableDepthTest(true);
+    driver.enableDepthMask(true);
+    driver.setDepthFunc(GL_LESS);
+    driver.setDepthRange(0.0, 1.0);
+    driver.enableStencilTest(false);
+    driver.enableCullFace(false);
+    driver.enableBlend(false);
+
+    const auto &entries = renderQueue.getEntries();
+    std::size_t numOfPrepassed = 0;
+    std::size_t begin = 0;
+    while (begin < entries.size()) {
+        std::size_t end = findEffectRunEnd(entries, begin);
+        if (entries[begin].effect->supportsDepthPrepass()) {
+            depthPrepassEffect.draw(renderQueue.getBatch(begin, end), renderQueue.getPointLights());
+            numOfPrepassed += end - begin;
+        }
+
+        begin = end;
+    }
+
+    context.getProfiler().setCounter("depth prepassed", static_cast<double>(numOfPrepassed));
 }
 
 
-void NodeAction<std::unique_ptr<Drawable>>::draw(DrawContext::SceneNode &node) {
-    std::map<Effect *, std::vector<Drawable *>> drawRequest;
-    std::vector<PointLight *> pointLights;
-    glm::mat4 transformation = parentTransformation(node.getParent());
-    createDrawRequest(node, transformation, drawRequest, pointLights);
+void NodeAction<std::unique_ptr<Drawable>>::draw(DrawContext::SceneNode &node, DrawContext &context) {
+    auto &renderQueue = context.getRenderQueue();
+    renderQueue.clear();
+
+#ifndef SCENE_NODE_TREE
+    // the BVH consumes the changed indices of every update, whichever path draws
+    auto &scene = context.getScene();
+    scene.updateTransformations();
+    context.updateBoundingVolumeHierarchy();
+#endif
+
+    auto &cullingStatistics = context.getCullingStatistics();
+    cullingStatistics = CullingStatistics{};
+
+    const auto &camera = context.getCamera();
+    glm::mat4 viewMatrix = camera.getViewMatrix();
+    glm::mat4 projMatrix = camera.getProjMatrix();
+    // the eye sits at the focus offset by the camera position
+    DrawView view{viewMatrix, projMatrix, Frustum(projMatrix * viewMatrix), camera.getFocus() + camera.getPosition()};
+    auto &profiler = context.getProfiler();
+    auto &visibleDrawables = context.getVisibleDrawables();
+    visibleDrawables.clear();
+    {
+        ProfilerScope scope(profiler, "traversal");
+#ifdef SCENE_NODE_TREE
+        auto parent = node.getParent();
+        bool isParentChanged = updateParentTransformation(parent);
+        createDrawRequests(node, parent ? parent->getWorldTransformation() : glm::mat4(1.0f), isParentChanged,
+                           view, renderQueue, visibleDrawables, cullingStatistics);
+#else
+        if (scene.getNumOfRoots() == 1 && !node.getParent().isValid()) {
+            // the BVH covers the whole scene, so it is only used when drawing from the root
+            createDrawRequests(context, view, renderQueue, visibleDrawables, cullingStatistics);
+        }
+        else {
+            scene.forEachInSubtree(node, [&](std::size_t nodeIdx) {
+                createDrawRequest(scene.drawableAt(nodeIdx), scene.worldTransformationAt(nodeIdx),
+                                  view, renderQueue, visibleDrawables, cullingStatistics);
+            });
+        }
+#endif
+    }
+
+    auto occlusionCuller = context.getOcclusionCuller();
+    if (occlusionCuller) {
+        ProfilerScope scope(profiler, "occlusion culling");
+        cullOccluded(*occlusionCuller, view, visibleDrawables, context.getOccluderCandidates(), cullingStatistics);
+    }
+
+    {
+        ProfilerScope scope(profiler, "queue");
+        for (auto drawable : visibleDrawables) {
+            queueDrawable(*drawable, view, renderQueue, cullingStatistics);
+        }
+    }
+
+    {
+        ProfilerScope scope(profiler, "sort");
+        renderQueue.sort();
+    }
+
+    const auto &entries = renderQueue.getEntries();
+    auto depthPrepassEffect = context.getDepthPrepassEffect();
+    if (depthPrepassEffect) {
+        ProfilerScope scope(profiler, "depth prepass", true);
+        drawDepthPrepass(context, *depthPrepassEffect, renderQueue);
+    }
+
+    std::size_t begin = 0;
+    while (begin < entries.size()) {
+        auto effect = entries[begin].effect;
+        std::size_t end = findEffectRunEnd(entries, begin);
 
-    for (auto &request : drawRequest) {
         // reset driver
-        auto effect = request.first;
-        auto &driver = effect->getContext()->getDriver();
+        auto &driver = context.getDriver();
 
         // TODO rebind to default framebuffer
         // TODO reset viewport
         driver.setColorMask(true, true, true, true);
 
+        // prepassed depth is only tested, the shaded fragments are the visible ones
+        bool isDepthPrepassed = depthPrepassEffect && effect->supportsDepthPrepass();
         driver.enableDepthTest(true);
-        driver.enableDepthMask(true);
-        driver.setDepthFunc(GL_LESS);
+        driver.enableDepthMask(!isDepthPrepassed);
+        driver.setDepthFunc(isDepthPrepassed ? GL_LEQUAL : GL_LESS);
         driver.setDepthRange(0.0, 1.0);
 
         driver.enableStencilTest(false);
@@ -208,8 +737,25 @@ void NodeAction<std::unique_ptr<Drawable>>::draw(DrawContext::SceneNode &node) {
         driver.setBlendEquation(GL_FUNC_ADD);
 
         // draw scene node
-        auto &drawables = request.second;
-        effect->draw(drawables, pointLights);
+        ProfilerScope scope(profiler, effect->getDrawScopeName(), true);
+        const auto &drawables = renderQueue.getBatch(begin, end);
+        effect->draw(drawables, renderQueue.getPointLights());
+
+        begin = end;
     }
-}
 
+    // a prepassed effect drawn last leaves depth writes off, which would stop the next frame's clear
+    auto &driver = context.getDriver();
+    driver.enableDepthMask(true);
+    driver.setDepthFunc(GL_LESS);
+
+    if (profiler.isEnabled()) {
+        const auto &driverStatistics = driver.getStatistics();
+        profiler.setCounter("visible", static_cast<double>(cullingStatistics.visible));
+        profiler.setCounter("occluded", static_cast<double>(cullingStatistics.occluded));
+        profiler.setCounter("triangles", static_cast<double>(cullingStatistics.triangles));
+        profiler.setCounter("draw calls", static_cast<double>(driverStatistics.drawCalls));
+        profiler.setCounter("state changes", static_cast<double>(driverStatistics.issuedStateCalls));
+        profiler.setCounter("uniform uploads", static_cast<double>(driverStatistics.issuedUniformUploads));
+    }
+}
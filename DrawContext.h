@@ -4,6 +4,14 @@
 #include <queue>
 #include "GLDriver.h"
 #include "Scene.h"
+#include "RenderQueue.h"
+#include "BoundingVolume.h"
+#include "BoundingVolumeHierarchy.h"
+#include "MeshBuffer.h"
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "VertexFormat.h"
 
 class DrawContext;
 class Effect;
@@ -53,10 +61,23 @@ public:
 
     EffectProperty(Effect *effect, const std::map<std::string, GLUniform> &values);
 
+    // a copy is another material and gets its own id
+    EffectProperty(const EffectProperty &other);
+
+    EffectProperty(EffectProperty &&other) noexcept;
+
+    EffectProperty &operator=(EffectProperty other) noexcept;
+
+    ~EffectProperty();
+
+    void swap(EffectProperty &other) noexcept;
+
     inline Effect *getEffect() { return _effect; }
 
     inline const Effect *getEffect() const { return _effect; }
 
+    inline unsigned getId() const { return _id; }
+
     template<typename T>
     void setParam(const std::string &name, T &&val) {
         _values.at(name).setValue(std::forward<T>(val));
@@ -75,21 +96,48 @@ public:
     inline ConstIterator end() const { return _values.end(); }
 
 private:
+    // shared so that properties released after their context still return their id
+    std::shared_ptr<SortKeyIdPool> _idPool;
     Effect *_effect;
     std::map<std::string, GLUniform> _values;
+    unsigned _id;
+};
+
+
+// range of elements drawn from a vertex array
+struct MeshRange {
+    const GLVertexArray *vertexArray = nullptr;
+    unsigned elementOffset = 0;
+    unsigned numOfElements = 0;
+
+    inline bool operator==(const MeshRange &other) const {
+        return vertexArray == other.vertexArray &&
+               elementOffset == other.elementOffset &&
+               numOfElements == other.numOfElements;
+    }
 };
 
 
 class Effect {
 public:
-    Effect(DrawContext *context)
-        : _context{context}
-    {}
+    Effect(DrawContext *context);
 
-    virtual ~Effect() = default;
+    virtual ~Effect();
 
     inline DrawContext *getContext() { return _context; }
 
+    inline unsigned getId() const { return _id; }
+
+    inline const std::string &getName() const { return _name; }
+
+    inline void setName(const std::string &name) {
+        _name = name;
+        _drawScopeName = "draw " + name;
+    }
+
+    // profiler scope of the effect's draws, built once so disabled profiling formats nothing
+    inline const char *getDrawScopeName() const { return _drawScopeName.c_str(); }
+
     virtual const std::map<std::string, int> &getAttributes() const = 0;
 
     virtual EffectProperty createEffectProperty() = 0;
@@ -97,8 +145,67 @@ public:
     virtual void draw(const std::vector<Drawable*> &drawables,
                       const std::vector<PointLight *> &pointLights) = 0;
 
+    // drawables of the effect are laid down by the depth prepass first and shaded with GL_LEQUAL and
+    // without depth writes. The effect must compute positions like the DepthPrepassEffect
+    virtual bool supportsDepthPrepass() const { return false; }
+
 protected:
+    // end of the run of drawables starting at begin that can be drawn as instances of one mesh
+    static std::size_t findInstanceRangeEnd(const std::vector<Drawable*> &drawables, std::size_t begin);
+
+    // end of the run of drawables starting at begin that are packed in the context mesh buffer
+    std::size_t findMultiDrawRangeEnd(const std::vector<Drawable*> &drawables, std::size_t begin) const;
+
+    // draws a run of instances with the matrices writeMatrices(drawable, matrices) appends per drawable.
+    // The instanced program must be bound
+    template<typename MatrixWriter>
+    void submitInstances(const std::vector<Drawable*> &drawables, std::size_t begin, std::size_t end,
+                         GLBuffer &instanceBuffer, int numOfInstanceMatrices, MatrixWriter &&writeMatrices)
+    {
+        _instanceData.clear();
+        for (std::size_t i = begin; i < end; ++i)
+            writeMatrices(*drawables[i], _instanceData);
+
+        flushInstances(*drawables[begin], instanceBuffer, numOfInstanceMatrices, end - begin);
+    }
+
+    // draws a packed run with one indirect command per visible mesh range. The texels writeTexels(drawable, texels)
+    // appends per drawable are fetched through the draw id. The multi draw program must be bound and sample the unit
+    template<typename TexelWriter>
+    void submitMultiDraw(const std::vector<Drawable*> &drawables, std::size_t begin, std::size_t end,
+                         GLBufferTexture &drawData, unsigned drawDataUnit, TexelWriter &&writeTexels)
+    {
+        _drawDataTexels.clear();
+        _drawCommands.clear();
+        for (std::size_t i = begin; i < end; ++i) {
+            writeTexels(*drawables[i], _drawDataTexels);
+            appendDrawCommands(*drawables[i], static_cast<unsigned>(i - begin));
+        }
+
+        flushMultiDraw(drawData, drawDataUnit);
+    }
+
+    static const std::size_t MIN_INSTANCES;
+    static const std::size_t MIN_MULTI_DRAWS;
+
     DrawContext *_context;
+
+private:
+    void flushInstances(Drawable &drawable, GLBuffer &instanceBuffer, int numOfInstanceMatrices, std::size_t instanceCount);
+
+    // consecutive draws of the same mesh become instances of one command
+    void appendDrawCommands(const Drawable &drawable, unsigned drawId);
+
+    void flushMultiDraw(GLBufferTexture &drawData, unsigned drawDataUnit);
+
+    unsigned _id;
+    std::string _name;
+    std::string _drawScopeName;
+
+    // reused by every submitted run
+    std::vector<glm::mat4> _instanceData;
+    std::vector<glm::vec4> _drawDataTexels;
+    std::vector<GLDrawElementsIndirectCommand> _drawCommands;
 };
 
 
@@ -128,8 +235,41 @@ public:
 
     virtual EffectProperty *getEffectProperty() { return nullptr; }
 
+    virtual const GLVertexArray *getVertexArray() const { return nullptr; }
+
+    // bounds in model space. Drawables without bounds are never culled
+    virtual const BoundingBox *getBoundingBox() const { return nullptr; }
+
+    virtual const BoundingSphere *getBoundingSphere() const { return nullptr; }
+
+    // drawables sharing a mesh range and effect property can be drawn instanced
+    virtual MeshRange getMeshRange() const { return {}; }
+
+    // maps stored vertex positions to model space, effects append it to the model matrix for positions only
+    virtual glm::mat4 getVertexDecodeMatrix() const { return glm::mat4(1.0f); }
+
+    // number of meshes of decreasing detail the drawable switches between
+    virtual std::size_t getNumOfLevelsOfDetail() const { return 1; }
+
+    // screenScale maps a model space distance to a fraction of the viewport height.
+    // Returns the error of the selected level scaled the same way
+    virtual float selectLevelOfDetail(float /*screenScale*/) { return 0.0f; }
+
+    // culls the clusters of the selected mesh range against the world space frustum and
+    // camera position and returns how many were culled
+    virtual std::size_t cullClusters(const Frustum & /*frustum*/, glm::vec3 /*cameraPosition*/) { return 0; }
+
+    // runs of the mesh range left by cluster culling, nullptr when the whole range is drawn
+    virtual const std::vector<MeshRange> *getVisibleMeshRanges() const { return nullptr; }
+
+    // triangles in model space rasterized to hide other drawables, nullptr when it occludes nothing
+    virtual const OccluderMesh *getOccluder() const { return nullptr; }
+
     virtual void draw() = 0;
 
+    // per instance matrices are read from the buffer starting at Geometry::INSTANCE_MATRIX_LOCATION
+    virtual void drawInstanced(GLBuffer &, int /*numOfInstanceMatrices*/, int /*instanceCount*/) {}
+
 protected:
     DrawContext *_context;
     glm::mat4 _transformation;
@@ -139,12 +279,53 @@ private:
 };
 
 
+struct CullingStatistics {
+    std::size_t visible = 0;
+    std::size_t culled = 0;
+
+    // of the visible drawables after level of detail selection and cluster culling
+    std::size_t triangles = 0;
+    std::size_t culledClusters = 0;
+
+    // largest simplification error of the selected levels of detail, as a fraction of the viewport height
+    float levelOfDetailError = 0.0f;
+
+    // visible drawables hidden behind occluders, counted in visible as well
+    std::size_t occluded = 0;
+    std::size_t occluders = 0;
+};
+
+
 class DrawContext {
 public:
+#ifdef SCENE_NODE_TREE
+    // the pointer tree is culled per drawable while it is traversed, without the BVH
     using SceneNode = Node<std::unique_ptr<Drawable>>;
+#else
+    using Scene = FlatScene<std::unique_ptr<Drawable>>;
+
+    using SceneNode = Scene::NodeHandle;
+#endif
 
     inline GLDriver &getDriver() { return _driver; }
 
+    inline MeshBuffer &getMeshBuffer() { return _meshBuffer; }
+
+    inline const MeshBuffer &getMeshBuffer() const { return _meshBuffer; }
+
+    // effects compile their shaders for the format and geometries are stored in it,
+    // so it is set before either is created
+    inline void setVertexFormat(const VertexFormat &format) {
+        _vertexFormat = format;
+        _meshBuffer.setVertexFormat(format);
+    }
+
+    inline const VertexFormat &getVertexFormat() const { return _vertexFormat; }
+
+#ifndef SCENE_NODE_TREE
+    inline Scene &getScene() { return _scene; }
+#endif
+
     inline const SceneNode &getRoot() const { return _root; }
 
     inline SceneNode &getRoot() { return _root; }
@@ -166,6 +347,7 @@ public:
             qDebug() << "Another effect with name " << name.c_str() << " already exists in the context";
 #endif
 
+        effect->setName(name);
         _effects.insert_or_assign(name, std::move(effect));
         return *effectPtr;
     }
@@ -182,20 +364,123 @@ public:
 
     inline const Camera &getCamera() const { return _camera; }
 
+    inline RenderQueue &getRenderQueue() { return _renderQueue; }
+
+    // ids of the effects and effect properties of this context, as packed into render queue keys
+    inline SortKeyIdPool &getEffectIds() { return _effectIds; }
+
+    inline const std::shared_ptr<SortKeyIdPool> &getEffectPropertyIds() { return _effectPropertyIds; }
+
+    // largest simplification error a level of detail may show, as a fraction of the
+    // viewport height. Zero always draws full detail
+    inline void setLevelOfDetailThreshold(float threshold) { _levelOfDetailThreshold = threshold; }
+
+    inline float getLevelOfDetailThreshold() const { return _levelOfDetailThreshold; }
+
+    // scene wide ambient light of the phong effects, scaled by each material's ambient color
+    inline void setAmbientLight(glm::vec3 ambientLight) { _ambientLight = ambientLight; }
+
+    inline glm::vec3 getAmbientLight() const { return _ambientLight; }
+
+    // tests the drawables left by frustum culling against the largest occluders on screen
+    void enableOcclusionCulling(bool enable);
+
+    inline bool isOcclusionCullingEnabled() const { return static_cast<bool>(_occlusionCuller); }
+
+    // nullptr while occlusion culling is disabled
+    inline OcclusionCuller *getOcclusionCuller() { return _occlusionCuller.get(); }
+
+    // draws the depth of the effects supporting it before shading them. Needs the GL context current
+    void enableDepthPrepass(bool enable);
+
+    inline bool isDepthPrepassEnabled() const { return static_cast<bool>(_depthPrepassEffect); }
+
+    // nullptr while the depth prepass is disabled
+    inline Effect *getDepthPrepassEffect() { return _depthPrepassEffect.get(); }
+
+    // disabled until enabled, frames are begun and ended by whoever presents them
+    inline Profiler &getProfiler() { return _profiler; }
+
+    inline CullingStatistics &getCullingStatistics() { return _cullingStatistics; }
+
+    inline const CullingStatistics &getCullingStatistics() const { return _cullingStatistics; }
+
+    // drawables left by frustum culling and occluder candidates of the current frame. Kept by the
+    // context so their capacity is reused from frame to frame
+    inline std::vector<Drawable *> &getVisibleDrawables() { return _visibleDrawables; }
+
+    inline std::vector<std::pair<float, Drawable *>> &getOccluderCandidates() { return _occluderCandidates; }
+
+    // workers shared by the parallel parts of a frame, used from the render thread only
+    inline ThreadPool &getThreadPool() { return _threadPool; }
+
+#ifndef SCENE_NODE_TREE
+    // rebuilds the BVH when the scene structure changed, otherwise refits moved drawables.
+    // Scene transformations must be up to date
+    void updateBoundingVolumeHierarchy();
+
+    inline BoundingVolumeHierarchy &getBoundingVolumeHierarchy() { return _bvh; }
+
+    // scene array index of a BVH primitive
+    inline std::size_t getPrimitiveNodeIndex(std::size_t primitive) const { return _primitiveNodes[primitive]; }
+
+    // drawables that are queued without culling
+    inline const std::vector<unsigned> &getUnboundedNodeIndices() const { return _unboundedNodes; }
+
+    inline const std::vector<unsigned> &getPointLightNodeIndices() const { return _pointLightNodes; }
+#endif
+
+    // nearest drawable whose world bounding box is hit by the ray, nullptr if none
+    Drawable *pick(glm::vec3 origin, glm::vec3 direction);
+
 private:
     std::unique_ptr<Drawable> createPointLightGeometry();
 
-    std::unique_ptr<Drawable> _pointLightGeometry;
-    Camera _camera;
+#ifndef SCENE_NODE_TREE
+    void buildBoundingVolumeHierarchy();
+#endif
+
+    // the driver is declared first so GL objects held by the other members are released before it
     GLDriver _driver;
-    SceneNode _root{nullptr};
+    SortKeyIdPool _effectIds{RenderQueue::MAX_EFFECTS};
+    std::shared_ptr<SortKeyIdPool> _effectPropertyIds{std::make_shared<SortKeyIdPool>(RenderQueue::MAX_EFFECT_PROPERTIES)};
+    VertexFormat _vertexFormat;
+    MeshBuffer _meshBuffer{&_driver};
+    Profiler _profiler{&_driver};
+    Camera _camera;
+    RenderQueue _renderQueue;
+    CullingStatistics _cullingStatistics;
+    std::vector<Drawable *> _visibleDrawables;
+    std::vector<std::pair<float, Drawable *>> _occluderCandidates;
+    float _levelOfDetailThreshold = 0.001f;
+    glm::vec3 _ambientLight{0.2f};
+
+    // declared before the culler and the effects using it
+    ThreadPool _threadPool;
+    std::unique_ptr<OcclusionCuller> _occlusionCuller;
+    std::unique_ptr<Effect> _depthPrepassEffect;
+    BoundingVolumeHierarchy _bvh;
+#ifndef SCENE_NODE_TREE
+    std::vector<unsigned> _primitiveNodes;
+    std::vector<unsigned> _nodePrimitives;
+    std::vector<unsigned> _unboundedNodes;
+    std::vector<unsigned> _pointLightNodes;
+    std::size_t _bvhStructureVersion = std::numeric_limits<std::size_t>::max();
+#endif
     std::unordered_map<std::string, std::unique_ptr<Effect>> _effects;
+    std::unique_ptr<Drawable> _pointLightGeometry;
+#ifdef SCENE_NODE_TREE
+    SceneNode _root{nullptr};
+#else
+    Scene _scene;
+    SceneNode _root{_scene.createRoot(nullptr)};
+#endif
 };
 
 
 template<>
 struct NodeAction<std::unique_ptr<Drawable>> {
-    static void draw(DrawContext::SceneNode &node);
+    static void draw(DrawContext::SceneNode &node, DrawContext &context);
 };
 
 
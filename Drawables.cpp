@@ -1,43 +1,52 @@
+#include <cassert>
 #include "Drawables.h"
 
 
 /***************************************************
  * Geometry definitions
  ***************************************************/
-const Geometry::GLAttribute Geometry::POSITION_ATTRIBUTE = {
-    3,
-    GL_FLOAT,
-    false,
-    0,
-    "vPosition"
-};
-
-
-const Geometry::GLAttribute Geometry::NORMAL_ATTRIBUTE = {
-    3,
-    GL_FLOAT,
-    false,
-    0,
-    "vNormal"
-};
+const std::string Geometry::POSITION_ATTRIBUTE = "vPosition";
+const std::string Geometry::NORMAL_ATTRIBUTE = "vNormal";
+const int Geometry::INSTANCE_MATRIX_LOCATION = 2;
 
 
 Geometry::Geometry(DrawContext *context,
                    std::shared_ptr<EffectProperty> effectProperty,
-                   std::shared_ptr<GLVertexArray> vao,
-                   std::shared_ptr<GLBuffer> buffer,
+                   const MeshBuffer::Allocation &allocation,
                    unsigned numOfElements,
                    unsigned elementOffset,
-                   int positionOffset,
-                   int normalOffset)
+                   const BoundingBox &boundingBox,
+                   const std::vector<LevelOfDetail> &levelsOfDetail,
+                   const std::vector<MeshCluster> &clusters)
     : Drawable{context},
-    _vao{std::move(vao)},
-    _buffer{std::move(buffer)},
+    _vao{allocation.vao},
+    _buffer{allocation.buffer},
     _numOfElements{numOfElements},
-    _elementOffset{elementOffset},
-    _positionsOffset{positionOffset},
-    _normalsOffset{normalOffset}
+    _elementOffset{allocation.elementOffset + elementOffset * static_cast<unsigned>(sizeof(unsigned))},
+    _elementType{GL_UNSIGNED_INT},
+    _positionsOffset{-1},
+    _normalsOffset{-1},
+    _format{context->getMeshBuffer().getVertexFormat()},
+    _decodeMatrix{allocation.decodeMatrix},
+    _boundingBox{boundingBox},
+    _boundingSphere{BoundingSphere::fromBox(boundingBox)},
+    _levelOfDetail{0},
+    _isClusterCulled{false}
 {
+    _levelsOfDetail.push_back({_numOfElements, _elementOffset, 0.0f});
+    for (const auto &levelOfDetail : levelsOfDetail) {
+        assert(_levelsOfDetail.back().error <= levelOfDetail.error);
+        unsigned offset = allocation.elementOffset + levelOfDetail.elementOffset * static_cast<unsigned>(sizeof(unsigned));
+        _levelsOfDetail.push_back({levelOfDetail.numOfElements, offset, levelOfDetail.error});
+    }
+
+    for (auto cluster : clusters) {
+        assert(cluster.elementOffset >= elementOffset && cluster.elementOffset + cluster.numOfElements <= elementOffset + numOfElements);
+        cluster.elementOffset = allocation.elementOffset + cluster.elementOffset * static_cast<unsigned>(sizeof(unsigned));
+        _clusters.push_back(cluster);
+    }
+
+    // attributes of the shared vertex array are set up by the mesh buffer
     setEffectProperty(std::move(effectProperty));
 }
 
@@ -47,32 +56,50 @@ Geometry::Geometry(DrawContext *context,
                    const std::vector<unsigned> &elements,
                    const std::vector<glm::vec3> &positions,
                    const std::vector<glm::vec3> &normals)
-    : Drawable{context}
+    : Drawable{context},
+    _format{context->getVertexFormat()}
 {
     _numOfElements = static_cast<unsigned>(elements.size());
     _elementOffset = 0;
+    _levelsOfDetail.push_back({_numOfElements, _elementOffset, 0.0f});
+    _levelOfDetail = 0;
+    _isClusterCulled = false;
+
+    // bounding volumes
+    _boundingBox = BoundingBox::fromPoints(positions);
+    _boundingSphere = BoundingSphere::fromBox(_boundingBox);
+
+    // create VAO, with 16 bit elements when every vertex can be addressed
+    auto &driver = _context->getDriver();
+    std::optional<GLVertexArray> vao;
+    if (_format.useShortElements && positions.size() <= (1u << 16)) {
+        std::vector<unsigned short> shortElements(elements.begin(), elements.end());
+        vao = driver.createVertexArray(shortElements.data(), static_cast<int>(shortElements.size()), GL_STATIC_DRAW);
+        _elementType = GL_UNSIGNED_SHORT;
+    }
+    else {
+        vao = driver.createVertexArray(elements.data(), static_cast<int>(elements.size()), GL_STATIC_DRAW);
+        _elementType = GL_UNSIGNED_INT;
+    }
 
-    // create VAO and Buffer
-    int positionCount = static_cast<int>(positions.size() * sizeof(glm::vec3));
-    int normalCount = static_cast<int>(normals.size() * sizeof(glm::vec3));
-    _positionsOffset = -1;
-    _normalsOffset = -1;
-
-    GLVertexArray vao = _context->getDriver().createVertexArray(elements.data(), elements.size(), GL_STATIC_DRAW);
-    GLBuffer buffer = _context->getDriver().createBuffer(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+    // create Buffer, normals follow the positions unless they are interleaved
+    auto encoded = _format.encode(positions, normals, _boundingBox);
+    _decodeMatrix = encoded.decodeMatrix;
+    int positionCount = static_cast<int>(encoded.positions.size());
+    int normalCount = static_cast<int>(encoded.normals.size());
+    GLBuffer buffer = driver.createBuffer(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
     buffer.bind();
     buffer.loadData(nullptr, positionCount + normalCount);
-    if (!positions.empty()) {
-        _positionsOffset = 0;
-        buffer.loadSubData(_positionsOffset, positions.data(), positionCount);
-    }
+    buffer.loadSubData(0, encoded.positions.data(), positionCount);
+    if (normalCount > 0)
+        buffer.loadSubData(positionCount, encoded.normals.data(), normalCount);
 
-    if (!normals.empty()) {
-        _normalsOffset = positionCount;
-        buffer.loadSubData(_normalsOffset, normals.data(), normalCount);
-    }
+    _positionsOffset = positions.empty() ? -1 : 0;
+    _normalsOffset = -1;
+    if (!positions.empty() && normals.size() == positions.size())
+        _normalsOffset = _format.isInterleaved ? 0 : positionCount;
 
-    _vao = std::make_shared<GLVertexArray>(std::move(vao));
+    _vao = std::make_shared<GLVertexArray>(std::move(*vao));
     _buffer = std::make_shared<GLBuffer>(std::move(buffer));
 
     // set property
@@ -90,9 +117,103 @@ EffectProperty *Geometry::getEffectProperty() {
 }
 
 
+const GLVertexArray *Geometry::getVertexArray() const {
+    return _vao.get();
+}
+
+
+const BoundingBox *Geometry::getBoundingBox() const {
+    return &_boundingBox;
+}
+
+
+const BoundingSphere *Geometry::getBoundingSphere() const {
+    return &_boundingSphere;
+}
+
+
+MeshRange Geometry::getMeshRange() const {
+    return {_vao.get(), _elementOffset, _numOfElements};
+}
+
+
+glm::mat4 Geometry::getVertexDecodeMatrix() const {
+    return _decodeMatrix;
+}
+
+
+float Geometry::selectLevelOfDetail(float screenScale) {
+    float threshold = _context->getLevelOfDetailThreshold();
+    std::size_t levelOfDetail = 0;
+    while (levelOfDetail + 1 < _levelsOfDetail.size() && _levelsOfDetail[levelOfDetail + 1].error * screenScale <= threshold)
+        ++levelOfDetail;
+
+    _levelOfDetail = levelOfDetail;
+    _numOfElements = _levelsOfDetail[levelOfDetail].numOfElements;
+    _elementOffset = _levelsOfDetail[levelOfDetail].elementOffset;
+
+    // full detail has no error, even when the camera is inside the bounds
+    return levelOfDetail > 0 ? _levelsOfDetail[levelOfDetail].error * screenScale : 0.0f;
+}
+
+
+std::size_t Geometry::cullClusters(const Frustum &frustum, glm::vec3 cameraPosition) {
+    _isClusterCulled = _levelOfDetail == 0 && !_clusters.empty();
+    if (!_isClusterCulled)
+        return 0;
+
+    // cones are tested in model space, which keeps their angles for rigid transformations with uniform scale
+    glm::vec3 modelCameraPosition = glm::vec3(glm::inverse(_transformation) * glm::vec4(cameraPosition, 1.0f));
+    std::size_t numOfCulled = 0;
+    _visibleMeshRanges.clear();
+    for (const auto &cluster : _clusters) {
+        if (cluster.isBackfacing(modelCameraPosition) || !frustum.intersects(cluster.boundingSphere.transform(_transformation))) {
+            ++numOfCulled;
+            continue;
+        }
+
+        if (!_visibleMeshRanges.empty() &&
+            _visibleMeshRanges.back().elementOffset + _visibleMeshRanges.back().numOfElements * sizeof(unsigned) == cluster.elementOffset)
+        {
+            _visibleMeshRanges.back().numOfElements += cluster.numOfElements;
+        }
+        else {
+            _visibleMeshRanges.push_back({_vao.get(), cluster.elementOffset, cluster.numOfElements});
+        }
+    }
+
+    return numOfCulled;
+}
+
+
+const std::vector<MeshRange> *Geometry::getVisibleMeshRanges() const {
+    return _isClusterCulled ? &_visibleMeshRanges : nullptr;
+}
+
+
+const OccluderMesh *Geometry::getOccluder() const {
+    return _occluder.get();
+}
+
+
 void Geometry::draw() {
     _vao->bind();
-    _context->getDriver().drawElements(GL_TRIANGLES, _numOfElements, GL_UNSIGNED_INT, _elementOffset);
+    if (!_isClusterCulled) {
+        _context->getDriver().drawElements(GL_TRIANGLES, _numOfElements, _elementType, _elementOffset);
+        return;
+    }
+
+    for (const auto &meshRange : _visibleMeshRanges) {
+        _context->getDriver().drawElements(GL_TRIANGLES, meshRange.numOfElements, _elementType, meshRange.elementOffset);
+    }
+}
+
+
+void Geometry::drawInstanced(GLBuffer &instanceBuffer, int numOfInstanceMatrices, int instanceCount) {
+    _vao->bind();
+    _vao->setInstanceMatrices(instanceBuffer, INSTANCE_MATRIX_LOCATION, numOfInstanceMatrices);
+
+    _context->getDriver().drawElementsInstanced(GL_TRIANGLES, _numOfElements, _elementType, _elementOffset, instanceCount);
 }
 
 
@@ -101,27 +222,28 @@ void Geometry::setEffectProperty(std::shared_ptr<EffectProperty> effectProperty)
 
     // enable attribs for VAO in here
     _vao->bind();
-    enableAttribute(effect, POSITION_ATTRIBUTE, _positionsOffset);
-    enableAttribute(effect, NORMAL_ATTRIBUTE, _normalsOffset);
+    _buffer->bind();
+    enableAttribute(effect, POSITION_ATTRIBUTE, _format.getPositionAttribute(), _positionsOffset);
+    enableAttribute(effect, NORMAL_ATTRIBUTE, _format.getNormalAttribute(), _normalsOffset);
     _vao->unbind();
 
     _effectProperty = effectProperty;
 }
 
 
-void Geometry::enableAttribute(const Effect *effect, const GLAttribute &requiredAttribute, int offset) {
+void Geometry::enableAttribute(const Effect *effect, const std::string &name, const VertexAttribute &attribute, int offset) {
     const auto &attributes = effect->getAttributes();
-    auto effectAttrib = attributes.find(requiredAttribute.name);
+    auto effectAttrib = attributes.find(name);
     if (offset != -1 &&
         effectAttrib != attributes.end())
     {
         auto attribLoc = effectAttrib->second;
         _vao->attribPointer(attribLoc,
-                            requiredAttribute.size,
-                            requiredAttribute.dataType,
-                            requiredAttribute.normalized,
-                            requiredAttribute.stride,
-                            offset);
+                            attribute.size,
+                            attribute.dataType,
+                            attribute.normalized,
+                            attribute.stride,
+                            offset + attribute.offset);
 
         _vao->enableAttrib(attribLoc);
     }
@@ -153,6 +275,36 @@ const EffectProperty *PointLight::getEffectProperty() const {
 }
 
 
+const GLVertexArray *PointLight::getVertexArray() const {
+    return _geometry->getVertexArray();
+}
+
+
+const BoundingBox *PointLight::getBoundingBox() const {
+    return _geometry->getBoundingBox();
+}
+
+
+const BoundingSphere *PointLight::getBoundingSphere() const {
+    return _geometry->getBoundingSphere();
+}
+
+
+MeshRange PointLight::getMeshRange() const {
+    return _geometry->getMeshRange();
+}
+
+
+glm::mat4 PointLight::getVertexDecodeMatrix() const {
+    return _geometry->getVertexDecodeMatrix();
+}
+
+
 void PointLight::draw() {
     _geometry->draw();
 }
+
+
+void PointLight::drawInstanced(GLBuffer &instanceBuffer, int numOfInstanceMatrices, int instanceCount) {
+    _geometry->drawInstanced(instanceBuffer, numOfInstanceMatrices, instanceCount);
+}
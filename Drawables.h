@@ -2,27 +2,33 @@
 #define DRAWABLES_H
 
 #include "DrawContext.h"
+#include "MeshCluster.h"
 
 
 class Geometry : public Drawable {
-    struct GLAttribute {
-        int size;
-        unsigned dataType;
-        bool normalized;
-        int stride;
-        std::string name;
+public:
+    // a simplified range of the same allocation. The offset is counted in elements
+    struct LevelOfDetail {
+        unsigned numOfElements;
+        unsigned elementOffset;
+
+        // in model space
+        float error;
     };
 
-public:
+    // a range of a mesh packed into the context's mesh buffer. Offsets are counted in elements
+    // from the start of the allocation, levels of detail are ordered from fine to coarse and
+    // clusters cover the full detail range
     Geometry(DrawContext *context,
              std::shared_ptr<EffectProperty> effectProperty,
-             std::shared_ptr<GLVertexArray> vao,
-             std::shared_ptr<GLBuffer> buffer,
-             unsigned numOfElement,
+             const MeshBuffer::Allocation &allocation,
+             unsigned numOfElements,
              unsigned elementOffset,
-             int positionOffset,
-             int normalOffset);
+             const BoundingBox &boundingBox,
+             const std::vector<LevelOfDetail> &levelsOfDetail = {},
+             const std::vector<MeshCluster> &clusters = {});
 
+    // a standalone mesh stored in the context's vertex format
     Geometry(DrawContext *context,
              std::shared_ptr<EffectProperty> effectProperty,
              const std::vector<unsigned> &elements,
@@ -41,23 +47,69 @@ public:
 
     inline EffectProperty *getEffectProperty() override;
 
+    const GLVertexArray *getVertexArray() const override;
+
+    const BoundingBox *getBoundingBox() const override;
+
+    const BoundingSphere *getBoundingSphere() const override;
+
+    MeshRange getMeshRange() const override;
+
+    glm::mat4 getVertexDecodeMatrix() const override;
+
+    inline std::size_t getNumOfLevelsOfDetail() const override { return _levelsOfDetail.size(); }
+
+    // picks the coarsest level whose projected error stays below the context's threshold
+    float selectLevelOfDetail(float screenScale) override;
+
+    inline std::size_t getLevelOfDetail() const { return _levelOfDetail; }
+
+    // only the full detail level is split into clusters
+    std::size_t cullClusters(const Frustum &frustum, glm::vec3 cameraPosition) override;
+
+    const std::vector<MeshRange> *getVisibleMeshRanges() const override;
+
+    inline void setOccluder(std::shared_ptr<const OccluderMesh> occluder) { _occluder = std::move(occluder); }
+
+    const OccluderMesh *getOccluder() const override;
+
     void draw() override;
 
-    static const GLAttribute POSITION_ATTRIBUTE;
-    static const GLAttribute NORMAL_ATTRIBUTE;
+    void drawInstanced(GLBuffer &instanceBuffer, int numOfInstanceMatrices, int instanceCount) override;
+
+    static const std::string POSITION_ATTRIBUTE;
+    static const std::string NORMAL_ATTRIBUTE;
+    static const int INSTANCE_MATRIX_LOCATION;
 
 private:
     void setEffectProperty(std::shared_ptr<EffectProperty> effectProperty);
 
-    void enableAttribute(const Effect *effect, const GLAttribute &requiredAttribute, int offset);
+    void enableAttribute(const Effect *effect, const std::string &name, const VertexAttribute &attribute, int offset);
 
     std::shared_ptr<EffectProperty> _effectProperty;
     std::shared_ptr<GLVertexArray> _vao;
     std::shared_ptr<GLBuffer> _buffer;
     unsigned _numOfElements;
     unsigned _elementOffset;
+    unsigned _elementType;
+
+    // byte offsets of the attribute blocks, -1 when the attribute is missing or set up elsewhere
     int _positionsOffset;
     int _normalsOffset;
+    VertexFormat _format;
+    glm::mat4 _decodeMatrix;
+    BoundingBox _boundingBox;
+    BoundingSphere _boundingSphere;
+
+    // the full mesh comes first, offsets are in bytes like _elementOffset
+    std::vector<LevelOfDetail> _levelsOfDetail;
+    std::size_t _levelOfDetail;
+
+    // offsets are in bytes, neighbouring visible clusters are merged into one range
+    std::vector<MeshCluster> _clusters;
+    std::vector<MeshRange> _visibleMeshRanges;
+    bool _isClusterCulled;
+    std::shared_ptr<const OccluderMesh> _occluder;
 };
 
 
@@ -85,8 +137,20 @@ public:
 
     const EffectProperty * getEffectProperty() const override;
 
+    const GLVertexArray *getVertexArray() const override;
+
+    const BoundingBox *getBoundingBox() const override;
+
+    const BoundingSphere *getBoundingSphere() const override;
+
+    MeshRange getMeshRange() const override;
+
+    glm::mat4 getVertexDecodeMatrix() const override;
+
     void draw() override;
 
+    void drawInstanced(GLBuffer &instanceBuffer, int numOfInstanceMatrices, int instanceCount) override;
+
 private:
     Drawable *_geometry;
     glm::vec3 _lightColor;
@@ -2,6 +2,7 @@
 #include "Utility.h"
 #include "Drawables.h"
 #include <glm/gtc/matrix_access.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 
 /***************************************************
@@ -15,11 +16,19 @@ ColorEffect::ColorEffect(DrawContext *context)
     : Effect{context}
 {
     auto &driver = context->getDriver();
+    const auto &format = context->getVertexFormat();
     _program = driver.createProgram({
-        {GL_VERTEX_SHADER,   readTextFile("shaders/ColorVert.glsl")},
+        {GL_VERTEX_SHADER,   format.preprocessShader(readTextFile("shaders/ColorVert.glsl"))},
         {GL_FRAGMENT_SHADER, readTextFile("shaders/ColorFrag.glsl")},
     });
 
+    // the instanced variant shares the attribute locations but reads the transformation per instance
+    _instancedProgram = driver.createProgram({
+        {GL_VERTEX_SHADER,   format.preprocessShader(readTextFile("shaders/ColorInstancedVert.glsl"))},
+        {GL_FRAGMENT_SHADER, readTextFile("shaders/ColorFrag.glsl")},
+    });
+    _instanceBuffer = driver.createBuffer(GL_ARRAY_BUFFER, GL_STREAM_DRAW);
+
     auto uniforms = _program->getUniforms();
 
     // effect wise uniforms
@@ -28,6 +37,11 @@ ColorEffect::ColorEffect(DrawContext *context)
     // drawable uniforms
     _drawableUniforms.insert({COLOR, uniforms.at(COLOR)});
 
+    auto instancedUniforms = _instancedProgram->getUniforms();
+    for (const auto &uniform : _drawableUniforms) {
+        _instancedUniformLocations.insert({uniform.first, instancedUniforms.at(uniform.first).location()});
+    }
+
     _attributes = _program->getAttributes();
 }
 
@@ -45,40 +59,66 @@ EffectProperty ColorEffect::createEffectProperty() {
 void ColorEffect::draw(const std::vector<Drawable *> &drawables,
                        const std::vector<PointLight *> &)
 {
-    _program->bind();
     const auto &camera = _context->getCamera();
+    glm::mat4 viewProjMat = camera.getProjMatrix() * camera.getViewMatrix();
+
+    std::size_t begin = 0;
+    while (begin < drawables.size()) {
+        std::size_t end = findInstanceRangeEnd(drawables, begin);
+        if (end - begin >= MIN_INSTANCES) {
+            drawInstances(drawables, begin, end, viewProjMat);
+            begin = end;
+            continue;
+        }
 
-    for (auto drawable : drawables) {
-        // set transformation
-        glm::mat4 mvp = camera.getProjMatrix() * camera.getViewMatrix() * drawable->getTransformation();
-        _effectUniforms.at(MVP_MAT).setValue(mvp);
+        _program->bind();
+        for (; begin < end; ++begin) {
+            auto drawable = drawables[begin];
 
-        // apply effectwise uniforms
-        for (const auto &uniform : _effectUniforms) {
-            _program->applyUniform(uniform.second);
-        }
+            // set transformation
+            glm::mat4 mvp = viewProjMat * drawable->getTransformation() * drawable->getVertexDecodeMatrix();
+            _effectUniforms.at(MVP_MAT).setValue(mvp);
 
-        // apply individual uniforms
-        auto effectProperty = drawable->getEffectProperty();
-        for (const auto &uniform : *effectProperty) {
-            _program->applyUniform(uniform.second);
-        }
+            // apply effectwise uniforms
+            for (const auto &uniform : _effectUniforms) {
+                _program->applyUniform(uniform.second);
+            }
+
+            // apply individual uniforms
+            auto effectProperty = drawable->getEffectProperty();
+            for (const auto &uniform : *effectProperty) {
+                _program->applyUniform(uniform.second);
+            }
 
-        // draw
-        drawable->draw();
+            // draw
+            drawable->draw();
+        }
     }
 
     _program->unbind();
 }
 
 
+void ColorEffect::drawInstances(const std::vector<Drawable *> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewProjMat) {
+    _instancedProgram->bind();
+
+    // every instance shares the effect property
+    auto effectProperty = drawables[begin]->getEffectProperty();
+    for (const auto &uniform : *effectProperty) {
+        _instancedProgram->applyUniform(_instancedUniformLocations.at(uniform.first), uniform.second.getValue());
+    }
+
+    submitInstances(drawables, begin, end, *_instanceBuffer, 1, [&viewProjMat](const Drawable &drawable, std::vector<glm::mat4> &matrices) {
+        matrices.push_back(viewProjMat * drawable.getTransformation() * drawable.getVertexDecodeMatrix());
+    });
+}
+
+
 
 
 /***************************************************
  * ForwardPhongEffect definitions
  ***************************************************/
-const std::size_t ForwardPhongEffect::PointLightUniforms::MAX = 10;
-
 const std::string ForwardPhongEffect::EFFECT_NAME = "ForwardPhongEffect";
 
 const std::string ForwardPhongEffect::AMBIENT_COLOR = "ambientColor";
@@ -86,37 +126,95 @@ const std::string ForwardPhongEffect::DIFFUSE_COLOR = "diffuseColor";
 const std::string ForwardPhongEffect::SPECULAR_COLOR = "specularColor";
 const std::string ForwardPhongEffect::SHININESS = "shininess";
 
-const std::string ForwardPhongEffect::MVP_MAT = "modelViewProjMat";
 const std::string ForwardPhongEffect::MV_MAT = "modelViewMat";
 const std::string ForwardPhongEffect::NORMAL_MAT = "normalMat";
-const std::string ForwardPhongEffect::LIGHT_AMBIENT = "lightAmbient";
-const ForwardPhongEffect::PointLightUniforms ForwardPhongEffect::POINT_LIGHTS;
+const std::string ForwardPhongEffect::DRAW_DATA = "drawData";
+const unsigned ForwardPhongEffect::DRAW_DATA_UNIT = 0;
+const std::string ForwardPhongEffect::POINT_LIGHTS = "pointLights";
+const unsigned ForwardPhongEffect::POINT_LIGHTS_UNIT = 1;
+const std::string ForwardPhongEffect::LIGHT_CLUSTERS = "lightClusters";
+const unsigned ForwardPhongEffect::LIGHT_CLUSTERS_UNIT = 2;
+const std::string ForwardPhongEffect::LIGHT_INDICES = "lightIndices";
+const unsigned ForwardPhongEffect::LIGHT_INDICES_UNIT = 3;
+const std::string ForwardPhongEffect::FRAME_UNIFORMS = "FrameUniforms";
+const unsigned ForwardPhongEffect::FRAME_UNIFORMS_BINDING = 0;
+const PhongFrameUniformsLayout ForwardPhongEffect::FRAME_UNIFORMS_LAYOUT;
+
+// model view and normal matrix interleaved per instance, read by both phong effects
+static void writePhongInstanceMatrices(const Drawable &drawable, const glm::mat4 &viewMat, std::vector<glm::mat4> &matrices) {
+    glm::mat4 mv = viewMat * drawable.getTransformation();
+    matrices.push_back(mv * drawable.getVertexDecodeMatrix());
+    matrices.push_back(glm::inverse(glm::transpose(mv)));
+}
+
+
+// texels per draw of the shared phong multi draw vertex shader: model view matrix, normal matrix columns,
+// ambient + shininess, diffuse, specular. Both phong effects name their parameters alike
+static void writePhongDrawTexels(const Drawable &drawable, const glm::mat4 &viewMat, std::vector<glm::vec4> &texels) {
+    glm::mat4 mv = viewMat * drawable.getTransformation();
+    glm::mat4 normalMat = glm::inverse(glm::transpose(mv));
+    glm::mat4 positionMat = mv * drawable.getVertexDecodeMatrix();
+    for (int column = 0; column < 4; ++column) {
+        texels.push_back(positionMat[column]);
+    }
+
+    for (int column = 0; column < 3; ++column) {
+        texels.push_back(normalMat[column]);
+    }
+
+    const auto *effectProperty = drawable.getEffectProperty();
+    auto ambientColor = std::get<glm::vec3>(effectProperty->getParam(ForwardPhongEffect::AMBIENT_COLOR)->getValue());
+    auto diffuseColor = std::get<glm::vec3>(effectProperty->getParam(ForwardPhongEffect::DIFFUSE_COLOR)->getValue());
+    auto specularColor = std::get<glm::vec3>(effectProperty->getParam(ForwardPhongEffect::SPECULAR_COLOR)->getValue());
+    auto shininess = std::get<float>(effectProperty->getParam(ForwardPhongEffect::SHININESS)->getValue());
+    texels.emplace_back(ambientColor.x, ambientColor.y, ambientColor.z, shininess);
+    texels.emplace_back(diffuseColor.x, diffuseColor.y, diffuseColor.z, 0.0f);
+    texels.emplace_back(specularColor.x, specularColor.y, specularColor.z, 0.0f);
+}
 
 
 ForwardPhongEffect::ForwardPhongEffect(DrawContext *context)
-    : Effect{context}
+    : Effect{context}, _lightClusters{&context->getThreadPool()}
 {
     auto &driver = context->getDriver();
+    const auto &format = context->getVertexFormat();
     _program = driver.createProgram({
-        {GL_VERTEX_SHADER,   readTextFile("shaders/ForwardPhongVert.glsl")},
+        {GL_VERTEX_SHADER,   format.preprocessShader(readTextFile("shaders/ForwardPhongVert.glsl"))},
         {GL_FRAGMENT_SHADER, readTextFile("shaders/ForwardPhongFrag.glsl")},
     });
 
+    // the instanced variant shares the attribute locations but reads the transformations per instance
+    _instancedProgram = driver.createProgram({
+        {GL_VERTEX_SHADER,   format.preprocessShader(readTextFile("shaders/ForwardPhongInstancedVert.glsl"))},
+        {GL_FRAGMENT_SHADER, readTextFile("shaders/ForwardPhongFrag.glsl")},
+    });
+    _instanceBuffer = driver.createBuffer(GL_ARRAY_BUFFER, GL_STREAM_DRAW);
+
+    _multiDrawProgram = driver.createProgram({
+        {GL_VERTEX_SHADER,   format.preprocessShader(readTextFile("shaders/ForwardPhongMultiDrawVert.glsl"))},
+        {GL_FRAGMENT_SHADER, readTextFile("shaders/ForwardPhongMultiDrawFrag.glsl")},
+    });
+    _drawData = driver.createBufferTexture(GL_RGBA32F, GL_STREAM_DRAW);
+    _drawDataLocation = _multiDrawProgram->getUniforms().at(DRAW_DATA).location();
+
+    _program->setUniformBlockBinding(FRAME_UNIFORMS, FRAME_UNIFORMS_BINDING);
+    _instancedProgram->setUniformBlockBinding(FRAME_UNIFORMS, FRAME_UNIFORMS_BINDING);
+    _multiDrawProgram->setUniformBlockBinding(FRAME_UNIFORMS, FRAME_UNIFORMS_BINDING);
+    _frameUniforms = driver.createUniformBlock(FRAME_UNIFORMS_LAYOUT.layout, GL_DYNAMIC_DRAW);
+
+    // two texels per light: view position and radius, color
+    _pointLights = driver.createBufferTexture(GL_RGBA32F, GL_STREAM_DRAW);
+    _lightClusterRanges = driver.createBufferTexture(GL_RG32UI, GL_STREAM_DRAW);
+    _lightIndices = driver.createBufferTexture(GL_R32UI, GL_STREAM_DRAW);
+    setLightSamplers(*_program);
+    setLightSamplers(*_instancedProgram);
+    setLightSamplers(*_multiDrawProgram);
+
     auto uniforms = _program->getUniforms();
 
     // effect wise uniforms
-    _effectUniforms.insert({MVP_MAT, uniforms.at(MVP_MAT)});
     _effectUniforms.insert({MV_MAT, uniforms.at(MV_MAT)});
     _effectUniforms.insert({NORMAL_MAT, uniforms.at(NORMAL_MAT)});
-    _effectUniforms.insert({LIGHT_AMBIENT, uniforms.at(LIGHT_AMBIENT)});
-    for (std::size_t i = 0; i < PointLightUniforms::MAX; ++i) {
-        const auto &position = POINT_LIGHTS.positions[i];
-        const auto &color = POINT_LIGHTS.colors[i];
-        const auto &radius = POINT_LIGHTS.radius[i];
-        _effectUniforms.insert({position, uniforms.at(position)});
-        _effectUniforms.insert({color, uniforms.at(color)});
-        _effectUniforms.insert({radius, uniforms.at(radius)});
-    }
 
     // drawable uniforms
     _drawableUniforms.insert({AMBIENT_COLOR, uniforms.at(AMBIENT_COLOR)});
@@ -125,11 +223,18 @@ ForwardPhongEffect::ForwardPhongEffect(DrawContext *context)
     _drawableUniforms.insert({SHININESS, uniforms.at(SHININESS)});
 
 #ifndef NDEBUG
-    if (_drawableUniforms.size() + _effectUniforms.size() != uniforms.size()) {
+    // the light samplers are set once by setLightSamplers
+    std::size_t numOfLightSamplers = 3;
+    if (_drawableUniforms.size() + _effectUniforms.size() + numOfLightSamplers != uniforms.size()) {
         qDebug() << "Drawable uniforms and effect uniforms does not make up all shader uniforms in ForwardPhongEffect";
     }
 #endif
 
+    auto instancedUniforms = _instancedProgram->getUniforms();
+    for (const auto &uniform : _drawableUniforms) {
+        _instancedUniformLocations.insert({uniform.first, instancedUniforms.at(uniform.first).location()});
+    }
+
     _attributes = _program->getAttributes();
 }
 
@@ -148,44 +253,615 @@ void ForwardPhongEffect::draw(const std::vector<Drawable *> &drawables,
                               const std::vector<PointLight *> &pointLights) {
     _program->bind();
     const auto &camera = _context->getCamera();
+    const auto &layout = FRAME_UNIFORMS_LAYOUT;
+    glm::mat4 viewMat = camera.getViewMatrix();
 
-    // draw ambient and directional light. TODO: hardcode for now
-    _effectUniforms.at(LIGHT_AMBIENT).setValue(glm::vec3(0.2f));
+    // camera and light clusters are written once per frame into the uniform block
+    _frameUniforms->setValue(layout.viewMat, viewMat);
+    _frameUniforms->setValue(layout.projMat, camera.getProjMatrix());
+
+    _frameUniforms->setValue(layout.lightAmbient, _context->getAmbientLight());
 
     // draw point lights
-    for (std::size_t i = 0; i < std::min(PointLightUniforms::MAX, pointLights.size()); ++i) {
-        auto pointLight = pointLights[i];
-        glm::vec4 lightPosition = glm::column(pointLight->getTransformation(), 3);
-        glm::vec4 lightViewPosition = camera.getViewMatrix() * lightPosition;
-        _effectUniforms.at(POINT_LIGHTS.positions[i]).setValue(lightViewPosition.xyz());
-        _effectUniforms.at(POINT_LIGHTS.colors[i]).setValue(pointLight->getLightColor());
-        _effectUniforms.at(POINT_LIGHTS.radius[i]).setValue(pointLight->getRadius());
-    }
+    updateLightClusters(pointLights, viewMat);
+    _frameUniforms->setValue(layout.clusterTilesX, LightClusterGrid::TILES_X);
+    _frameUniforms->setValue(layout.clusterTilesY, LightClusterGrid::TILES_Y);
+    _frameUniforms->setValue(layout.clusterSlices, LightClusterGrid::SLICES);
+    _frameUniforms->setValue(layout.clusterDepthScale, _lightClusters.getDepthScale());
+    _frameUniforms->setValue(layout.clusterDepthBias, _lightClusters.getDepthBias());
+    _frameUniforms->bind(FRAME_UNIFORMS_BINDING);
 
     // draw drawables
-    for (auto drawable : drawables) {
-        // apply transformation
-        glm::mat4 mv = camera.getViewMatrix() * drawable->getTransformation();
-        glm::mat4 mvp = camera.getProjMatrix() * mv;
-        glm::mat4 normalMat = glm::inverse(glm::transpose(mv));
-        _effectUniforms.at(MVP_MAT).setValue(mvp);
-        _effectUniforms.at(MV_MAT).setValue(mv);
-        _effectUniforms.at(NORMAL_MAT).setValue(normalMat);
-
-        // apply effectwise uniforms
-        for (const auto &uniform : _effectUniforms) {
-            _program->applyUniform(uniform.second);
+    std::size_t begin = 0;
+    while (begin < drawables.size()) {
+        std::size_t end = findMultiDrawRangeEnd(drawables, begin);
+        if (end - begin >= MIN_MULTI_DRAWS) {
+            drawMultiple(drawables, begin, end, viewMat);
+            begin = end;
+            continue;
+        }
+
+        end = findInstanceRangeEnd(drawables, begin);
+        if (end - begin >= MIN_INSTANCES) {
+            drawInstances(drawables, begin, end, viewMat);
+            begin = end;
+            continue;
+        }
+
+        _program->bind();
+        for (; begin < end; ++begin) {
+            auto drawable = drawables[begin];
+
+            // apply transformation, normals are not quantized so their matrix skips the decoding
+            glm::mat4 mv = viewMat * drawable->getTransformation();
+            glm::mat4 normalMat = glm::inverse(glm::transpose(mv));
+            _effectUniforms.at(MV_MAT).setValue(mv * drawable->getVertexDecodeMatrix());
+            _effectUniforms.at(NORMAL_MAT).setValue(normalMat);
+
+            // apply effectwise uniforms
+            for (const auto &uniform : _effectUniforms) {
+                _program->applyUniform(uniform.second);
+            }
+
+            // apply individual uniforms
+            auto effectProperty = drawable->getEffectProperty();
+            for (const auto &uniform : *effectProperty) {
+                _program->applyUniform(uniform.second);
+            }
+
+            // draw
+            drawable->draw();
+        }
+    }
+
+    _program->unbind();
+}
+
+
+void ForwardPhongEffect::drawInstances(const std::vector<Drawable *> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat) {
+    _instancedProgram->bind();
+
+    // every instance shares the effect property
+    auto effectProperty = drawables[begin]->getEffectProperty();
+    for (const auto &uniform : *effectProperty) {
+        _instancedProgram->applyUniform(_instancedUniformLocations.at(uniform.first), uniform.second.getValue());
+    }
+
+    submitInstances(drawables, begin, end, *_instanceBuffer, 2, [&viewMat](const Drawable &drawable, std::vector<glm::mat4> &matrices) {
+        writePhongInstanceMatrices(drawable, viewMat, matrices);
+    });
+}
+
+
+void ForwardPhongEffect::drawMultiple(const std::vector<Drawable *> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat) {
+    _multiDrawProgram->bind();
+    _multiDrawProgram->applyUniform(_drawDataLocation, static_cast<int>(DRAW_DATA_UNIT));
+    submitMultiDraw(drawables, begin, end, *_drawData, DRAW_DATA_UNIT, [&viewMat](const Drawable &drawable, std::vector<glm::vec4> &texels) {
+        writePhongDrawTexels(drawable, viewMat, texels);
+    });
+}
+
+
+void ForwardPhongEffect::updateLightClusters(const std::vector<PointLight *> &pointLights, const glm::mat4 &viewMat) {
+    ProfilerScope scope(_context->getProfiler(), "light clusters");
+
+    _lightSpheres.clear();
+    _pointLightTexels.clear();
+    for (auto pointLight : pointLights) {
+        glm::vec3 viewPosition = glm::vec3(viewMat * glm::column(pointLight->getTransformation(), 3));
+        _lightSpheres.emplace_back(viewPosition, pointLight->getRadius());
+        _pointLightTexels.emplace_back(viewPosition, pointLight->getRadius());
+        _pointLightTexels.emplace_back(pointLight->getLightColor(), 0.0f);
+    }
+
+    _lightClusters.build(_context->getCamera().getProjMatrix(), _lightSpheres);
+    const auto &clusters = _lightClusters.getClusters();
+    const auto &lightIndices = _lightClusters.getLightIndices();
+
+    _pointLights->loadData(_pointLightTexels.data(), static_cast<int>(_pointLightTexels.size() * sizeof(glm::vec4)));
+    _lightClusterRanges->loadData(clusters.data(), static_cast<int>(clusters.size() * sizeof(glm::uvec2)));
+    _lightIndices->loadData(lightIndices.data(), static_cast<int>(lightIndices.size() * sizeof(unsigned)));
+    _pointLights->bind(POINT_LIGHTS_UNIT);
+    _lightClusterRanges->bind(LIGHT_CLUSTERS_UNIT);
+    _lightIndices->bind(LIGHT_INDICES_UNIT);
+
+    _context->getProfiler().setCounter("point lights", static_cast<double>(pointLights.size()));
+    _context->getProfiler().setCounter("light indices", static_cast<double>(lightIndices.size()));
+}
+
+
+void ForwardPhongEffect::setLightSamplers(GLProgram &program) {
+    auto uniforms = program.getUniforms();
+    program.bind();
+    program.applyUniform(uniforms.at(POINT_LIGHTS).location(), static_cast<int>(POINT_LIGHTS_UNIT));
+    program.applyUniform(uniforms.at(LIGHT_CLUSTERS).location(), static_cast<int>(LIGHT_CLUSTERS_UNIT));
+    program.applyUniform(uniforms.at(LIGHT_INDICES).location(), static_cast<int>(LIGHT_INDICES_UNIT));
+    program.unbind();
+}
+
+
+
+
+/***************************************************
+ * DeferredPhongEffect definitions
+ ***************************************************/
+const std::string DeferredPhongEffect::EFFECT_NAME = "DeferredPhongEffect";
+
+const std::string DeferredPhongEffect::AMBIENT_COLOR = "ambientColor";
+const std::string DeferredPhongEffect::DIFFUSE_COLOR = "diffuseColor";
+const std::string DeferredPhongEffect::SPECULAR_COLOR = "specularColor";
+const std::string DeferredPhongEffect::SHININESS = "shininess";
+
+const std::string DeferredPhongEffect::MV_MAT = "modelViewMat";
+const std::string DeferredPhongEffect::NORMAL_MAT = "normalMat";
+const std::string DeferredPhongEffect::MVP_MAT = "modelViewProjMat";
+const std::string DeferredPhongEffect::DRAW_DATA = "drawData";
+const unsigned DeferredPhongEffect::DRAW_DATA_UNIT = 0;
+const std::string DeferredPhongEffect::FRAME_UNIFORMS = "FrameUniforms";
+const unsigned DeferredPhongEffect::FRAME_UNIFORMS_BINDING = 0;
+const PhongFrameUniformsLayout DeferredPhongEffect::FRAME_UNIFORMS_LAYOUT;
+
+// sampled on the texture unit of their index, the light accumulation follows them
+const std::vector<std::string> DeferredPhongEffect::G_BUFFER_SAMPLERS = {"normalShininess", "diffuseColors", "specularColors", "viewDepths"};
+const std::string DeferredPhongEffect::LIGHT_ACCUMULATION = "lightAccumulation";
+const std::string DeferredPhongEffect::VIEW_DEPTHS = "viewDepths";
+const std::string DeferredPhongEffect::UNPROJECTION = "unprojection";
+const std::string DeferredPhongEffect::LIGHT_POSITION = "lightPosition";
+const std::string DeferredPhongEffect::LIGHT_COLOR = "lightColor";
+const std::string DeferredPhongEffect::LIGHT_RADIUS = "lightRadius";
+const std::string DeferredPhongEffect::VIEWPORT_ORIGIN = "viewportOrigin";
+const std::string DeferredPhongEffect::DEPTH_PROJECTION = "depthProjection";
+
+// the tessellated point light sphere lies inside the sphere it approximates
+const float DeferredPhongEffect::LIGHT_VOLUME_SCALE = 1.05f;
+
+
+DeferredPhongEffect::DeferredPhongEffect(DrawContext *context)
+    : Effect{context}
+{
+    auto &driver = context->getDriver();
+    const auto &format = context->getVertexFormat();
+
+    // the geometry pass shares the vertex shaders of the forward effect
+    _program = driver.createProgram({
+        {GL_VERTEX_SHADER,   format.preprocessShader(readTextFile("shaders/ForwardPhongVert.glsl"))},
+        {GL_FRAGMENT_SHADER, readTextFile("shaders/DeferredGeometryFrag.glsl")},
+    });
+
+    _instancedProgram = driver.createProgram({
+        {GL_VERTEX_SHADER,   format.preprocessShader(readTextFile("shaders/ForwardPhongInstancedVert.glsl"))},
+        {GL_FRAGMENT_SHADER, readTextFile("shaders/DeferredGeometryFrag.glsl")},
+    });
+    _instanceBuffer = driver.createBuffer(GL_ARRAY_BUFFER, GL_STREAM_DRAW);
+
+    _multiDrawProgram = driver.createProgram({
+        {GL_VERTEX_SHADER,   format.preprocessShader(readTextFile("shaders/ForwardPhongMultiDrawVert.glsl"))},
+        {GL_FRAGMENT_SHADER, readTextFile("shaders/DeferredGeometryMultiDrawFrag.glsl")},
+    });
+    _drawData = driver.createBufferTexture(GL_RGBA32F, GL_STREAM_DRAW);
+    _drawDataLocation = _multiDrawProgram->getUniforms().at(DRAW_DATA).location();
+
+    _program->setUniformBlockBinding(FRAME_UNIFORMS, FRAME_UNIFORMS_BINDING);
+    _instancedProgram->setUniformBlockBinding(FRAME_UNIFORMS, FRAME_UNIFORMS_BINDING);
+    _multiDrawProgram->setUniformBlockBinding(FRAME_UNIFORMS, FRAME_UNIFORMS_BINDING);
+    _frameUniforms = driver.createUniformBlock(FRAME_UNIFORMS_LAYOUT.layout, GL_DYNAMIC_DRAW);
+
+    auto uniforms = _program->getUniforms();
+
+    // effect wise uniforms
+    _effectUniforms.insert({MV_MAT, uniforms.at(MV_MAT)});
+    _effectUniforms.insert({NORMAL_MAT, uniforms.at(NORMAL_MAT)});
+
+    // drawable uniforms
+    _drawableUniforms.insert({AMBIENT_COLOR, uniforms.at(AMBIENT_COLOR)});
+    _drawableUniforms.insert({DIFFUSE_COLOR, uniforms.at(DIFFUSE_COLOR)});
+    _drawableUniforms.insert({SPECULAR_COLOR, uniforms.at(SPECULAR_COLOR)});
+    _drawableUniforms.insert({SHININESS, uniforms.at(SHININESS)});
+
+#ifndef NDEBUG
+    if (_drawableUniforms.size() + _effectUniforms.size() != uniforms.size()) {
+        qDebug() << "Drawable uniforms and effect uniforms does not make up all shader uniforms in DeferredPhongEffect";
+    }
+#endif
+
+    auto instancedUniforms = _instancedProgram->getUniforms();
+    for (const auto &uniform : _drawableUniforms) {
+        _instancedUniformLocations.insert({uniform.first, instancedUniforms.at(uniform.first).location()});
+    }
+
+    _attributes = _program->getAttributes();
+
+    // the light volumes are the point light spheres, drawn with the same vertex format
+    _lightProgram = driver.createProgram({
+        {GL_VERTEX_SHADER,   format.preprocessShader(readTextFile("shaders/DeferredLightVert.glsl"))},
+        {GL_FRAGMENT_SHADER, readTextFile("shaders/DeferredLightFrag.glsl")},
+    });
+
+    // samplers keep their units, only the light uniforms change per draw
+    _lightProgram->bind();
+    auto lightUniforms = _lightProgram->getUniforms();
+    for (std::size_t unit = 0; unit < G_BUFFER_SAMPLERS.size(); ++unit) {
+        _lightProgram->applyUniform(lightUniforms.at(G_BUFFER_SAMPLERS[unit]).location(), static_cast<int>(unit));
+    }
+
+    for (const auto &name : {MVP_MAT, UNPROJECTION, LIGHT_POSITION, LIGHT_COLOR, LIGHT_RADIUS}) {
+        _lightUniformLocations.insert({name, lightUniforms.at(name).location()});
+    }
+
+    _compositeProgram = driver.createProgram({
+        {GL_VERTEX_SHADER,   readTextFile("shaders/DeferredCompositeVert.glsl")},
+        {GL_FRAGMENT_SHADER, readTextFile("shaders/DeferredCompositeFrag.glsl")},
+    });
+
+    _compositeProgram->bind();
+    auto compositeUniforms = _compositeProgram->getUniforms();
+    _compositeProgram->applyUniform(compositeUniforms.at(LIGHT_ACCUMULATION).location(), static_cast<int>(G_BUFFER_SAMPLERS.size()));
+    _compositeProgram->applyUniform(compositeUniforms.at(VIEW_DEPTHS).location(), static_cast<int>(G_BUFFER_SAMPLERS.size() - 1));
+    for (const auto &name : {VIEWPORT_ORIGIN, DEPTH_PROJECTION}) {
+        _compositeProgram->applyUniform(compositeUniforms.at(name).location(), glm::vec2(0.0f));
+        _compositeUniformLocations.insert({name, compositeUniforms.at(name).location()});
+    }
+
+    _compositeProgram->unbind();
+
+    // core profiles draw from a bound vertex array even when no attribute is read
+    const unsigned triangleElements[] = {0, 1, 2};
+    _fullscreenTriangle = driver.createVertexArray(triangleElements, 3, GL_STATIC_DRAW);
+}
+
+
+const std::map<std::string, int> &DeferredPhongEffect::getAttributes() const {
+    return _attributes;
+}
+
+
+EffectProperty DeferredPhongEffect::createEffectProperty() {
+    return {this, _drawableUniforms};
+}
+
+
+void DeferredPhongEffect::draw(const std::vector<Drawable *> &drawables,
+                               const std::vector<PointLight *> &pointLights) {
+    auto &driver = _context->getDriver();
+    const auto &camera = _context->getCamera();
+    const auto &layout = FRAME_UNIFORMS_LAYOUT;
+    glm::mat4 viewMat = camera.getViewMatrix();
+    glm::mat4 projMat = camera.getProjMatrix();
+
+    // the G-buffer covers the viewport of the framebuffer being drawn to
+    unsigned targetFramebuffer = driver.getBoundFramebuffer();
+    auto viewport = driver.getBoundViewport();
+    resizeGBuffer(viewport[2], viewport[3]);
+
+    _frameUniforms->setValue(layout.viewMat, viewMat);
+    _frameUniforms->setValue(layout.projMat, projMat);
+
+    _frameUniforms->setValue(layout.lightAmbient, _context->getAmbientLight());
+    _frameUniforms->bind(FRAME_UNIFORMS_BINDING);
+
+    // geometry pass, every target starts at zero and the depth at the far plane
+    auto &framebuffer = _gBuffer->framebuffer;
+    framebuffer.bind();
+    framebuffer.setDrawBuffers({GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2,
+                                GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4});
+    for (int drawBuffer = 0; drawBuffer < 5; ++drawBuffer) {
+        framebuffer.clearColorBuffer(drawBuffer, glm::vec4(0.0f));
+    }
+
+    framebuffer.clearDepthStencil(1.0f, 0);
+    driver.setViewport(0, 0, viewport[2], viewport[3]);
+    drawGeometry(drawables, viewMat);
+
+    // lighting pass adds into the light accumulation only
+    framebuffer.setDrawBuffers({GL_COLOR_ATTACHMENT4});
+    drawLightVolumes(pointLights, viewMat, projMat);
+
+    composite(targetFramebuffer, viewport, projMat);
+}
+
+
+void DeferredPhongEffect::resizeGBuffer(int width, int height) {
+    if (_gBuffer && _gBuffer->normalShininess.getWidth() == width && _gBuffer->normalShininess.getHeight() == height)
+        return;
+
+    auto &driver = _context->getDriver();
+    _gBuffer.reset();
+    _gBuffer.emplace(GBuffer{
+        driver.createTexture(GL_RGBA16F, width, height),
+        driver.createTexture(GL_RGBA8, width, height),
+        driver.createTexture(GL_RGBA8, width, height),
+        driver.createTexture(GL_R32F, width, height),
+        driver.createTexture(GL_RGBA16F, width, height),
+        driver.createRenderbuffer(GL_DEPTH24_STENCIL8, width, height),
+        driver.createFramebuffer()
+    });
+
+    auto &framebuffer = _gBuffer->framebuffer;
+    framebuffer.attachTexture(GL_COLOR_ATTACHMENT0, _gBuffer->normalShininess);
+    framebuffer.attachTexture(GL_COLOR_ATTACHMENT1, _gBuffer->diffuseColors);
+    framebuffer.attachTexture(GL_COLOR_ATTACHMENT2, _gBuffer->specularColors);
+    framebuffer.attachTexture(GL_COLOR_ATTACHMENT3, _gBuffer->viewDepths);
+    framebuffer.attachTexture(GL_COLOR_ATTACHMENT4, _gBuffer->lightAccumulation);
+    framebuffer.attachRenderbuffer(GL_DEPTH_STENCIL_ATTACHMENT, _gBuffer->depthStencil);
+
+#ifndef NDEBUG
+    if (!framebuffer.isComplete())
+        qDebug() << "G-buffer of DeferredPhongEffect is incomplete";
+#endif
+}
+
+
+void DeferredPhongEffect::drawGeometry(const std::vector<Drawable *> &drawables, const glm::mat4 &viewMat) {
+    std::size_t begin = 0;
+    while (begin < drawables.size()) {
+        std::size_t end = findMultiDrawRangeEnd(drawables, begin);
+        if (end - begin >= MIN_MULTI_DRAWS) {
+            drawMultiple(drawables, begin, end, viewMat);
+            begin = end;
+            continue;
         }
 
-        // apply individual uniforms
-        auto effectProperty = drawable->getEffectProperty();
-        for (const auto &uniform : *effectProperty) {
-            _program->applyUniform(uniform.second);
+        end = findInstanceRangeEnd(drawables, begin);
+        if (end - begin >= MIN_INSTANCES) {
+            drawInstances(drawables, begin, end, viewMat);
+            begin = end;
+            continue;
         }
 
-        // draw
-        drawable->draw();
+        _program->bind();
+        for (; begin < end; ++begin) {
+            auto drawable = drawables[begin];
+
+            // apply transformation, normals are not quantized so their matrix skips the decoding
+            glm::mat4 mv = viewMat * drawable->getTransformation();
+            glm::mat4 normalMat = glm::inverse(glm::transpose(mv));
+            _effectUniforms.at(MV_MAT).setValue(mv * drawable->getVertexDecodeMatrix());
+            _effectUniforms.at(NORMAL_MAT).setValue(normalMat);
+
+            // apply effectwise uniforms
+            for (const auto &uniform : _effectUniforms) {
+                _program->applyUniform(uniform.second);
+            }
+
+            // apply individual uniforms
+            auto effectProperty = drawable->getEffectProperty();
+            for (const auto &uniform : *effectProperty) {
+                _program->applyUniform(uniform.second);
+            }
+
+            // draw
+            drawable->draw();
+        }
     }
 
     _program->unbind();
 }
+
+
+void DeferredPhongEffect::drawInstances(const std::vector<Drawable *> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat) {
+    _instancedProgram->bind();
+
+    // every instance shares the effect property
+    auto effectProperty = drawables[begin]->getEffectProperty();
+    for (const auto &uniform : *effectProperty) {
+        _instancedProgram->applyUniform(_instancedUniformLocations.at(uniform.first), uniform.second.getValue());
+    }
+
+    submitInstances(drawables, begin, end, *_instanceBuffer, 2, [&viewMat](const Drawable &drawable, std::vector<glm::mat4> &matrices) {
+        writePhongInstanceMatrices(drawable, viewMat, matrices);
+    });
+}
+
+
+void DeferredPhongEffect::drawMultiple(const std::vector<Drawable *> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat) {
+    _multiDrawProgram->bind();
+    _multiDrawProgram->applyUniform(_drawDataLocation, static_cast<int>(DRAW_DATA_UNIT));
+    submitMultiDraw(drawables, begin, end, *_drawData, DRAW_DATA_UNIT, [&viewMat](const Drawable &drawable, std::vector<glm::vec4> &texels) {
+        writePhongDrawTexels(drawable, viewMat, texels);
+    });
+}
+
+
+void DeferredPhongEffect::drawLightVolumes(const std::vector<PointLight *> &pointLights, const glm::mat4 &viewMat, const glm::mat4 &projMat) {
+    auto &driver = _context->getDriver();
+    auto volume = _context->getPointLightGeometry();
+    const auto *volumeBox = volume->getBoundingBox();
+    float volumeScale = 2.0f * LIGHT_VOLUME_SCALE / (volumeBox->max.x - volumeBox->min.x);
+    glm::mat4 viewProjMat = projMat * viewMat;
+    Frustum frustum(viewProjMat);
+
+    _gBuffer->normalShininess.bind(0);
+    _gBuffer->diffuseColors.bind(1);
+    _gBuffer->specularColors.bind(2);
+    _gBuffer->viewDepths.bind(3);
+
+    _lightProgram->bind();
+    glm::vec4 unprojection(1.0f / projMat[0][0], 1.0f / projMat[1][1], projMat[2][0] / projMat[0][0], projMat[2][1] / projMat[1][1]);
+    _lightProgram->applyUniform(_lightUniformLocations.at(UNPROJECTION), unprojection);
+
+    driver.enableDepthMask(false);
+    driver.enableStencilTest(true);
+    driver.setBlendFunc(GL_ONE, GL_ONE);
+    for (auto pointLight : pointLights) {
+        glm::vec3 lightPosition = glm::vec3(glm::column(pointLight->getTransformation(), 3));
+        float lightRadius = pointLight->getRadius();
+        if (!frustum.intersects(BoundingSphere(lightPosition, lightRadius)))
+            continue;
+
+        glm::mat4 modelMat = glm::translate(glm::mat4(1.0f), lightPosition) * glm::scale(glm::mat4(1.0f), glm::vec3(lightRadius * volumeScale));
+        _lightProgram->applyUniform(_lightUniformLocations.at(MVP_MAT), viewProjMat * modelMat * volume->getVertexDecodeMatrix());
+        _lightProgram->applyUniform(_lightUniformLocations.at(LIGHT_POSITION), glm::vec3(viewMat * glm::vec4(lightPosition, 1.0f)));
+        _lightProgram->applyUniform(_lightUniformLocations.at(LIGHT_COLOR), pointLight->getLightColor());
+        _lightProgram->applyUniform(_lightUniformLocations.at(LIGHT_RADIUS), lightRadius);
+
+        // stencil pass: surfaces between the front and back faces of the volume end up nonzero
+        driver.setColorMask(false, false, false, false);
+        driver.enableDepthTest(true);
+        driver.enableCullFace(false);
+        driver.enableBlend(false);
+        driver.setStencilFunc(GL_ALWAYS, 0, 0xFF);
+        driver.setStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+        driver.setStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+        volume->draw();
+
+        // light pass over the back faces, which also covers the camera inside the volume, resets the stencil it reads
+        driver.setColorMask(true, true, true, true);
+        driver.enableDepthTest(false);
+        driver.enableCullFace(true);
+        driver.setCullFace(GL_FRONT);
+        driver.enableBlend(true);
+        driver.setStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+        driver.setStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
+        volume->draw();
+    }
+}
+
+
+void DeferredPhongEffect::composite(unsigned targetFramebuffer, const std::array<int, 4> &viewport, const glm::mat4 &projMat) {
+    auto &driver = _context->getDriver();
+    driver.bindFramebuffer(targetFramebuffer);
+    driver.setViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    unsigned lightAccumulationUnit = static_cast<unsigned>(G_BUFFER_SAMPLERS.size());
+    _gBuffer->viewDepths.bind(lightAccumulationUnit - 1);
+    _gBuffer->lightAccumulation.bind(lightAccumulationUnit);
+
+    _compositeProgram->bind();
+    _compositeProgram->applyUniform(_compositeUniformLocations.at(VIEWPORT_ORIGIN), glm::vec2(viewport[0], viewport[1]));
+    _compositeProgram->applyUniform(_compositeUniformLocations.at(DEPTH_PROJECTION), glm::vec2(projMat[2][2], projMat[3][2]));
+
+    // the fragment depth is written, so the depth test stays on against the target
+    driver.setColorMask(true, true, true, true);
+    driver.enableDepthTest(true);
+    driver.enableDepthMask(true);
+    driver.enableCullFace(false);
+    driver.enableBlend(false);
+    driver.enableStencilTest(false);
+
+    _fullscreenTriangle->bind();
+    driver.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
+    _fullscreenTriangle->unbind();
+    _compositeProgram->unbind();
+}
+
+
+
+
+/***************************************************
+ * DepthPrepassEffect definitions
+ ***************************************************/
+const std::string DepthPrepassEffect::EFFECT_NAME = "DepthPrepassEffect";
+
+const std::string DepthPrepassEffect::MV_MAT = "modelViewMat";
+const std::string DepthPrepassEffect::PROJ_MAT = "projMat";
+const std::string DepthPrepassEffect::DRAW_DATA = "drawData";
+const unsigned DepthPrepassEffect::DRAW_DATA_UNIT = 0;
+
+
+DepthPrepassEffect::DepthPrepassEffect(DrawContext *context)
+    : Effect{context}
+{
+    // no fragment shader, only depth is written
+    auto &driver = context->getDriver();
+    const auto &format = context->getVertexFormat();
+    _program = driver.createProgram({
+        {GL_VERTEX_SHADER, format.preprocessShader(readTextFile("shaders/DepthPrepassVert.glsl"))},
+    });
+
+    _instancedProgram = driver.createProgram({
+        {GL_VERTEX_SHADER, format.preprocessShader(readTextFile("shaders/DepthPrepassInstancedVert.glsl"))},
+    });
+    _instanceBuffer = driver.createBuffer(GL_ARRAY_BUFFER, GL_STREAM_DRAW);
+
+    _multiDrawProgram = driver.createProgram({
+        {GL_VERTEX_SHADER, format.preprocessShader(readTextFile("shaders/DepthPrepassMultiDrawVert.glsl"))},
+    });
+    _drawData = driver.createBufferTexture(GL_RGBA32F, GL_STREAM_DRAW);
+
+    auto uniforms = _program->getUniforms();
+    _mvMatLocation = uniforms.at(MV_MAT).location();
+    _projMatLocation = uniforms.at(PROJ_MAT).location();
+    _instancedProjMatLocation = _instancedProgram->getUniforms().at(PROJ_MAT).location();
+
+    auto multiDrawUniforms = _multiDrawProgram->getUniforms();
+    _multiDrawProjMatLocation = multiDrawUniforms.at(PROJ_MAT).location();
+    _drawDataLocation = multiDrawUniforms.at(DRAW_DATA).location();
+
+    _attributes = _program->getAttributes();
+}
+
+
+const std::map<std::string, int> &DepthPrepassEffect::getAttributes() const {
+    return _attributes;
+}
+
+
+EffectProperty DepthPrepassEffect::createEffectProperty() {
+    return {this, {}};
+}
+
+
+void DepthPrepassEffect::draw(const std::vector<Drawable *> &drawables,
+                              const std::vector<PointLight *> &)
+{
+    const auto &camera = _context->getCamera();
+    glm::mat4 viewMat = camera.getViewMatrix();
+    glm::mat4 projMat = camera.getProjMatrix();
+
+    // the projection is applied after the model view matrix, as in the shading pass
+    _instancedProgram->bind();
+    _instancedProgram->applyUniform(_instancedProjMatLocation, projMat);
+    _multiDrawProgram->bind();
+    _multiDrawProgram->applyUniform(_multiDrawProjMatLocation, projMat);
+    _program->bind();
+    _program->applyUniform(_projMatLocation, projMat);
+
+    std::size_t begin = 0;
+    while (begin < drawables.size()) {
+        std::size_t end = findMultiDrawRangeEnd(drawables, begin);
+        if (end - begin >= MIN_MULTI_DRAWS) {
+            drawMultiple(drawables, begin, end, viewMat);
+            begin = end;
+            continue;
+        }
+
+        end = findInstanceRangeEnd(drawables, begin);
+        if (end - begin >= MIN_INSTANCES) {
+            drawInstances(drawables, begin, end, viewMat);
+            begin = end;
+            continue;
+        }
+
+        _program->bind();
+        for (; begin < end; ++begin) {
+            auto drawable = drawables[begin];
+            glm::mat4 mv = viewMat * drawable->getTransformation() * drawable->getVertexDecodeMatrix();
+            _program->applyUniform(_mvMatLocation, mv);
+            drawable->draw();
+        }
+    }
+
+    _program->unbind();
+}
+
+
+void DepthPrepassEffect::drawInstances(const std::vector<Drawable *> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat) {
+    _instancedProgram->bind();
+    submitInstances(drawables, begin, end, *_instanceBuffer, 1, [&viewMat](const Drawable &drawable, std::vector<glm::mat4> &matrices) {
+        matrices.push_back(viewMat * drawable.getTransformation() * drawable.getVertexDecodeMatrix());
+    });
+}
+
+
+void DepthPrepassEffect::drawMultiple(const std::vector<Drawable *> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat) {
+    _multiDrawProgram->bind();
+    _multiDrawProgram->applyUniform(_drawDataLocation, static_cast<int>(DRAW_DATA_UNIT));
+
+    // only the model view matrix is fetched per draw
+    submitMultiDraw(drawables, begin, end, *_drawData, DRAW_DATA_UNIT, [&viewMat](const Drawable &drawable, std::vector<glm::vec4> &texels) {
+        glm::mat4 positionMat = viewMat * drawable.getTransformation() * drawable.getVertexDecodeMatrix();
+        for (int column = 0; column < 4; ++column) {
+            texels.push_back(positionMat[column]);
+        }
+    });
+}
@@ -3,6 +3,7 @@
 
 
 #include "DrawContext.h"
+#include "LightClusters.h"
 
 
 class ColorEffect : public Effect {
@@ -20,15 +21,46 @@ public:
     static const std::string COLOR;
 
 private:
+    void drawInstances(const std::vector<Drawable*> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewProjMat);
+
     static const std::string MVP_MAT;
 
     std::optional<GLProgram> _program;
+    std::optional<GLProgram> _instancedProgram;
+    std::optional<GLBuffer> _instanceBuffer;
     std::map<std::string, GLUniform> _effectUniforms;
     std::map<std::string, GLUniform> _drawableUniforms;
+    std::map<std::string, int> _instancedUniformLocations;
     std::map<std::string, int> _attributes;
 };
 
 
+// offsets of the per frame camera and light cluster data in the FrameUniforms block,
+// shared by the vertex shaders of the phong effects
+struct PhongFrameUniformsLayout {
+    PhongFrameUniformsLayout() {
+        viewMat = layout.addMember<glm::mat4>();
+        projMat = layout.addMember<glm::mat4>();
+        lightAmbient = layout.addMember<glm::vec3>();
+        clusterTilesX = layout.addMember<int>();
+        clusterTilesY = layout.addMember<int>();
+        clusterSlices = layout.addMember<int>();
+        clusterDepthScale = layout.addMember<float>();
+        clusterDepthBias = layout.addMember<float>();
+    }
+
+    GLUniformBlockLayout layout;
+    int viewMat;
+    int projMat;
+    int lightAmbient;
+    int clusterTilesX;
+    int clusterTilesY;
+    int clusterSlices;
+    int clusterDepthScale;
+    int clusterDepthBias;
+};
+
+
 class ForwardPhongEffect : public Effect {
 public:
     ForwardPhongEffect(DrawContext *context);
@@ -40,6 +72,8 @@ public:
     void draw(const std::vector<Drawable*> &drawables,
               const std::vector<PointLight *> &pointLights) override;
 
+    inline bool supportsDepthPrepass() const override { return true; }
+
     static const std::string EFFECT_NAME;
     static const std::string AMBIENT_COLOR;
     static const std::string DIFFUSE_COLOR;
@@ -47,32 +81,194 @@ public:
     static const std::string SHININESS;
 
 private:
-    struct PointLightUniforms {
-        PointLightUniforms() {
-            for (std::size_t i = 0; i < MAX; ++i) {
-                std::string pointLight = "pointLights[" + std::to_string(i) +"]";
-                positions[i] = pointLight + ".position";
-                colors[i] = pointLight + ".color";
-                radius[i] = pointLight + ".radius";
-            }
-        }
-
-        static const std::size_t MAX;
-        std::string positions[10];
-        std::string colors[10];
-        std::string radius[10];
+    // bins the point lights in view space and uploads them with the clusters
+    void updateLightClusters(const std::vector<PointLight *> &pointLights, const glm::mat4 &viewMat);
+
+    // the light buffer textures stay bound to their units, every program samples them
+    void setLightSamplers(GLProgram &program);
+
+    void drawInstances(const std::vector<Drawable*> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat);
+
+    void drawMultiple(const std::vector<Drawable*> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat);
+
+    static const std::string MV_MAT;
+    static const std::string NORMAL_MAT;
+    static const std::string DRAW_DATA;
+    static const unsigned DRAW_DATA_UNIT;
+    static const std::string POINT_LIGHTS;
+    static const unsigned POINT_LIGHTS_UNIT;
+    static const std::string LIGHT_CLUSTERS;
+    static const unsigned LIGHT_CLUSTERS_UNIT;
+    static const std::string LIGHT_INDICES;
+    static const unsigned LIGHT_INDICES_UNIT;
+    static const std::string FRAME_UNIFORMS;
+    static const unsigned FRAME_UNIFORMS_BINDING;
+    static const PhongFrameUniformsLayout FRAME_UNIFORMS_LAYOUT;
+
+    std::optional<GLUniformBlock> _frameUniforms;
+    std::optional<GLProgram> _program;
+    std::optional<GLProgram> _instancedProgram;
+    std::optional<GLBuffer> _instanceBuffer;
+    std::map<std::string, GLUniform> _effectUniforms;
+    std::map<std::string, GLUniform> _drawableUniforms;
+    std::map<std::string, int> _instancedUniformLocations;
+    std::map<std::string, int> _attributes;
+
+    // packed geometry is drawn with multi draw indirect, per draw data is fetched from a buffer texture
+    std::optional<GLProgram> _multiDrawProgram;
+    std::optional<GLBufferTexture> _drawData;
+    int _drawDataLocation;
+
+    // point lights are shaded per cluster of the view frustum instead of all of them per fragment
+    LightClusterGrid _lightClusters;
+    std::vector<BoundingSphere> _lightSpheres;
+    std::vector<glm::vec4> _pointLightTexels;
+    std::optional<GLBufferTexture> _pointLights;
+    std::optional<GLBufferTexture> _lightClusterRanges;
+    std::optional<GLBufferTexture> _lightIndices;
+};
+
+
+
+/***************************************************
+ * Renders the geometry once into a G-buffer of view normals
+ * and shininess, diffuse and specular colors and view depth,
+ * then adds every point light by drawing its sphere as a
+ * light volume. A stencil pass marks the pixels whose surface
+ * lies inside the volume, so the lighting cost follows the
+ * covered pixels instead of the geometry. The result is
+ * composited into the bound framebuffer with its depth, so
+ * later effects depth test against it. The G-buffer is not
+ * multisampled and follows the viewport size
+ ***************************************************/
+class DeferredPhongEffect : public Effect {
+public:
+    DeferredPhongEffect(DrawContext *context);
+
+    const std::map<std::string, int> &getAttributes() const override;
+
+    EffectProperty createEffectProperty() override;
+
+    void draw(const std::vector<Drawable*> &drawables,
+              const std::vector<PointLight *> &pointLights) override;
+
+    // material parameters are named like the ForwardPhongEffect ones
+    static const std::string EFFECT_NAME;
+    static const std::string AMBIENT_COLOR;
+    static const std::string DIFFUSE_COLOR;
+    static const std::string SPECULAR_COLOR;
+    static const std::string SHININESS;
+
+private:
+    // render targets, the framebuffer is released before its attachments
+    struct GBuffer {
+        GLTexture normalShininess;
+        GLTexture diffuseColors;
+        GLTexture specularColors;
+        GLTexture viewDepths;
+        GLTexture lightAccumulation;
+        GLRenderbuffer depthStencil;
+        GLFramebuffer framebuffer;
     };
 
-    static const std::string MVP_MAT;
+    void resizeGBuffer(int width, int height);
+
+    void drawGeometry(const std::vector<Drawable*> &drawables, const glm::mat4 &viewMat);
+
+    void drawInstances(const std::vector<Drawable*> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat);
+
+    void drawMultiple(const std::vector<Drawable*> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat);
+
+    void drawLightVolumes(const std::vector<PointLight *> &pointLights, const glm::mat4 &viewMat, const glm::mat4 &projMat);
+
+    // draws the light accumulation into the framebuffer bound before the G-buffer
+    void composite(unsigned targetFramebuffer, const std::array<int, 4> &viewport, const glm::mat4 &projMat);
+
     static const std::string MV_MAT;
     static const std::string NORMAL_MAT;
-    static const std::string LIGHT_AMBIENT;
-    static const PointLightUniforms POINT_LIGHTS;
+    static const std::string MVP_MAT;
+    static const std::string DRAW_DATA;
+    static const unsigned DRAW_DATA_UNIT;
+    static const std::string FRAME_UNIFORMS;
+    static const unsigned FRAME_UNIFORMS_BINDING;
+    static const PhongFrameUniformsLayout FRAME_UNIFORMS_LAYOUT;
+    static const std::vector<std::string> G_BUFFER_SAMPLERS;
+    static const std::string LIGHT_ACCUMULATION;
+    static const std::string VIEW_DEPTHS;
+    static const std::string UNPROJECTION;
+    static const std::string LIGHT_POSITION;
+    static const std::string LIGHT_COLOR;
+    static const std::string LIGHT_RADIUS;
+    static const std::string VIEWPORT_ORIGIN;
+    static const std::string DEPTH_PROJECTION;
+    static const float LIGHT_VOLUME_SCALE;
 
+    std::optional<GLUniformBlock> _frameUniforms;
     std::optional<GLProgram> _program;
+    std::optional<GLProgram> _instancedProgram;
+    std::optional<GLProgram> _multiDrawProgram;
+    std::optional<GLBuffer> _instanceBuffer;
+    std::optional<GLBufferTexture> _drawData;
     std::map<std::string, GLUniform> _effectUniforms;
     std::map<std::string, GLUniform> _drawableUniforms;
+    std::map<std::string, int> _instancedUniformLocations;
+    std::map<std::string, int> _attributes;
+    int _drawDataLocation;
+
+    // light volumes shade from the G-buffer, the composite pass copies the result out with its depth
+    std::optional<GLProgram> _lightProgram;
+    std::optional<GLProgram> _compositeProgram;
+    std::map<std::string, int> _lightUniformLocations;
+    std::map<std::string, int> _compositeUniformLocations;
+    std::optional<GLVertexArray> _fullscreenTriangle;
+    std::optional<GBuffer> _gBuffer;
+};
+
+
+
+
+/***************************************************
+ * Draws positions only, so the depth of the scene is laid
+ * down before the expensive shading and every pixel is shaded
+ * once. Transformations are computed like the effects
+ * supporting the prepass and the cluster culled ranges and
+ * levels of detail of the drawables are drawn the same way.
+ * Not registered by name, the draw context owns it
+ ***************************************************/
+class DepthPrepassEffect : public Effect {
+public:
+    DepthPrepassEffect(DrawContext *context);
+
+    const std::map<std::string, int> &getAttributes() const override;
+
+    EffectProperty createEffectProperty() override;
+
+    void draw(const std::vector<Drawable*> &drawables,
+              const std::vector<PointLight *> &pointLights) override;
+
+    static const std::string EFFECT_NAME;
+
+private:
+    void drawInstances(const std::vector<Drawable*> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat);
+
+    void drawMultiple(const std::vector<Drawable*> &drawables, std::size_t begin, std::size_t end, const glm::mat4 &viewMat);
+
+    static const std::string MV_MAT;
+    static const std::string PROJ_MAT;
+    static const std::string DRAW_DATA;
+    static const unsigned DRAW_DATA_UNIT;
+
+    std::optional<GLProgram> _program;
+    std::optional<GLProgram> _instancedProgram;
+    std::optional<GLProgram> _multiDrawProgram;
+    std::optional<GLBuffer> _instanceBuffer;
+    std::optional<GLBufferTexture> _drawData;
     std::map<std::string, int> _attributes;
+    int _mvMatLocation;
+    int _projMatLocation;
+    int _instancedProjMatLocation;
+    int _multiDrawProjMatLocation;
+    int _drawDataLocation;
 };
 
 
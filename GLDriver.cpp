@@ -1,4 +1,6 @@
 #include "GLDriver.h"
+#include <cstring>
+#include <limits>
 #include "glm/gtc/type_ptr.hpp"
 
 
@@ -47,6 +49,14 @@ static UniformType getUniformType(unsigned type, int size) {
         if (size == 1)
             return glm::mat4{};
         return std::vector<glm::mat4>();
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+        // samplers are set to their texture unit
+        if (size == 1)
+            return int{};
+        return std::vector<int>();
     default:
         assert(false && "UNIFORM TYPE NOT IMPLEMENTED");
     }
@@ -64,6 +74,10 @@ GLProgram::GLProgram(GLDriver *driver,
 
     _prog = GL->glCreateProgram();
 
+    // the driver only keeps a binary to hand out when asked before linking
+    if (driver->isProgramCacheEnabled())
+        GL->glProgramParameteri(_prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
     std::vector<unsigned> createdShaders(shaders.size());
     for (const auto &shaderInfo : shaders) {
         unsigned shaderType = shaderInfo.first;
@@ -112,9 +126,19 @@ GLProgram::GLProgram(GLDriver *driver,
 }
 
 
+GLProgram::GLProgram(GLDriver *driver, unsigned binaryFormat, const std::vector<char> &binary)
+    : _driver{driver}
+{
+    auto GL = driver->GL();
+    _prog = GL->glCreateProgram();
+    GL->glProgramBinary(_prog, binaryFormat, binary.data(), static_cast<int>(binary.size()));
+}
+
+
 GLProgram::GLProgram(GLProgram &&other) noexcept
     :_prog{other._prog},
-    _driver{other._driver}
+    _driver{other._driver},
+    _uploadedUniforms{std::move(other._uploadedUniforms)}
 {
     other._prog = 0;
 }
@@ -130,8 +154,7 @@ GLProgram::~GLProgram() noexcept {
     if (!_driver)
         return;
 
-    auto GL = _driver->GL();
-    GL->glDeleteProgram(_prog);
+    _driver->deleteProgram(_prog);
 }
 
 
@@ -139,18 +162,39 @@ void GLProgram::swap(GLProgram &other) noexcept {
     using std::swap;
     swap(_driver, other._driver);
     swap(_prog, other._prog);
+    swap(_uploadedUniforms, other._uploadedUniforms);
 }
 
 
 void GLProgram::bind() {
-    auto GL = _driver->GL();
-    GL->glUseProgram(_prog);
+    _driver->useProgram(_prog);
 }
 
 
 void GLProgram::unbind() {
+    _driver->useProgram(0);
+}
+
+
+bool GLProgram::isLinked() const {
+    int isLinked;
+    _driver->GL()->glGetProgramiv(_prog, GL_LINK_STATUS, &isLinked);
+    return isLinked == GL_TRUE;
+}
+
+
+bool GLProgram::getBinary(unsigned &binaryFormat, std::vector<char> &binary) const {
     auto GL = _driver->GL();
-    GL->glUseProgram(0);
+    int size;
+    GL->glGetProgramiv(_prog, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return false;
+
+    binary.resize(static_cast<std::size_t>(size));
+    int length = 0;
+    GL->glGetProgramBinary(_prog, size, &length, &binaryFormat, binary.data());
+    binary.resize(static_cast<std::size_t>(length));
+    return length > 0;
 }
 
 
@@ -184,6 +228,12 @@ std::map<std::string, GLUniform> GLProgram::getUniforms() const {
     int uniformSize;
     unsigned uniformType;
     for (unsigned i = 0; i < static_cast<std::size_t>(count); ++i) {
+        // members of uniform blocks are backed by buffers, not by locations
+        int blockIndex;
+        GL->glGetActiveUniformsiv(_prog, 1, &i, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+        if (blockIndex != -1)
+            continue;
+
         GL->glGetActiveUniform(_prog, i, sizeof(uniformName), nullptr, &uniformSize, &uniformType, uniformName);
         GLUniform uniform(queryUniformLocation(uniformName), getUniformType(uniformType, uniformSize));
         uniforms.insert({uniformName, std::move(uniform)});
@@ -193,10 +243,45 @@ std::map<std::string, GLUniform> GLProgram::getUniforms() const {
 }
 
 
+void GLProgram::setUniformBlockBinding(const std::string &blockName, unsigned bindingPoint) {
+    auto GL = _driver->GL();
+    unsigned blockIndex = GL->glGetUniformBlockIndex(_prog, blockName.c_str());
+    if (blockIndex == GL_INVALID_INDEX) {
+#ifndef NDEBUG
+        qDebug() << "Cannot Find Uniform Block: " << blockName.data() << "\n";
+#endif
+        return;
+    }
+
+    GL->glUniformBlockBinding(_prog, blockIndex, bindingPoint);
+}
+
+
 void GLProgram::applyUniform(const GLUniform &uniform) {
+    applyUniform(uniform.location(), uniform.getValue());
+}
+
+
+void GLProgram::applyUniform(int location, const UniformType &value) {
+    if (location == -1)
+        return;
+
+    auto uploaded = _uploadedUniforms.find(location);
+    if (uploaded != _uploadedUniforms.end() && uploaded->second == value) {
+        _driver->recordUniformUpload(true);
+        return;
+    }
+
     std::visit([&](const auto &val){
-        applyUniformImpl(uniform.location(), val);
-    }, uniform.getValue());
+        applyUniformImpl(location, val);
+    }, value);
+
+    if (uploaded != _uploadedUniforms.end())
+        uploaded->second = value;
+    else
+        _uploadedUniforms.insert({location, value});
+
+    _driver->recordUniformUpload(false);
 }
 
 
@@ -318,8 +403,7 @@ GLBuffer::~GLBuffer() noexcept {
     if (!_driver)
         return;
 
-    auto GL = _driver->GL();
-    GL->glDeleteBuffers(1, &_buffer);
+    _driver->deleteBuffer(_buffer);
 }
 
 
@@ -334,14 +418,12 @@ void GLBuffer::swap(GLBuffer &other) noexcept {
 
 
 void GLBuffer::bind() {
-    auto GL = _driver->GL();
-    GL->glBindBuffer(_target, _buffer);
+    _driver->bindBuffer(_target, _buffer);
 }
 
 
 void GLBuffer::unbind() {
-    auto GL = _driver->GL();
-    GL->glBindBuffer(_target, 0);
+    _driver->bindBuffer(_target, 0);
 }
 
 
@@ -359,27 +441,106 @@ void GLBuffer::loadSubData(int offset, const void *data, int count) {
 }
 
 
+void GLBuffer::copySubData(GLBuffer &source, int readOffset, int writeOffset, int count) {
+    assert((writeOffset + count <= _capacity) && "GLBuffer overflow");
+    _driver->bindBuffer(GL_COPY_READ_BUFFER, source._buffer);
+    _driver->bindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+    auto GL = _driver->GL();
+    GL->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, readOffset, writeOffset, count);
+}
+
+
+void GLBuffer::bindBase(unsigned index) {
+    _driver->bindBufferBase(_target, index, _buffer);
+}
+
+
+/***************************************************
+ * GLUniformBlockLayout definitions
+ ***************************************************/
+GLUniformBlockLayout::GLUniformBlockLayout()
+    : _size{0}
+{}
+
+
+int GLUniformBlockLayout::addStruct(const GLUniformBlockLayout &structLayout, int arrayCount) {
+    return appendMember(VEC4_ALIGNMENT, structLayout.getStructSize() * std::max(arrayCount, 1));
+}
+
+
+int GLUniformBlockLayout::appendMember(int alignment, int size) {
+    int offset = roundUp(_size, alignment);
+    _size = offset + size;
+    return offset;
+}
+
+
+/***************************************************
+ * GLUniformBlock definitions
+ ***************************************************/
+GLUniformBlock::GLUniformBlock(GLDriver *driver, const GLUniformBlockLayout &layout, unsigned usage)
+    : _buffer{driver->createBuffer(GL_UNIFORM_BUFFER, usage)},
+    _data(static_cast<std::size_t>(layout.getStructSize()), 0),
+    _dirtyBegin{0},
+    _dirtyEnd{0}
+{
+    _buffer.bind();
+    _buffer.loadData(_data.data(), static_cast<int>(_data.size()));
+}
+
+
+void GLUniformBlock::bind(unsigned bindingPoint) {
+    if (_dirtyBegin < _dirtyEnd) {
+        _buffer.bind();
+        _buffer.loadSubData(_dirtyBegin, _data.data() + _dirtyBegin, _dirtyEnd - _dirtyBegin);
+        _dirtyBegin = _dirtyEnd = 0;
+    }
+
+    _buffer.bindBase(bindingPoint);
+}
+
+
+void GLUniformBlock::writeValue(int offset, const void *data, int size) {
+    assert((offset + size <= static_cast<int>(_data.size())) && "GLUniformBlock overflow");
+    auto dst = _data.data() + offset;
+    if (std::memcmp(dst, data, static_cast<std::size_t>(size)) == 0)
+        return;
+
+    std::memcpy(dst, data, static_cast<std::size_t>(size));
+    if (_dirtyBegin == _dirtyEnd) {
+        _dirtyBegin = offset;
+        _dirtyEnd = offset + size;
+    }
+    else {
+        _dirtyBegin = std::min(_dirtyBegin, offset);
+        _dirtyEnd = std::max(_dirtyEnd, offset + size);
+    }
+}
+
+
 /***************************************************
  * GLVertexArray definitions
  ***************************************************/
 GLVertexArray::GLVertexArray(GLDriver *driver, const unsigned *elements, int numOfElements, unsigned usage)
-    : _driver{driver}
+    : _driver{driver}, _instanceBuffer{0}, _numOfInstanceMatrices{0}
 {
-    auto GL = _driver->GL();
-    GL->glGenVertexArrays(1, &_vao);
-    bind();
-    _elementBuffer = _driver->createBuffer(GL_ELEMENT_ARRAY_BUFFER, usage);
-    _elementBuffer->bind();
-    _elementBuffer->loadData(elements, numOfElements * static_cast<int>(sizeof(unsigned)));
-    unbind();
-    _elementBuffer->unbind();
+    createElementBuffer(elements, numOfElements * static_cast<int>(sizeof(unsigned)), usage);
+}
+
+
+GLVertexArray::GLVertexArray(GLDriver *driver, const unsigned short *elements, int numOfElements, unsigned usage)
+    : _driver{driver}, _instanceBuffer{0}, _numOfInstanceMatrices{0}
+{
+    createElementBuffer(elements, numOfElements * static_cast<int>(sizeof(unsigned short)), usage);
 }
 
 
 GLVertexArray::GLVertexArray(GLVertexArray &&other) noexcept
     : _driver{other._driver},
     _elementBuffer{std::move(other._elementBuffer)},
-    _vao{other._vao}
+    _vao{other._vao},
+    _instanceBuffer{other._instanceBuffer},
+    _numOfInstanceMatrices{other._numOfInstanceMatrices}
 {
     other._vao = 0;
 }
@@ -395,8 +556,7 @@ GLVertexArray::~GLVertexArray() noexcept {
     if (!_driver)
         return;
 
-    auto GL = _driver->GL();
-    GL->glDeleteVertexArrays(1, &_vao);
+    _driver->deleteVertexArray(_vao);
 }
 
 
@@ -405,18 +565,18 @@ void GLVertexArray::swap(GLVertexArray &other) noexcept {
     swap(_driver, other._driver);
     swap(_elementBuffer, other._elementBuffer);
     swap(_vao, other._vao);
+    swap(_instanceBuffer, other._instanceBuffer);
+    swap(_numOfInstanceMatrices, other._numOfInstanceMatrices);
 }
 
 
 void GLVertexArray::bind() {
-    auto GL = _driver->GL();
-    GL->glBindVertexArray(_vao);
+    _driver->bindVertexArray(_vao);
 }
 
 
 void GLVertexArray::unbind() {
-    auto GL = _driver->GL();
-    GL->glBindVertexArray(0);
+    _driver->bindVertexArray(0);
 }
 
 
@@ -444,19 +604,329 @@ void GLVertexArray::attribDivisor(int attribIdx, unsigned divisor) {
 }
 
 
+void GLVertexArray::setInstanceMatrices(GLBuffer &instanceBuffer, int firstAttribIdx, int numOfMatrices) {
+    if (_instanceBuffer == instanceBuffer.getId() && _numOfInstanceMatrices == numOfMatrices)
+        return;
+
+    // expects the vertex array to be bound
+    instanceBuffer.bind();
+    int stride = numOfMatrices * static_cast<int>(sizeof(glm::mat4));
+    for (int column = 0; column < numOfMatrices * 4; ++column) {
+        int attribIdx = firstAttribIdx + column;
+        attribPointer(attribIdx, 4, GL_FLOAT, false, stride, column * static_cast<int>(sizeof(glm::vec4)));
+        enableAttrib(attribIdx);
+        attribDivisor(attribIdx, 1);
+    }
+
+    _instanceBuffer = instanceBuffer.getId();
+    _numOfInstanceMatrices = numOfMatrices;
+}
+
+
+void GLVertexArray::setElementBuffer(GLBuffer elementBuffer) {
+    bind();
+    elementBuffer.bind();
+    unbind();
+    _elementBuffer = std::move(elementBuffer);
+}
+
+
+void GLVertexArray::createElementBuffer(const void *elements, int size, unsigned usage) {
+    auto GL = _driver->GL();
+    GL->glGenVertexArrays(1, &_vao);
+    bind();
+    _elementBuffer = _driver->createBuffer(GL_ELEMENT_ARRAY_BUFFER, usage);
+    _elementBuffer->bind();
+    _elementBuffer->loadData(elements, size);
+    unbind();
+    _elementBuffer->unbind();
+}
+
+
+/***************************************************
+ * GLBufferTexture definitions
+ ***************************************************/
+GLBufferTexture::GLBufferTexture(GLDriver *driver, unsigned internalFormat, unsigned usage)
+    : _driver{driver}, _buffer{driver->createBuffer(GL_TEXTURE_BUFFER, usage)}
+{
+    auto GL = _driver->GL();
+    GL->glGenTextures(1, &_texture);
+    GL->glBindTexture(GL_TEXTURE_BUFFER, _texture);
+    GL->glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, _buffer.getId());
+    GL->glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+
+GLBufferTexture::GLBufferTexture(GLBufferTexture &&other) noexcept
+    : _driver{other._driver},
+    _buffer{std::move(other._buffer)},
+    _texture{other._texture}
+{
+    other._texture = 0;
+}
+
+
+GLBufferTexture &GLBufferTexture::operator=(GLBufferTexture &&other) noexcept {
+    GLBufferTexture(std::move(other)).swap(*this);
+    return *this;
+}
+
+
+GLBufferTexture::~GLBufferTexture() noexcept {
+    if (!_driver || _texture == 0)
+        return;
+
+    auto GL = _driver->GL();
+    GL->glDeleteTextures(1, &_texture);
+}
+
+
+void GLBufferTexture::swap(GLBufferTexture &other) noexcept {
+    using std::swap;
+    swap(_driver, other._driver);
+    _buffer.swap(other._buffer);
+    swap(_texture, other._texture);
+}
+
+
+void GLBufferTexture::loadData(const void *data, int count) {
+    // the texture keeps referring to the buffer when its storage is respecified
+    _buffer.bind();
+    _buffer.loadData(data, count);
+}
+
+
+void GLBufferTexture::bind(unsigned textureUnit) {
+    auto GL = _driver->GL();
+    GL->glActiveTexture(GL_TEXTURE0 + textureUnit);
+    GL->glBindTexture(GL_TEXTURE_BUFFER, _texture);
+}
+
+
+/***************************************************
+ * GLTexture definitions
+ ***************************************************/
+GLTexture::GLTexture(GLDriver *driver, unsigned internalFormat, int width, int height)
+    : _driver{driver}, _width{width}, _height{height}
+{
+    auto GL = _driver->GL();
+    GL->glGenTextures(1, &_texture);
+    GL->glBindTexture(GL_TEXTURE_2D, _texture);
+    GL->glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+    GL->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    GL->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    GL->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    GL->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GL->glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+GLTexture::GLTexture(GLTexture &&other) noexcept
+    : _driver{other._driver},
+    _texture{other._texture},
+    _width{other._width},
+    _height{other._height}
+{
+    other._texture = 0;
+}
+
+
+GLTexture &GLTexture::operator=(GLTexture &&other) noexcept {
+    GLTexture(std::move(other)).swap(*this);
+    return *this;
+}
+
+
+GLTexture::~GLTexture() noexcept {
+    if (!_driver || _texture == 0)
+        return;
+
+    auto GL = _driver->GL();
+    GL->glDeleteTextures(1, &_texture);
+}
+
+
+void GLTexture::swap(GLTexture &other) noexcept {
+    using std::swap;
+    swap(_driver, other._driver);
+    swap(_texture, other._texture);
+    swap(_width, other._width);
+    swap(_height, other._height);
+}
+
+
+void GLTexture::bind(unsigned textureUnit) {
+    auto GL = _driver->GL();
+    GL->glActiveTexture(GL_TEXTURE0 + textureUnit);
+    GL->glBindTexture(GL_TEXTURE_2D, _texture);
+}
+
+
+/***************************************************
+ * GLRenderbuffer definitions
+ ***************************************************/
+GLRenderbuffer::GLRenderbuffer(GLDriver *driver, unsigned internalFormat, int width, int height, int samples)
+    : _driver{driver}
+{
+    auto GL = _driver->GL();
+    GL->glGenRenderbuffers(1, &_renderbuffer);
+    GL->glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffer);
+    GL->glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, internalFormat, width, height);
+    GL->glBindRenderbuffer(GL_RENDERBUFFER, 0);
+}
+
+
+GLRenderbuffer::GLRenderbuffer(GLRenderbuffer &&other) noexcept
+    : _driver{other._driver},
+    _renderbuffer{other._renderbuffer}
+{
+    other._renderbuffer = 0;
+}
+
+
+GLRenderbuffer &GLRenderbuffer::operator=(GLRenderbuffer &&other) noexcept {
+    GLRenderbuffer(std::move(other)).swap(*this);
+    return *this;
+}
+
+
+GLRenderbuffer::~GLRenderbuffer() noexcept {
+    if (!_driver || _renderbuffer == 0)
+        return;
+
+    auto GL = _driver->GL();
+    GL->glDeleteRenderbuffers(1, &_renderbuffer);
+}
+
+
+void GLRenderbuffer::swap(GLRenderbuffer &other) noexcept {
+    using std::swap;
+    swap(_driver, other._driver);
+    swap(_renderbuffer, other._renderbuffer);
+}
+
+
+/***************************************************
+ * GLFramebuffer definitions
+ ***************************************************/
+GLFramebuffer::GLFramebuffer(GLDriver *driver)
+    : _driver{driver}
+{
+    auto GL = _driver->GL();
+    GL->glGenFramebuffers(1, &_framebuffer);
+}
+
+
+GLFramebuffer::GLFramebuffer(GLFramebuffer &&other) noexcept
+    : _driver{other._driver},
+    _framebuffer{other._framebuffer}
+{
+    other._framebuffer = 0;
+}
+
+
+GLFramebuffer &GLFramebuffer::operator=(GLFramebuffer &&other) noexcept {
+    GLFramebuffer(std::move(other)).swap(*this);
+    return *this;
+}
+
+
+GLFramebuffer::~GLFramebuffer() noexcept {
+    if (!_driver || _framebuffer == 0)
+        return;
+
+    auto GL = _driver->GL();
+    GL->glDeleteFramebuffers(1, &_framebuffer);
+}
+
+
+void GLFramebuffer::swap(GLFramebuffer &other) noexcept {
+    using std::swap;
+    swap(_driver, other._driver);
+    swap(_framebuffer, other._framebuffer);
+}
+
+
+void GLFramebuffer::bind() {
+    _driver->bindFramebuffer(_framebuffer);
+}
+
+
+void GLFramebuffer::attachTexture(unsigned attachment, const GLTexture &texture) {
+    bind();
+    auto GL = _driver->GL();
+    GL->glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture.getId(), 0);
+}
+
+
+void GLFramebuffer::attachRenderbuffer(unsigned attachment, const GLRenderbuffer &renderbuffer) {
+    bind();
+    auto GL = _driver->GL();
+    GL->glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, renderbuffer.getId());
+}
+
+
+void GLFramebuffer::setDrawBuffers(const std::vector<unsigned> &attachments) {
+    auto GL = _driver->GL();
+    GL->glDrawBuffers(static_cast<int>(attachments.size()), attachments.data());
+}
+
+
+void GLFramebuffer::clearColorBuffer(int drawBuffer, glm::vec4 color) {
+    auto GL = _driver->GL();
+    GL->glClearBufferfv(GL_COLOR, drawBuffer, &color[0]);
+}
+
+
+void GLFramebuffer::clearDepthStencil(float depth, int stencil) {
+    auto GL = _driver->GL();
+    GL->glClearBufferfi(GL_DEPTH_STENCIL, 0, depth, stencil);
+}
+
+
+bool GLFramebuffer::isComplete() {
+    bind();
+    auto GL = _driver->GL();
+    return GL->glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+
 /***************************************************
  * GLDriver definitions
  ***************************************************/
-GLDriver::GLDriver() {}
+const std::uint64_t GLDriver::TIMER_QUERY_UNAVAILABLE = std::numeric_limits<std::uint64_t>::max();
+
+GLDriver::GLDriver()
+    : _timerQueryPool{0}, _isTimerQueryActive{false}, _GL43{nullptr}, _hasProgramBinaries{false}
+{}
 
 
-void GLDriver::initialize(QSurface *surface) {
+bool GLDriver::initialize(QSurface *surface) {
     _context.setFormat(surface->format());
-    _context.create();
-    _context.makeCurrent(surface);
-    _GL.initializeOpenGLFunctions();
+    if (!_context.create() || !_context.makeCurrent(surface) || !_GL.initializeOpenGLFunctions())
+        return false;
+
+    // multi draw indirect is core since 4.3, older contexts fall back to a loop
+    _GL43 = _context.versionFunctions<QOpenGLFunctions_4_3_Core>();
+    if (_GL43)
+        _GL43->initializeOpenGLFunctions();
+
+    // drivers may support program binaries without offering any format
+    int numOfBinaryFormats = 0;
+    _GL.glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numOfBinaryFormats);
+    _hasProgramBinaries = numOfBinaryFormats > 0;
+
+    _driverIdentity.clear();
+    for (unsigned name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        auto value = _GL.glGetString(name);
+        if (value)
+            _driverIdentity += reinterpret_cast<const char*>(value);
+
+        _driverIdentity += '\n';
+    }
 
     _device = std::make_unique<QOpenGLPaintDevice>();
+    return true;
 }
 
 
@@ -485,7 +955,27 @@ QPainter GLDriver::createPainter() {
 
 
 GLProgram GLDriver::createProgram(const std::vector<std::pair<unsigned, std::string> > &shaders) {
-    return {this, shaders};
+    if (!isProgramCacheEnabled())
+        return {this, shaders};
+
+    auto key = ProgramCache::createKey(_driverIdentity, shaders);
+    unsigned binaryFormat;
+    std::vector<char> binary;
+    if (_programCache.read(key, binaryFormat, binary)) {
+        GLProgram program(this, binaryFormat, binary);
+        if (program.isLinked())
+            return program;
+    }
+
+    // a missing or rejected binary is replaced by the one just linked
+    GLProgram program(this, shaders);
+    if (program.isLinked() && program.getBinary(binaryFormat, binary) && !_programCache.write(key, binaryFormat, binary)) {
+#ifndef NDEBUG
+        qDebug() << "Failed to write program cache" << key.c_str();
+#endif
+    }
+
+    return program;
 }
 
 
@@ -494,98 +984,155 @@ GLBuffer GLDriver::createBuffer(unsigned target, unsigned usage) {
 }
 
 
+GLUniformBlock GLDriver::createUniformBlock(const GLUniformBlockLayout &layout, unsigned usage) {
+    return {this, layout, usage};
+}
+
+
 GLVertexArray GLDriver::createVertexArray(const unsigned *elements, int numOfElements,  unsigned usage) {
     return {this, elements, numOfElements, usage};
 }
 
 
+GLVertexArray GLDriver::createVertexArray(const unsigned short *elements, int numOfElements, unsigned usage) {
+    return {this, elements, numOfElements, usage};
+}
+
+
+GLBufferTexture GLDriver::createBufferTexture(unsigned internalFormat, unsigned usage) {
+    return {this, internalFormat, usage};
+}
+
+
+GLTexture GLDriver::createTexture(unsigned internalFormat, int width, int height) {
+    return {this, internalFormat, width, height};
+}
+
+
+GLRenderbuffer GLDriver::createRenderbuffer(unsigned internalFormat, int width, int height, int samples) {
+    return {this, internalFormat, width, height, samples};
+}
+
+
+GLFramebuffer GLDriver::createFramebuffer() {
+    return GLFramebuffer(this);
+}
+
+
+unsigned GLDriver::getBoundFramebuffer() {
+    int framebuffer;
+    _GL.glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    return static_cast<unsigned>(framebuffer);
+}
+
+
+std::array<int, 4> GLDriver::getBoundViewport() {
+    std::array<int, 4> viewport;
+    _GL.glGetIntegerv(GL_VIEWPORT, viewport.data());
+    return viewport;
+}
+
+
+void GLDriver::bindFramebuffer(unsigned framebuffer) {
+    _GL.glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+
 void GLDriver::setColorMask(bool red, bool blue, bool green, bool alpha) {
-    _GL.glColorMask(red, green, blue, alpha);
+    if (updateState(_state.colorMask, {red, green, blue, alpha}))
+        _GL.glColorMask(red, green, blue, alpha);
 }
 
 
 void GLDriver::enableCullFace(bool enableOrDisable) {
-    if (enableOrDisable) {
-        _GL.glEnable(GL_CULL_FACE);
-    }
-    else {
-        _GL.glDisable(GL_CULL_FACE);
-    }
+    enableCapability(GL_CULL_FACE, _state.cullFaceEnabled, enableOrDisable);
 }
 
 
 void GLDriver::setCullFace(unsigned face) {
-    _GL.glCullFace(face);
+    if (updateState(_state.cullFace, face))
+        _GL.glCullFace(face);
 }
 
 
 void GLDriver::setFrontFace(unsigned face) {
-    _GL.glFrontFace(face);
+    if (updateState(_state.frontFace, face))
+        _GL.glFrontFace(face);
 }
 
 
 void GLDriver::enableStencilTest(bool enableOrDisable) {
-    if (enableOrDisable) {
-        _GL.glEnable(GL_STENCIL_TEST);
-    }
-    else {
-        _GL.glDisable(GL_STENCIL_TEST);
-    }
+    enableCapability(GL_STENCIL_TEST, _state.stencilTestEnabled, enableOrDisable);
 }
 
 
 void GLDriver::setStencilFunc(unsigned func, int ref, unsigned mask) {
-    _GL.glStencilFunc(func, ref, mask);
+    if (updateState(_state.stencilFunc, {func, ref, mask}))
+        _GL.glStencilFunc(func, ref, mask);
 }
 
 
 void GLDriver::setStencilOp(unsigned stencilFail, unsigned depthFail, unsigned depthStencilPass) {
-    _GL.glStencilOp(stencilFail, depthFail, depthStencilPass);
+    setStencilOpSeparate(GL_FRONT_AND_BACK, stencilFail, depthFail, depthStencilPass);
 }
 
 
-void GLDriver::enableBlend(bool enableOrDisable) {
-    if (enableOrDisable) {
-        _GL.glEnable(GL_BLEND);
-    }
-    else {
-        _GL.glDisable(GL_BLEND);
+void GLDriver::setStencilOpSeparate(unsigned face, unsigned stencilFail, unsigned depthFail, unsigned depthStencilPass) {
+    std::tuple<unsigned, unsigned, unsigned> stencilOp{stencilFail, depthFail, depthStencilPass};
+    bool isFront = face != GL_BACK;
+    bool isBack = face != GL_FRONT;
+    if ((!isFront || _state.frontStencilOp == stencilOp) && (!isBack || _state.backStencilOp == stencilOp)) {
+        ++_statistics.filteredStateCalls;
+        return;
     }
+
+    if (isFront)
+        _state.frontStencilOp = stencilOp;
+    if (isBack)
+        _state.backStencilOp = stencilOp;
+
+    ++_statistics.issuedStateCalls;
+    _GL.glStencilOpSeparate(face, stencilFail, depthFail, depthStencilPass);
+}
+
+
+void GLDriver::enableBlend(bool enableOrDisable) {
+    enableCapability(GL_BLEND, _state.blendEnabled, enableOrDisable);
 }
 
 
 void GLDriver::setBlendFunc(unsigned sfactor, unsigned dfactor) {
-    _GL.glBlendFunc(sfactor, dfactor);
+    if (updateState(_state.blendFunc, {sfactor, dfactor}))
+        _GL.glBlendFunc(sfactor, dfactor);
 }
 
 
 void GLDriver::setBlendEquation(unsigned equation) {
-    _GL.glBlendEquation(equation);
+    if (updateState(_state.blendEquation, equation))
+        _GL.glBlendEquation(equation);
 }
 
 
 void GLDriver::enableDepthTest(bool enableOrDisable) {
-    if (enableOrDisable) {
-        _GL.glEnable(GL_DEPTH_TEST);
-    }
-    else {
-        _GL.glDisable(GL_DEPTH_TEST);
-    }
+    enableCapability(GL_DEPTH_TEST, _state.depthTestEnabled, enableOrDisable);
 }
 
 
 void GLDriver::setDepthFunc(unsigned func) {
-    _GL.glDepthFunc(func);
+    if (updateState(_state.depthFunc, func))
+        _GL.glDepthFunc(func);
 }
 
 
 void GLDriver::setDepthRange(double near, double far) {
-    _GL.glDepthRange(near, far);
+    if (updateState(_state.depthRange, {near, far}))
+        _GL.glDepthRange(near, far);
 }
 
 
 void GLDriver::enableDepthMask(bool enableOrDisable) {
-    _GL.glDepthMask(enableOrDisable);
+    if (updateState(_state.depthMask, enableOrDisable))
+        _GL.glDepthMask(enableOrDisable);
 }
 
 
@@ -595,21 +1142,25 @@ void GLDriver::clearBufferBit(unsigned bufferBit) {
 
 
 void GLDriver::clearColor(glm::vec4 color) {
-    _GL.glClearColor(color.r, color.g, color.b, color.a);
+    if (updateState(_state.clearColor, color))
+        _GL.glClearColor(color.r, color.g, color.b, color.a);
 }
 
 
 void GLDriver::setViewport(int x, int y, int width, int height) {
-    _GL.glViewport(x, y, width, height);
+    if (updateState(_state.viewport, {x, y, width, height}))
+        _GL.glViewport(x, y, width, height);
 }
 
 
 void GLDriver::drawElements(unsigned mode, unsigned elementCount, unsigned elementType, unsigned offset) {
+    ++_statistics.drawCalls;
     _GL.glDrawElements(mode, static_cast<int>(elementCount), elementType, reinterpret_cast<void*>(offset));
 }
 
 
 void GLDriver::drawElementsInstanced(unsigned mode, unsigned elementCount, unsigned elementType, unsigned offset, int instanceCount) {
+    ++_statistics.drawCalls;
     _GL.glDrawElementsInstanced(mode,
                                  static_cast<int>(elementCount),
                                  elementType,
@@ -618,3 +1169,165 @@ void GLDriver::drawElementsInstanced(unsigned mode, unsigned elementCount, unsig
 }
 
 
+void GLDriver::multiDrawElementsIndirect(unsigned mode, unsigned elementType, unsigned offset, int drawCount, int stride) {
+    if (_GL43) {
+        ++_statistics.drawCalls;
+        _GL43->glMultiDrawElementsIndirect(mode, elementType, reinterpret_cast<void*>(offset), drawCount, stride);
+        return;
+    }
+
+    _statistics.drawCalls += static_cast<std::size_t>(drawCount);
+    for (int i = 0; i < drawCount; ++i) {
+        _GL.glDrawElementsIndirect(mode, elementType, reinterpret_cast<void*>(offset + static_cast<unsigned>(i * stride)));
+    }
+}
+
+
+void GLDriver::useProgram(unsigned program) {
+    if (updateState(_state.program, program))
+        _GL.glUseProgram(program);
+}
+
+
+void GLDriver::bindVertexArray(unsigned vao) {
+    if (updateState(_state.vertexArray, vao)) {
+        _GL.glBindVertexArray(vao);
+
+        // element array buffer binding is part of the VAO state
+        _state.buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+    }
+}
+
+
+void GLDriver::bindBuffer(unsigned target, unsigned buffer) {
+    auto bound = _state.buffers.find(target);
+    if (bound != _state.buffers.end() && bound->second == buffer) {
+        ++_statistics.filteredStateCalls;
+        return;
+    }
+
+    _state.buffers.insert_or_assign(target, buffer);
+    ++_statistics.issuedStateCalls;
+    _GL.glBindBuffer(target, buffer);
+}
+
+
+void GLDriver::bindBufferBase(unsigned target, unsigned index, unsigned buffer) {
+    auto bound = _state.indexedBuffers.find({target, index});
+    if (bound != _state.indexedBuffers.end() && bound->second == buffer) {
+        ++_statistics.filteredStateCalls;
+        return;
+    }
+
+    _state.indexedBuffers.insert_or_assign({target, index}, buffer);
+    ++_statistics.issuedStateCalls;
+    _GL.glBindBufferBase(target, index, buffer);
+
+    // binding to an indexed target also binds the generic one
+    _state.buffers.insert_or_assign(target, buffer);
+}
+
+
+void GLDriver::deleteProgram(unsigned program) {
+    _GL.glDeleteProgram(program);
+
+    // a deleted program stays in use until another one is bound
+    if (_state.program == program)
+        _state.program.reset();
+}
+
+
+void GLDriver::deleteVertexArray(unsigned vao) {
+    _GL.glDeleteVertexArrays(1, &vao);
+
+    if (_state.vertexArray == vao) {
+        _state.vertexArray = 0;
+        _state.buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+    }
+}
+
+
+void GLDriver::deleteBuffer(unsigned buffer) {
+    _GL.glDeleteBuffers(1, &buffer);
+
+    // deleting a buffer resets every binding point it is bound to
+    for (auto &binding : _state.buffers) {
+        if (binding.second == buffer)
+            binding.second = 0;
+    }
+
+    for (auto &binding : _state.indexedBuffers) {
+        if (binding.second == buffer)
+            binding.second = 0;
+    }
+}
+
+
+void GLDriver::invalidateState() {
+    _state = GLState{};
+}
+
+
+void GLDriver::recordUniformUpload(bool filtered) {
+    if (filtered)
+        ++_statistics.filteredUniformUploads;
+    else
+        ++_statistics.issuedUniformUploads;
+}
+
+
+std::vector<std::uint64_t> GLDriver::swapTimerQueryPools() {
+    assert(!_isTimerQueryActive);
+    _timerQueryPool = 1 - _timerQueryPool;
+    auto &pool = _timerQueryPools[_timerQueryPool];
+    std::vector<std::uint64_t> elapsedTimes(pool.numOfIssued);
+    for (std::size_t i = 0; i < pool.numOfIssued; ++i) {
+        GLuint isAvailable = GL_FALSE;
+        _GL.glGetQueryObjectuiv(pool.queries[i], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (!isAvailable) {
+            elapsedTimes[i] = TIMER_QUERY_UNAVAILABLE;
+            continue;
+        }
+
+        GLuint64 elapsedTime = 0;
+        _GL.glGetQueryObjectui64v(pool.queries[i], GL_QUERY_RESULT, &elapsedTime);
+        elapsedTimes[i] = elapsedTime;
+    }
+
+    pool.numOfIssued = 0;
+    return elapsedTimes;
+}
+
+
+void GLDriver::beginTimerQuery() {
+    assert(!_isTimerQueryActive && "TIMER QUERIES CANNOT NEST");
+    auto &pool = _timerQueryPools[_timerQueryPool];
+    if (pool.numOfIssued == pool.queries.size()) {
+        unsigned query;
+        _GL.glGenQueries(1, &query);
+        pool.queries.push_back(query);
+    }
+
+    _GL.glBeginQuery(GL_TIME_ELAPSED, pool.queries[pool.numOfIssued++]);
+    _isTimerQueryActive = true;
+}
+
+
+void GLDriver::endTimerQuery() {
+    assert(_isTimerQueryActive);
+    _GL.glEndQuery(GL_TIME_ELAPSED);
+    _isTimerQueryActive = false;
+}
+
+
+void GLDriver::enableCapability(unsigned capability, std::optional<bool> &state, bool enableOrDisable) {
+    if (!updateState(state, enableOrDisable))
+        return;
+
+    if (enableOrDisable) {
+        _GL.glEnable(capability);
+    }
+    else {
+        _GL.glDisable(capability);
+    }
+}
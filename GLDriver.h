@@ -5,7 +5,9 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <cstdint>
 #include <QOpenGLFunctions_4_2_Core>
+#include <QOpenGLFunctions_4_3_Core>
 #include <QDebug>
 #include <QOpenGLPaintDevice>
 #include <QPainter>
@@ -13,6 +15,13 @@
 #include <glm/glm.hpp>
 #include <cassert>
 #include <variant>
+#include <array>
+#include <optional>
+#include <tuple>
+#include <map>
+#include <type_traits>
+#include <unordered_map>
+#include "ProgramCache.h"
 
 
 class GLDriver;
@@ -69,6 +78,9 @@ public:
     GLProgram(GLDriver *driver,
               const std::vector<std::pair<unsigned, std::string>> &shaders);
 
+    // links from a binary of getBinary, check isLinked as the driver may reject it
+    GLProgram(GLDriver *driver, unsigned binaryFormat, const std::vector<char> &binary);
+
     GLProgram(const GLProgram &) = delete;
 
     GLProgram(GLProgram &&) noexcept;
@@ -85,12 +97,22 @@ public:
 
     void unbind();
 
+    bool isLinked() const;
+
+    // fails when the driver has no binary of the program
+    bool getBinary(unsigned &binaryFormat, std::vector<char> &binary) const;
+
     std::map<std::string, GLUniform> getUniforms() const;
 
     std::map<std::string, int> getAttributes() const;
 
+    void setUniformBlockBinding(const std::string &blockName, unsigned bindingPoint);
+
     void applyUniform(const GLUniform &uniform);
 
+    // applies a value at a location of this program, used when a uniform is shared by name across program variants
+    void applyUniform(int location, const UniformType &value);
+
 private:
     int queryUniformLocation(const std::string &uniformName) const;
 
@@ -128,6 +150,9 @@ private:
 
     unsigned _prog;
     GLDriver *_driver;
+
+    // last value uploaded per uniform location, used to skip redundant uploads
+    std::unordered_map<int, UniformType> _uploadedUniforms;
 };
 
 
@@ -155,6 +180,15 @@ public:
 
     void loadSubData(int offset, const void *data, int count);
 
+    // copies a range of another buffer into this one on the GPU
+    void copySubData(GLBuffer &source, int readOffset, int writeOffset, int count);
+
+    void bindBase(unsigned index);
+
+    inline unsigned getId() const { return _buffer; }
+
+    inline int getCapacity() const { return _capacity; }
+
 private:
     GLDriver *_driver;
     unsigned _buffer;
@@ -164,10 +198,87 @@ private:
 };
 
 
+template<typename T>
+struct GLStd140 {};
+
+template<> struct GLStd140<int>       { static constexpr int ALIGNMENT = 4;  static constexpr int SIZE = 4;  };
+template<> struct GLStd140<unsigned>  { static constexpr int ALIGNMENT = 4;  static constexpr int SIZE = 4;  };
+template<> struct GLStd140<float>     { static constexpr int ALIGNMENT = 4;  static constexpr int SIZE = 4;  };
+template<> struct GLStd140<glm::vec2> { static constexpr int ALIGNMENT = 8;  static constexpr int SIZE = 8;  };
+template<> struct GLStd140<glm::vec3> { static constexpr int ALIGNMENT = 16; static constexpr int SIZE = 12; };
+template<> struct GLStd140<glm::vec4> { static constexpr int ALIGNMENT = 16; static constexpr int SIZE = 16; };
+template<> struct GLStd140<glm::mat2> { static constexpr int ALIGNMENT = 16; static constexpr int SIZE = 32; };
+template<> struct GLStd140<glm::mat3> { static constexpr int ALIGNMENT = 16; static constexpr int SIZE = 48; };
+template<> struct GLStd140<glm::mat4> { static constexpr int ALIGNMENT = 16; static constexpr int SIZE = 64; };
+
+
+// computes member offsets of a uniform block or struct following the std140 rules
+class GLUniformBlockLayout {
+public:
+    GLUniformBlockLayout();
+
+    // returns the offset of the newly added member. Array element stride is rounded up to vec4
+    template<typename T>
+    int addMember(int arrayCount = 0) {
+        if (arrayCount == 0)
+            return appendMember(GLStd140<T>::ALIGNMENT, GLStd140<T>::SIZE);
+
+        return appendMember(VEC4_ALIGNMENT, roundUp(GLStd140<T>::SIZE, VEC4_ALIGNMENT) * arrayCount);
+    }
+
+    int addStruct(const GLUniformBlockLayout &structLayout, int arrayCount = 0);
+
+    inline int getSize() const { return _size; }
+
+    inline int getStructSize() const { return roundUp(_size, VEC4_ALIGNMENT); }
+
+private:
+    static constexpr int VEC4_ALIGNMENT = 16;
+
+    static inline int roundUp(int value, int alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    int appendMember(int alignment, int size);
+
+    int _size;
+};
+
+
+class GLUniformBlock {
+public:
+    GLUniformBlock(GLDriver *driver, const GLUniformBlockLayout &layout, unsigned usage);
+
+    template<typename T>
+    inline void setValue(int offset, const T &value) {
+        if constexpr (std::is_same_v<T, glm::mat2> || std::is_same_v<T, glm::mat3>) {
+            // matrix columns are padded to vec4 in std140
+            for (int column = 0; column < T::length(); ++column)
+                writeValue(offset + column * GLStd140<glm::vec4>::SIZE, &value[column], sizeof(value[column]));
+        }
+        else {
+            writeValue(offset, &value, GLStd140<T>::SIZE);
+        }
+    }
+
+    void bind(unsigned bindingPoint);
+
+private:
+    void writeValue(int offset, const void *data, int size);
+
+    GLBuffer _buffer;
+    std::vector<unsigned char> _data;
+    int _dirtyBegin;
+    int _dirtyEnd;
+};
+
+
 class GLVertexArray {
 public:
     GLVertexArray(GLDriver *driver, const unsigned *elements, int numOfElements, unsigned usage);
 
+    GLVertexArray(GLDriver *driver, const unsigned short *elements, int numOfElements, unsigned usage);
+
     GLVertexArray(const GLVertexArray &) = delete;
 
     GLVertexArray(GLVertexArray &&) noexcept;
@@ -192,10 +303,174 @@ public:
 
     void attribDivisor(int attribIdx, unsigned divisor);
 
+    // points four vec4 attributes per matrix at the buffer, advancing once per instance.
+    // The vertex array remembers the layout, so repeated calls with the same buffer are free
+    void setInstanceMatrices(GLBuffer &instanceBuffer, int firstAttribIdx, int numOfMatrices);
+
+    // replaces the element buffer, the vertex array keeps its id
+    void setElementBuffer(GLBuffer elementBuffer);
+
+    inline GLBuffer &getElementBuffer() { return *_elementBuffer; }
+
+    inline unsigned getId() const { return _vao; }
+
 private:
+    void createElementBuffer(const void *elements, int size, unsigned usage);
+
     GLDriver *_driver;
     std::optional<GLBuffer> _elementBuffer;
     unsigned _vao;
+    unsigned _instanceBuffer;
+    int _numOfInstanceMatrices;
+};
+
+
+// buffer exposed to shaders as a samplerBuffer
+class GLBufferTexture {
+public:
+    GLBufferTexture(GLDriver *driver, unsigned internalFormat, unsigned usage);
+
+    GLBufferTexture(const GLBufferTexture &) = delete;
+
+    GLBufferTexture(GLBufferTexture &&) noexcept;
+
+    GLBufferTexture &operator=(const GLBufferTexture &) = delete;
+
+    GLBufferTexture &operator=(GLBufferTexture &&) noexcept;
+
+    ~GLBufferTexture() noexcept;
+
+    void swap(GLBufferTexture &other) noexcept;
+
+    void loadData(const void *data, int count);
+
+    void bind(unsigned textureUnit);
+
+private:
+    GLDriver *_driver;
+    GLBuffer _buffer;
+    unsigned _texture;
+};
+
+
+// 2D texture with immutable storage, sampled with texelFetch and used as a render target
+class GLTexture {
+public:
+    GLTexture(GLDriver *driver, unsigned internalFormat, int width, int height);
+
+    GLTexture(const GLTexture &) = delete;
+
+    GLTexture(GLTexture &&) noexcept;
+
+    GLTexture &operator=(const GLTexture &) = delete;
+
+    GLTexture &operator=(GLTexture &&) noexcept;
+
+    ~GLTexture() noexcept;
+
+    void swap(GLTexture &other) noexcept;
+
+    void bind(unsigned textureUnit);
+
+    inline unsigned getId() const { return _texture; }
+
+    inline int getWidth() const { return _width; }
+
+    inline int getHeight() const { return _height; }
+
+private:
+    GLDriver *_driver;
+    unsigned _texture;
+    int _width;
+    int _height;
+};
+
+
+// render target that is never sampled, e.g. a depth stencil buffer
+class GLRenderbuffer {
+public:
+    GLRenderbuffer(GLDriver *driver, unsigned internalFormat, int width, int height, int samples = 0);
+
+    GLRenderbuffer(const GLRenderbuffer &) = delete;
+
+    GLRenderbuffer(GLRenderbuffer &&) noexcept;
+
+    GLRenderbuffer &operator=(const GLRenderbuffer &) = delete;
+
+    GLRenderbuffer &operator=(GLRenderbuffer &&) noexcept;
+
+    ~GLRenderbuffer() noexcept;
+
+    void swap(GLRenderbuffer &other) noexcept;
+
+    inline unsigned getId() const { return _renderbuffer; }
+
+private:
+    GLDriver *_driver;
+    unsigned _renderbuffer;
+};
+
+
+// framebuffer object, the attached textures and renderbuffers must outlive it
+class GLFramebuffer {
+public:
+    GLFramebuffer(GLDriver *driver);
+
+    GLFramebuffer(const GLFramebuffer &) = delete;
+
+    GLFramebuffer(GLFramebuffer &&) noexcept;
+
+    GLFramebuffer &operator=(const GLFramebuffer &) = delete;
+
+    GLFramebuffer &operator=(GLFramebuffer &&) noexcept;
+
+    ~GLFramebuffer() noexcept;
+
+    void swap(GLFramebuffer &other) noexcept;
+
+    // binds for drawing and reading
+    void bind();
+
+    void attachTexture(unsigned attachment, const GLTexture &texture);
+
+    void attachRenderbuffer(unsigned attachment, const GLRenderbuffer &renderbuffer);
+
+    // the framebuffer must be bound
+    void setDrawBuffers(const std::vector<unsigned> &attachments);
+
+    // clears without touching the driver's clear color, drawBuffer indexes the draw buffers set last
+    void clearColorBuffer(int drawBuffer, glm::vec4 color);
+
+    void clearDepthStencil(float depth, int stencil);
+
+    bool isComplete();
+
+    inline unsigned getId() const { return _framebuffer; }
+
+private:
+    GLDriver *_driver;
+    unsigned _framebuffer;
+};
+
+
+// layout of a command read by glDrawElementsIndirect
+struct GLDrawElementsIndirectCommand {
+    unsigned count;
+    unsigned instanceCount;
+    unsigned firstIndex;
+    int baseVertex;
+    unsigned baseInstance;
+};
+
+
+struct GLDriverStatistics {
+    std::size_t issuedStateCalls = 0;
+    std::size_t filteredStateCalls = 0;
+    std::size_t issuedUniformUploads = 0;
+    std::size_t filteredUniformUploads = 0;
+
+    // a multi draw counts once however many commands it reads
+    std::size_t drawCalls = 0;
 };
 
 
@@ -209,7 +484,8 @@ public:
 
     inline QOpenGLFunctions_4_2_Core *GL() { return &_GL; }
 
-    void initialize(QSurface *surface);
+    // returns false when no context with the surface format can be created
+    bool initialize(QSurface *surface);
 
     void swapBuffers(QSurface *surface);
 
@@ -221,12 +497,40 @@ public:
 
     QPainter createPainter();
 
+    // loads the linked binary from the program cache when it holds one for this driver, otherwise compiles
+    // the shaders and stores the binary
     GLProgram createProgram(const std::vector<std::pair<unsigned, std::string>> &shaders);
 
+    // an empty directory disables the program cache, set before creating programs
+    inline void setProgramCacheDirectory(const std::string &directory) { _programCache.setDirectory(directory); }
+
+    inline bool isProgramCacheEnabled() const { return _programCache.isEnabled() && _hasProgramBinaries; }
+
     GLBuffer createBuffer(unsigned target, unsigned usage);
 
+    GLUniformBlock createUniformBlock(const GLUniformBlockLayout &layout, unsigned usage);
+
     GLVertexArray createVertexArray(const unsigned *elements, int numOfElements, unsigned usage);
 
+    GLVertexArray createVertexArray(const unsigned short *elements, int numOfElements, unsigned usage);
+
+    GLBufferTexture createBufferTexture(unsigned internalFormat, unsigned usage);
+
+    GLTexture createTexture(unsigned internalFormat, int width, int height);
+
+    GLRenderbuffer createRenderbuffer(unsigned internalFormat, int width, int height, int samples = 0);
+
+    GLFramebuffer createFramebuffer();
+
+    // draw framebuffer and viewport bound by whoever drives the frame, queried from GL since
+    // surfaces and Qt framebuffer objects bind them behind the driver's back
+    unsigned getBoundFramebuffer();
+
+    std::array<int, 4> getBoundViewport();
+
+    // binds for drawing and reading, 0 is the default framebuffer. Not cached for the same reason
+    void bindFramebuffer(unsigned framebuffer);
+
     void setColorMask(bool red, bool blue, bool green, bool alpha);
 
     void enableCullFace(bool enableOrDisable);
@@ -241,6 +545,9 @@ public:
 
     void setStencilOp(unsigned stencilFail, unsigned depthFail, unsigned depthStencilPass);
 
+    // face is GL_FRONT, GL_BACK or GL_FRONT_AND_BACK
+    void setStencilOpSeparate(unsigned face, unsigned stencilFail, unsigned depthFail, unsigned depthStencilPass);
+
     void enableBlend(bool enableOrDisable);
 
     void setBlendFunc(unsigned sfactor, unsigned dfactor);
@@ -265,10 +572,107 @@ public:
 
     void drawElementsInstanced(unsigned mode, unsigned elementCount, unsigned elementType, unsigned offset, int instanceCount);
 
+    // reads drawCount commands from the bound GL_DRAW_INDIRECT_BUFFER. Loops over
+    // glDrawElementsIndirect when the context does not provide GL 4.3
+    void multiDrawElementsIndirect(unsigned mode, unsigned elementType, unsigned offset, int drawCount, int stride);
+
+    inline bool hasMultiDrawIndirect() const { return _GL43 != nullptr; }
+
+    void useProgram(unsigned program);
+
+    void bindVertexArray(unsigned vao);
+
+    void bindBuffer(unsigned target, unsigned buffer);
+
+    void bindBufferBase(unsigned target, unsigned index, unsigned buffer);
+
+    void deleteProgram(unsigned program);
+
+    void deleteVertexArray(unsigned vao);
+
+    void deleteBuffer(unsigned buffer);
+
+    void invalidateState();
+
+    void recordUniformUpload(bool filtered);
+
+    // GL_TIME_ELAPSED queries come from two pools used in alternate frames, so a result is
+    // read two frames after it was issued. Returns the nanoseconds measured by the queries of
+    // the pool that becomes current, in the order they were issued. Results the GPU has not
+    // delivered yet are dropped as TIMER_QUERY_UNAVAILABLE instead of stalling the frame
+    std::vector<std::uint64_t> swapTimerQueryPools();
+
+    // timer queries cannot nest
+    void beginTimerQuery();
+
+    void endTimerQuery();
+
+    inline const GLDriverStatistics &getStatistics() const { return _statistics; }
+
+    inline void resetStatistics() { _statistics = GLDriverStatistics{}; }
+
+    static const std::uint64_t TIMER_QUERY_UNAVAILABLE;
+
 private:
+    // shadow copy of the pipeline state. An empty optional means the state is unknown
+    struct GLState {
+        std::optional<std::array<bool, 4>> colorMask;
+        std::optional<bool> cullFaceEnabled;
+        std::optional<unsigned> cullFace;
+        std::optional<unsigned> frontFace;
+        std::optional<bool> stencilTestEnabled;
+        std::optional<std::tuple<unsigned, int, unsigned>> stencilFunc;
+        std::optional<std::tuple<unsigned, unsigned, unsigned>> frontStencilOp;
+        std::optional<std::tuple<unsigned, unsigned, unsigned>> backStencilOp;
+        std::optional<bool> blendEnabled;
+        std::optional<std::pair<unsigned, unsigned>> blendFunc;
+        std::optional<unsigned> blendEquation;
+        std::optional<bool> depthTestEnabled;
+        std::optional<unsigned> depthFunc;
+        std::optional<std::pair<double, double>> depthRange;
+        std::optional<bool> depthMask;
+        std::optional<glm::vec4> clearColor;
+        std::optional<std::array<int, 4>> viewport;
+        std::optional<unsigned> program;
+        std::optional<unsigned> vertexArray;
+        std::unordered_map<unsigned, unsigned> buffers;
+        std::map<std::pair<unsigned, unsigned>, unsigned> indexedBuffers;
+    };
+
+    template<typename T>
+    inline bool updateState(std::optional<T> &state, const T &value) {
+        if (state == value) {
+            ++_statistics.filteredStateCalls;
+            return false;
+        }
+
+        state = value;
+        ++_statistics.issuedStateCalls;
+        return true;
+    }
+
+    void enableCapability(unsigned capability, std::optional<bool> &state, bool enableOrDisable);
+
+    // queries are created on demand and reused, they live as long as the context
+    struct TimerQueryPool {
+        std::vector<unsigned> queries;
+        std::size_t numOfIssued = 0;
+    };
+
+    GLState _state;
+    GLDriverStatistics _statistics;
+    std::array<TimerQueryPool, 2> _timerQueryPools;
+    std::size_t _timerQueryPool;
+    bool _isTimerQueryActive;
     QOpenGLFunctions_4_2_Core _GL;
+    QOpenGLFunctions_4_3_Core *_GL43;
     QOpenGLContext _context;
     std::unique_ptr<QOpenGLPaintDevice> _device;
+
+    // vendor, renderer and version, binaries of one driver are not loadable by another
+    ProgramCache _programCache;
+    std::string _driverIdentity;
+    bool _hasProgramBinaries;
 };
 
 
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cmath>
+#include <QElapsedTimer>
+#include <glm/gtc/matrix_transform.hpp>
+#include "HeadlessRenderer.h"
+#include "Effects.h"
+#include "Drawables.h"
+#include "BasicGeometry.h"
+#include "MeshLoader.h"
+
+
+/***************************************************
+ * HeadlessRenderer definitions
+ ***************************************************/
+const float HeadlessRenderer::CAM_FOV = 45.0f;
+const float HeadlessRenderer::CAM_NEAR = 0.1f;
+const float HeadlessRenderer::CAM_FAR = 10000.0f;
+
+HeadlessRenderer::HeadlessRenderer(int width, int height, int samples)
+    : _width{width}, _height{height}, _samples{samples}, _isDeferredShading{false}, _isMeshOptimizing{true}
+{
+    assert(width > 0 && height > 0);
+
+    QSurfaceFormat format;
+    format.setMajorVersion(4);
+    format.setMinorVersion(2);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    _surface.setFormat(format);
+    _surface.create();
+}
+
+
+HeadlessRenderer::~HeadlessRenderer() {
+    // GL objects of the scene and framebuffer are deleted with the context current
+    if (_framebuffer)
+        _context.getDriver().makeCurrent(&_surface);
+
+    _framebuffer.reset();
+}
+
+
+bool HeadlessRenderer::initialize() {
+    if (!_surface.isValid())
+        return false;
+
+    auto &driver = _context.getDriver();
+    if (!driver.initialize(&_surface))
+        return false;
+
+    QOpenGLFramebufferObjectFormat framebufferFormat;
+    framebufferFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    framebufferFormat.setSamples(_samples);
+    _framebuffer = std::make_unique<QOpenGLFramebufferObject>(_width, _height, framebufferFormat);
+    if (!_framebuffer->isValid())
+        return false;
+
+    // initialize effects
+    _context.createEffect<ColorEffect>(ColorEffect::EFFECT_NAME);
+    _context.createEffect<ForwardPhongEffect>(ForwardPhongEffect::EFFECT_NAME);
+    if (_isDeferredShading)
+        _context.createEffect<DeferredPhongEffect>(DeferredPhongEffect::EFFECT_NAME);
+
+    _defaultEffectProperty = createMaterialEffectProperty(&_context, {"default", glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(1.0f), 32.0f}, getPhongEffectName());
+
+    // initialize scene, lit like the viewer
+    auto &root = _context.getRoot();
+    auto pointLight = _context.createDrawable<PointLight>(glm::vec3(2.0f), 1000.0f);
+    auto &&lightNode = root.emplaceChild(std::move(pointLight));
+    lightNode.position() = glm::vec3{250.0f, 250.0f, 250.0f};
+
+    auto &camera = _context.getCamera();
+    camera.setProjMatrix(glm::perspective(glm::radians(CAM_FOV), static_cast<float>(_width) / _height, CAM_NEAR, CAM_FAR));
+    return true;
+}
+
+
+bool HeadlessRenderer::loadMeshFile(const std::string &file) {
+    MeshData meshData;
+    if (!MeshLoader::load(file, meshData, &_threadPool, nullptr, _isMeshOptimizing))
+        return false;
+
+    _context.getDriver().makeCurrent(&_surface);
+    std::vector<std::shared_ptr<EffectProperty>> effectProperties;
+    for (const auto &material : meshData.materials) {
+        effectProperties.push_back(createMaterialEffectProperty(&_context, material, getPhongEffectName()));
+    }
+
+    for (const auto &shape : meshData.shapes) {
+        if (_levelOfDetailTriangles.size() < shape.levelsOfDetail.size() + 1)
+            _levelOfDetailTriangles.resize(shape.levelsOfDetail.size() + 1, 0);
+    }
+
+    for (const auto &shape : meshData.shapes) {
+        for (const auto &range : shape.materialRanges) {
+            _sceneBounds.expand(range.boundingBox);
+        }
+
+        // shapes with fewer levels are drawn at their coarsest one
+        for (std::size_t level = 0; level < _levelOfDetailTriangles.size(); ++level) {
+            std::size_t shapeLevel = std::min(level, shape.levelsOfDetail.size());
+            const auto &elements = shapeLevel == 0 ? shape.elements : shape.levelsOfDetail[shapeLevel - 1].elements;
+            _levelOfDetailTriangles[level] += elements.size() / 3;
+        }
+
+        for (auto &drawable : createShapeGeometries(&_context, shape, effectProperties, _defaultEffectProperty)) {
+            _context.getRoot().emplaceChild(std::move(drawable));
+        }
+    }
+
+    return true;
+}
+
+
+void HeadlessRenderer::setCamera(glm::vec3 eye, glm::vec3 focus) {
+    // the camera position is an offset from the focus
+    auto &camera = _context.getCamera();
+    camera.setFocus(focus);
+    camera.setPosition(eye - focus);
+    camera.setViewQuat(glm::quat_cast(glm::lookAt(eye, focus, Camera::UP_DIRECTION)));
+}
+
+
+void HeadlessRenderer::fitCamera() {
+    if (_sceneBounds.isEmpty())
+        return;
+
+    // the bounding sphere fits the vertical field of view, which is the narrower one in landscape
+    auto sphere = BoundingSphere::fromBox(_sceneBounds);
+    float distance = sphere.radius / std::sin(glm::radians(CAM_FOV) * 0.5f);
+    setCamera(sphere.center + glm::vec3(0.0f, 0.0f, distance), sphere.center);
+}
+
+
+double HeadlessRenderer::renderFrame() {
+    assert(_framebuffer && "INITIALIZE BEFORE RENDERING");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    auto &driver = _context.getDriver();
+    driver.makeCurrent(&_surface);
+    auto &profiler = _context.getProfiler();
+    profiler.beginFrame();
+    {
+        ProfilerScope scope(profiler, "render");
+        _framebuffer->bind();
+        driver.setViewport(0, 0, _width, _height);
+        driver.enableDepthMask(true);
+        driver.clearColor({0.23f, 0.23f, 0.23f, 1.0f});
+        driver.clearBufferBit(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        _context.getRoot().draw(_context);
+    }
+
+    {
+        ProfilerScope scope(profiler, "finish");
+        driver.GL()->glFinish();
+    }
+
+    profiler.endFrame();
+
+    return static_cast<double>(timer.nsecsElapsed()) * 1e-6;
+}
+
+
+QImage HeadlessRenderer::grabFrame() {
+    assert(_framebuffer && "INITIALIZE BEFORE RENDERING");
+
+    auto &driver = _context.getDriver();
+    driver.makeCurrent(&_surface);
+    QImage image = _framebuffer->toImage();
+
+    // resolving binds framebuffers and programs behind the driver's back
+    driver.invalidateState();
+    return image;
+}
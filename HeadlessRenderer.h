@@ -0,0 +1,90 @@
+#ifndef HEADLESSRENDERER_H
+#define HEADLESSRENDERER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <QImage>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include "DrawContext.h"
+#include "Effects.h"
+#include "ThreadPool.h"
+
+
+/***************************************************
+ * Renders the scene of a draw context into a framebuffer
+ * object on an offscreen surface, so frames can be drawn,
+ * timed and saved without a window. Works with any platform
+ * plugin providing OpenGL 4.2, e.g. Mesa llvmpipe. Needs a
+ * QGuiApplication and is used from the GUI thread only
+ ***************************************************/
+class HeadlessRenderer {
+public:
+    HeadlessRenderer(int width, int height, int samples = 0);
+
+    HeadlessRenderer(const HeadlessRenderer &) = delete;
+
+    HeadlessRenderer &operator=(const HeadlessRenderer &) = delete;
+
+    ~HeadlessRenderer();
+
+    // shades the scene with the DeferredPhongEffect instead of the ForwardPhongEffect, set before initializing
+    inline void setDeferredShading(bool enable) { _isDeferredShading = enable; }
+
+    // reorders loaded meshes for the vertex cache, overdraw and vertex fetch, on by default. Set before loading
+    inline void setMeshOptimization(bool enable) { _isMeshOptimizing = enable; }
+
+    // creates the GL context, framebuffer, effects and a light. Returns false when OpenGL 4.2 is unavailable
+    bool initialize();
+
+    inline DrawContext &getDrawContext() { return _context; }
+
+    // loads a mesh file into the scene and waits for it
+    bool loadMeshFile(const std::string &file);
+
+    // triangles of the loaded meshes at full detail followed by each generated level of detail
+    inline const std::vector<std::size_t> &getLevelOfDetailTriangles() const { return _levelOfDetailTriangles; }
+
+    // the eye and focus are in world space
+    void setCamera(glm::vec3 eye, glm::vec3 focus);
+
+    // looks at the loaded meshes down the negative z axis from far enough to see all of them
+    void fitCamera();
+
+    // renders one frame and waits for the GPU to finish it. Returns the frame time in milliseconds
+    double renderFrame();
+
+    // the last rendered frame, resolved when multisampled
+    QImage grabFrame();
+
+    inline int getWidth() const { return _width; }
+
+    inline int getHeight() const { return _height; }
+
+    static const float CAM_FOV;
+    static const float CAM_NEAR;
+    static const float CAM_FAR;
+
+private:
+    inline const std::string &getPhongEffectName() const {
+        return _isDeferredShading ? DeferredPhongEffect::EFFECT_NAME : ForwardPhongEffect::EFFECT_NAME;
+    }
+
+    int _width;
+    int _height;
+    int _samples;
+    bool _isDeferredShading;
+    bool _isMeshOptimizing;
+    BoundingBox _sceneBounds;
+    std::vector<std::size_t> _levelOfDetailTriangles;
+    std::shared_ptr<EffectProperty> _defaultEffectProperty;
+
+    // the surface outlives the context, the framebuffer is released while the context is alive
+    QOffscreenSurface _surface;
+    DrawContext _context;
+    std::unique_ptr<QOpenGLFramebufferObject> _framebuffer;
+    ThreadPool _threadPool;
+};
+
+#endif // HEADLESSRENDERER_H
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include "LightClusters.h"
+#include "ThreadPool.h"
+
+
+/***************************************************
+ * LightClusterGrid definitions
+ ***************************************************/
+const int LightClusterGrid::TILES_X = 16;
+const int LightClusterGrid::TILES_Y = 9;
+const int LightClusterGrid::SLICES = 24;
+
+LightClusterGrid::LightClusterGrid(ThreadPool *threadPool)
+    : _projMatrix{0.0f},
+    _depthScale{0.0f},
+    _depthBias{0.0f},
+    _bounds(static_cast<std::size_t>(TILES_X * TILES_Y * SLICES)),
+    _clusterLights(static_cast<std::size_t>(TILES_X * TILES_Y * SLICES)),
+    _clusters(static_cast<std::size_t>(TILES_X * TILES_Y * SLICES)),
+    _threadPool{threadPool}
+{}
+
+
+LightClusterGrid::~LightClusterGrid() = default;
+
+
+void LightClusterGrid::build(const glm::mat4 &projMatrix, const std::vector<BoundingSphere> &lights) {
+    if (projMatrix != _projMatrix)
+        updateBounds(projMatrix);
+
+    // every slice only writes the light lists of its own clusters
+    if (_threadPool) {
+        _threadPool->parallelFor(static_cast<std::size_t>(SLICES), [&](std::size_t slice) {
+            binSlice(static_cast<int>(slice), lights);
+        });
+    }
+    else {
+        for (int slice = 0; slice < SLICES; ++slice)
+            binSlice(slice, lights);
+    }
+
+    _lightIndices.clear();
+    for (std::size_t i = 0; i < _clusterLights.size(); ++i) {
+        const auto &clusterLights = _clusterLights[i];
+        _clusters[i] = glm::uvec2(static_cast<unsigned>(_lightIndices.size()), static_cast<unsigned>(clusterLights.size()));
+        _lightIndices.insert(_lightIndices.end(), clusterLights.begin(), clusterLights.end());
+    }
+}
+
+
+void LightClusterGrid::updateBounds(const glm::mat4 &projMatrix) {
+    // near and far planes of a perspective projection
+    _projMatrix = projMatrix;
+    float nearDepth = projMatrix[3][2] / (projMatrix[2][2] - 1.0f);
+    float farDepth = projMatrix[3][2] / (projMatrix[2][2] + 1.0f);
+    assert(nearDepth > 0.0f && std::isfinite(farDepth) && farDepth > nearDepth && "CLUSTERS NEED A PERSPECTIVE PROJECTION WITH A FAR PLANE");
+
+    float logDepthRatio = std::log(farDepth / nearDepth);
+    _depthScale = static_cast<float>(SLICES) / logDepthRatio;
+    _depthBias = -static_cast<float>(SLICES) * std::log(nearDepth) / logDepthRatio;
+
+    _sliceDepths.resize(static_cast<std::size_t>(SLICES + 1));
+    for (int slice = 0; slice <= SLICES; ++slice) {
+        _sliceDepths[static_cast<std::size_t>(slice)] = nearDepth * std::pow(farDepth / nearDepth, static_cast<float>(slice) / SLICES);
+    }
+
+    // tile corners on the near plane, every cluster spans them between its slice depths
+    glm::mat4 invProjMatrix = glm::inverse(projMatrix);
+    std::vector<glm::vec3> nearCorners;
+    for (int y = 0; y <= TILES_Y; ++y) {
+        for (int x = 0; x <= TILES_X; ++x) {
+            glm::vec4 corner = invProjMatrix * glm::vec4(2.0f * x / TILES_X - 1.0f, 2.0f * y / TILES_Y - 1.0f, -1.0f, 1.0f);
+            nearCorners.push_back(glm::vec3(corner) / corner.w);
+        }
+    }
+
+    for (int slice = 0; slice < SLICES; ++slice) {
+        float minScale = _sliceDepths[static_cast<std::size_t>(slice)] / nearDepth;
+        float maxScale = _sliceDepths[static_cast<std::size_t>(slice + 1)] / nearDepth;
+        for (int y = 0; y < TILES_Y; ++y) {
+            for (int x = 0; x < TILES_X; ++x) {
+                BoundingBox bounds;
+                for (int corner = 0; corner < 4; ++corner) {
+                    auto nearCorner = nearCorners[static_cast<std::size_t>((y + corner / 2) * (TILES_X + 1) + x + corner % 2)];
+                    bounds.expand(nearCorner * minScale);
+                    bounds.expand(nearCorner * maxScale);
+                }
+
+                _bounds[clusterIndex(x, y, slice)] = bounds;
+            }
+        }
+    }
+}
+
+
+void LightClusterGrid::binSlice(int slice, const std::vector<BoundingSphere> &lights) {
+    for (int y = 0; y < TILES_Y; ++y) {
+        for (int x = 0; x < TILES_X; ++x) {
+            _clusterLights[clusterIndex(x, y, slice)].clear();
+        }
+    }
+
+    float minDepth = _sliceDepths[static_cast<std::size_t>(slice)];
+    float maxDepth = _sliceDepths[static_cast<std::size_t>(slice + 1)];
+    for (std::size_t i = 0; i < lights.size(); ++i) {
+        const auto &light = lights[i];
+        float depth = -light.center.z;
+        if (depth + light.radius < minDepth || depth - light.radius > maxDepth)
+            continue;
+
+        glm::ivec2 minTile, maxTile;
+        findTileRange(light, minDepth, maxDepth, minTile, maxTile);
+        for (int y = minTile.y; y <= maxTile.y; ++y) {
+            for (int x = minTile.x; x <= maxTile.x; ++x) {
+                // squared distance from the light to the closest point of the cluster
+                auto index = clusterIndex(x, y, slice);
+                const auto &bounds = _bounds[index];
+                glm::vec3 offset = glm::clamp(light.center, bounds.min, bounds.max) - light.center;
+                if (glm::dot(offset, offset) <= light.radius * light.radius)
+                    _clusterLights[index].push_back(static_cast<unsigned>(i));
+            }
+        }
+    }
+}
+
+
+void LightClusterGrid::findTileRange(const BoundingSphere &light, float minDepth, float maxDepth,
+                                     glm::ivec2 &minTile, glm::ivec2 &maxTile) const
+{
+    // the box of the sphere cut to the slice is in front of the near plane, so all corners project
+    glm::vec3 minCorner = light.center - glm::vec3(light.radius);
+    glm::vec3 maxCorner = light.center + glm::vec3(light.radius);
+    minCorner.z = std::max(minCorner.z, -maxDepth);
+    maxCorner.z = std::min(maxCorner.z, -minDepth);
+
+    glm::vec2 minNdc(std::numeric_limits<float>::max());
+    glm::vec2 maxNdc(-std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 position((corner & 1) ? maxCorner.x : minCorner.x,
+                           (corner & 2) ? maxCorner.y : minCorner.y,
+                           (corner & 4) ? maxCorner.z : minCorner.z);
+        glm::vec4 clip = _projMatrix * glm::vec4(position, 1.0f);
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        minNdc = glm::min(minNdc, ndc);
+        maxNdc = glm::max(maxNdc, ndc);
+    }
+
+    // an empty range when the light is off screen
+    glm::vec2 tiles(TILES_X, TILES_Y);
+    minTile = glm::max(glm::ivec2(glm::floor((minNdc * 0.5f + 0.5f) * tiles)), glm::ivec2(0));
+    maxTile = glm::min(glm::ivec2(glm::floor((maxNdc * 0.5f + 0.5f) * tiles)), glm::ivec2(TILES_X - 1, TILES_Y - 1));
+}
@@ -0,0 +1,74 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "BoundingVolume.h"
+
+class ThreadPool;
+
+
+/***************************************************
+ * Bins point lights into clusters of the view frustum,
+ * split into screen tiles and depth slices growing
+ * exponentially from the near plane, so a fragment only
+ * shades the lights reaching its cluster. Lights are
+ * spheres in view space, slices are binned in parallel.
+ * Needs no GL context
+ ***************************************************/
+class LightClusterGrid {
+public:
+    // slices are binned on the calling thread alone without a thread pool
+    explicit LightClusterGrid(ThreadPool *threadPool = nullptr);
+
+    LightClusterGrid(const LightClusterGrid &) = delete;
+
+    LightClusterGrid &operator=(const LightClusterGrid &) = delete;
+
+    ~LightClusterGrid();
+
+    // the projection must be a perspective one, cluster bounds are rebuilt when it changes
+    void build(const glm::mat4 &projMatrix, const std::vector<BoundingSphere> &lights);
+
+    // offset into the light indices and number of lights per cluster, tiles in x vary fastest, then in y, then slices
+    inline const std::vector<glm::uvec2> &getClusters() const { return _clusters; }
+
+    inline const std::vector<unsigned> &getLightIndices() const { return _lightIndices; }
+
+    // the slice of a view space depth d is floor(log(d) * depthScale + depthBias)
+    inline float getDepthScale() const { return _depthScale; }
+
+    inline float getDepthBias() const { return _depthBias; }
+
+    static const int TILES_X;
+    static const int TILES_Y;
+    static const int SLICES;
+
+private:
+    void updateBounds(const glm::mat4 &projMatrix);
+
+    void binSlice(int slice, const std::vector<BoundingSphere> &lights);
+
+    // tiles touched by the projected view space box of a light cut to the depths of a slice
+    void findTileRange(const BoundingSphere &light, float minDepth, float maxDepth,
+                       glm::ivec2 &minTile, glm::ivec2 &maxTile) const;
+
+    inline std::size_t clusterIndex(int x, int y, int slice) const {
+        return static_cast<std::size_t>(x + TILES_X * (y + TILES_Y * slice));
+    }
+
+    glm::mat4 _projMatrix;
+    float _depthScale;
+    float _depthBias;
+    std::vector<float> _sliceDepths;
+
+    // view space bounds and binned lights per cluster
+    std::vector<BoundingBox> _bounds;
+    std::vector<std::vector<unsigned>> _clusterLights;
+
+    std::vector<glm::uvec2> _clusters;
+    std::vector<unsigned> _lightIndices;
+    ThreadPool *_threadPool;
+};
+
+#endif // LIGHTCLUSTERS_H
@@ -1,12 +1,266 @@
 #include "Viewer.h"
+#include "HeadlessRenderer.h"
 
+#include <algorithm>
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+#include <QTextStream>
+
+
+// parses "x,y,z"
+static bool parseVec3(const QString &text, glm::vec3 &value) {
+    auto components = text.split(',');
+    if (components.size() != 3)
+        return false;
+
+    bool isValid = true;
+    for (int i = 0; i < 3 && isValid; ++i)
+        value[i] = components[i].toFloat(&isValid);
+
+    return isValid;
+}
+
+
+// parses "position,normal", e.g. "unorm16,octahedral"
+static bool parseVertexFormat(const QString &text, VertexFormat &format) {
+    auto components = text.split(',');
+    if (components.size() != 2)
+        return false;
+
+    if (components[0] == "float")
+        format.position = VertexFormat::Position::FLOAT;
+    else if (components[0] == "half")
+        format.position = VertexFormat::Position::HALF_FLOAT;
+    else if (components[0] == "unorm16")
+        format.position = VertexFormat::Position::UNORM16;
+    else
+        return false;
+
+    if (components[1] == "float")
+        format.normal = VertexFormat::Normal::FLOAT;
+    else if (components[1] == "octahedral")
+        format.normal = VertexFormat::Normal::OCTAHEDRAL;
+    else
+        return false;
+
+    return true;
+}
+
+
+// renders the frames once per level of detail threshold and prints the triangles drawn against the largest
+// projected error. The error is reported as a fraction of the viewport height like the threshold
+static void runLevelOfDetailSweep(HeadlessRenderer &renderer, const std::vector<float> &thresholds,
+                                  int numOfFrames, QTextStream &out)
+{
+    out << "levels of detail triangles";
+    for (auto numOfTriangles : renderer.getLevelOfDetailTriangles())
+        out << " " << numOfTriangles;
+
+    out << "\n";
+
+    auto &context = renderer.getDrawContext();
+    renderer.renderFrame();
+    for (auto threshold : thresholds) {
+        context.setLevelOfDetailThreshold(threshold);
+        std::vector<double> frameTimes;
+        for (int frame = 0; frame < numOfFrames; ++frame)
+            frameTimes.push_back(renderer.renderFrame());
+
+        std::sort(frameTimes.begin(), frameTimes.end());
+        const auto &statistics = context.getCullingStatistics();
+        out << "threshold " << threshold
+            << " triangles " << statistics.triangles
+            << " error " << statistics.levelOfDetailError
+            << " error pixels " << QString::number(statistics.levelOfDetailError * renderer.getHeight(), 'f', 2)
+            << " median " << QString::number(frameTimes[frameTimes.size() / 2], 'f', 3) << " ms\n";
+    }
+}
+
+
+// loads a mesh file, renders frames offscreen and prints their timings
+static int runHeadless(const QCommandLineParser &parser) {
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    if (parser.positionalArguments().size() != 1) {
+        err << "Headless mode needs exactly one mesh file\n";
+        return 1;
+    }
+
+    auto size = parser.value("size").split('x');
+    int width = size.size() == 2 ? size[0].toInt() : 0;
+    int height = size.size() == 2 ? size[1].toInt() : 0;
+    int numOfFrames = parser.value("frames").toInt();
+    if (width <= 0 || height <= 0 || numOfFrames <= 0) {
+        err << "Invalid size or number of frames\n";
+        return 1;
+    }
+
+    std::vector<float> thresholds;
+    if (parser.isSet("lod-sweep")) {
+        for (const auto &text : parser.value("lod-sweep").split(',')) {
+            bool isValid = false;
+            thresholds.push_back(text.toFloat(&isValid));
+            if (!isValid || thresholds.back() < 0.0f) {
+                err << "Level of detail thresholds are given as non negative numbers separated by commas\n";
+                return 1;
+            }
+        }
+    }
+
+    VertexFormat vertexFormat;
+    if (!parseVertexFormat(parser.value("vertex-format"), vertexFormat)) {
+        err << "Vertex formats are given as position,normal with float, half or unorm16 and float or octahedral\n";
+        return 1;
+    }
+
+    // warm runs load every program from the cache, which shows in the initialize time
+    QElapsedTimer timer;
+    timer.start();
+    HeadlessRenderer renderer(width, height, parser.value("samples").toInt());
+    renderer.setDeferredShading(parser.isSet("deferred"));
+    renderer.setMeshOptimization(!parser.isSet("no-mesh-optimization"));
+    renderer.getDrawContext().setVertexFormat(vertexFormat);
+    renderer.getDrawContext().getDriver().setProgramCacheDirectory(parser.value("program-cache").toStdString());
+    if (!renderer.initialize()) {
+        err << "Failed to create an OpenGL 4.2 core context\n";
+        return 1;
+    }
+
+    renderer.getDrawContext().enableDepthPrepass(parser.isSet("depth-prepass"));
+    renderer.getDrawContext().enableOcclusionCulling(parser.isSet("occlusion-culling"));
+    out << "initialize " << timer.elapsed() << " ms\n";
+
+    timer.restart();
+    auto file = parser.positionalArguments().front();
+    if (!renderer.loadMeshFile(file.toStdString())) {
+        err << "Failed to load " << file << "\n";
+        return 1;
+    }
+
+    out << "load " << timer.elapsed() << " ms\n";
+
+    renderer.fitCamera();
+    glm::vec3 eye, focus;
+    bool hasEye = parser.isSet("eye");
+    bool hasFocus = parser.isSet("focus");
+    if (hasEye || hasFocus) {
+        if ((hasEye && !parseVec3(parser.value("eye"), eye)) || (hasFocus && !parseVec3(parser.value("focus"), focus))) {
+            err << "Camera vectors are given as x,y,z\n";
+            return 1;
+        }
+
+        // the side not given keeps its fitted value
+        const auto &camera = renderer.getDrawContext().getCamera();
+        if (!hasEye)
+            eye = camera.getFocus() + camera.getPosition();
+        if (!hasFocus)
+            focus = camera.getFocus();
+
+        renderer.setCamera(eye, focus);
+    }
+
+    if (!thresholds.empty()) {
+        runLevelOfDetailSweep(renderer, thresholds, numOfFrames, out);
+        return 0;
+    }
+
+    // GPU times of the last two frames are still pending when the trace is written
+    QString trace = parser.value("trace");
+    auto &profiler = renderer.getDrawContext().getProfiler();
+    profiler.setEnabled(!trace.isEmpty());
+
+    QString output = parser.value("output");
+    if (!output.isEmpty())
+        QDir().mkpath(output);
+
+    // the first frame also pays for shader and buffer setup, so it is reported but kept out of the summary
+    std::vector<double> frameTimes;
+    for (int frame = 0; frame < numOfFrames; ++frame) {
+        double frameTime = renderer.renderFrame();
+        const auto &statistics = renderer.getDrawContext().getCullingStatistics();
+        out << "frame " << frame << " " << QString::number(frameTime, 'f', 3) << " ms"
+            << " visible " << statistics.visible
+            << " culled " << statistics.culled
+            << " occluded " << statistics.occluded
+            << " triangles " << statistics.triangles << "\n";
+
+        if (frame > 0 || numOfFrames == 1)
+            frameTimes.push_back(frameTime);
+
+        if (!output.isEmpty()) {
+            auto path = QDir(output).filePath(QString("frame_%1.png").arg(frame, 4, 10, QChar('0')));
+            if (!renderer.grabFrame().save(path)) {
+                err << "Failed to write " << path << "\n";
+                return 1;
+            }
+        }
+    }
+
+    double total = 0.0;
+    for (auto frameTime : frameTimes)
+        total += frameTime;
+
+    if (!trace.isEmpty() && !profiler.exportChromeTrace(trace.toStdString())) {
+        err << "Failed to write " << trace << "\n";
+        return 1;
+    }
+
+    std::sort(frameTimes.begin(), frameTimes.end());
+    out << "frames " << frameTimes.size()
+        << " min " << QString::number(frameTimes.front(), 'f', 3)
+        << " median " << QString::number(frameTimes[frameTimes.size() / 2], 'f', 3)
+        << " mean " << QString::number(total / frameTimes.size(), 'f', 3)
+        << " max " << QString::number(frameTimes.back(), 'f', 3) << " ms\n";
+
+    return 0;
+}
+
 
 int main(int argc, char *argv[])
 {
     QGuiApplication a(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("file", "Mesh file to render in headless mode");
+    parser.addOptions({
+        {"headless", "Render offscreen without a window, e.g. with QT_QPA_PLATFORM=offscreen"},
+        {"size", "Framebuffer size", "WIDTHxHEIGHT", "1280x720"},
+        {"samples", "Multisample count", "samples", "4"},
+        {"frames", "Number of frames to render", "frames", "1"},
+        {"eye", "Camera position, fitted to the scene by default", "x,y,z"},
+        {"focus", "Point the camera looks at, the scene center by default", "x,y,z"},
+        {"output", "Directory the frames are written to as PNG", "directory"},
+        {"deferred", "Shades the scene with deferred point lights"},
+        {"depth-prepass", "Draws the depth of the forward shaded scene before shading it, toggled with P in the viewer"},
+        {"occlusion-culling", "Culls drawables hidden behind the largest occluders on the CPU, toggled with O in the viewer"},
+        {"trace", "Profiles the frames and writes them as Chrome trace JSON", "file"},
+        {"lod-sweep", "Renders the frames once per level of detail threshold, as fractions of the viewport height,"
+                      " and reports the triangles drawn against the largest projected error", "thresholds"},
+        {"no-mesh-optimization", "Keeps the triangle and vertex order of the mesh file, bypassing the mesh cache"},
+        {"vertex-format", "Storage of positions (float, half or unorm16) and normals (float or octahedral)",
+         "position,normal", "float,float"},
+        {"program-cache", "Directory linked shader programs are cached in, empty disables the cache", "directory",
+         QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("programs")},
+    });
+    parser.process(a);
+
+    if (parser.isSet("headless"))
+        return runHeadless(parser);
+
+    VertexFormat vertexFormat;
+    if (!parseVertexFormat(parser.value("vertex-format"), vertexFormat)) {
+        QTextStream(stderr) << "Invalid vertex format " << parser.value("vertex-format") << "\n";
+        return 1;
+    }
+
     Viewer w(4);
+    w.getDrawContext().setVertexFormat(vertexFormat);
+    w.getDrawContext().getDriver().setProgramCacheDirectory(parser.value("program-cache").toStdString());
+    w.getDrawContext().enableOcclusionCulling(parser.isSet("occlusion-culling"));
     w.resize(1000, 1000);
     w.setAnimating(false);
     w.show();
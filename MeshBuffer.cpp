@@ -0,0 +1,197 @@
+#include <algorithm>
+#include "MeshBuffer.h"
+
+
+/***************************************************
+ * MeshBuffer definitions
+ ***************************************************/
+const int MeshBuffer::POSITION_LOCATION = 0;
+const int MeshBuffer::NORMAL_LOCATION = 1;
+const int MeshBuffer::DRAW_ID_LOCATION = 10;
+const unsigned MeshBuffer::INITIAL_VERTICES = 1 << 16;
+const unsigned MeshBuffer::INITIAL_ELEMENTS = 1 << 18;
+
+MeshBuffer::MeshBuffer(GLDriver *driver)
+    : _driver{driver},
+    _numOfVertices{0},
+    _vertexCapacity{0},
+    _numOfElements{0},
+    _elementCapacity{0},
+    _numOfDrawIds{0}
+{}
+
+
+void MeshBuffer::setVertexFormat(const VertexFormat &format) {
+    _format = format;
+    _vao.reset();
+    _vertexBuffer.reset();
+    _drawIdBuffer.reset();
+    _numOfVertices = 0;
+    _vertexCapacity = 0;
+    _numOfElements = 0;
+    _elementCapacity = 0;
+    _numOfDrawIds = 0;
+}
+
+
+MeshBuffer::Allocation MeshBuffer::allocate(const std::vector<unsigned> &elements,
+                                            const std::vector<glm::vec3> &positions,
+                                            const std::vector<glm::vec3> &normals)
+{
+    // every geometry released its share of the buffers, start over from the beginning
+    if (_vao && _vao.use_count() == 1) {
+        _numOfVertices = 0;
+        _numOfElements = 0;
+    }
+
+    auto numOfVertices = static_cast<unsigned>(positions.size());
+    auto numOfElements = static_cast<unsigned>(elements.size());
+    reserve(_numOfVertices + numOfVertices, _numOfElements + numOfElements);
+
+    auto encoded = _format.encode(positions, normals, BoundingBox::fromPoints(positions));
+    int positionSize = _format.isInterleaved ? _format.getVertexSize() : _format.getPositionSize();
+    _vertexBuffer->bind();
+    _vertexBuffer->loadSubData(static_cast<int>(_numOfVertices) * positionSize, encoded.positions.data(), static_cast<int>(encoded.positions.size()));
+    if (!encoded.normals.empty()) {
+        int normalsBegin = static_cast<int>(_vertexCapacity) * positionSize + static_cast<int>(_numOfVertices) * _format.getNormalSize();
+        _vertexBuffer->loadSubData(normalsBegin, encoded.normals.data(), static_cast<int>(encoded.normals.size()));
+    }
+
+    std::vector<unsigned> rebased(elements);
+    for (auto &element : rebased) {
+        element += _numOfVertices;
+    }
+
+    // the element buffer binding belongs to the vao, bind it first
+    auto elementOffset = _numOfElements * static_cast<unsigned>(sizeof(unsigned));
+    _vao->bind();
+    auto &elementBuffer = _vao->getElementBuffer();
+    elementBuffer.bind();
+    elementBuffer.loadSubData(static_cast<int>(elementOffset), rebased.data(), static_cast<int>(rebased.size() * sizeof(unsigned)));
+    _vao->unbind();
+
+    _numOfVertices += numOfVertices;
+    _numOfElements += numOfElements;
+    return {_vao, _vertexBuffer, elementOffset, numOfElements, encoded.decodeMatrix};
+}
+
+
+void MeshBuffer::multiDraw(const std::vector<GLDrawElementsIndirectCommand> &commands) {
+    unsigned numOfDrawIds = 0;
+    for (const auto &command : commands) {
+        numOfDrawIds = std::max(numOfDrawIds, command.baseInstance + command.instanceCount);
+    }
+
+    _vao->bind();
+    reserveDrawIds(numOfDrawIds);
+
+    if (!_indirectBuffer)
+        _indirectBuffer = _driver->createBuffer(GL_DRAW_INDIRECT_BUFFER, GL_STREAM_DRAW);
+
+    _indirectBuffer->bind();
+    _indirectBuffer->loadData(commands.data(), static_cast<int>(commands.size() * sizeof(GLDrawElementsIndirectCommand)));
+    _driver->multiDrawElementsIndirect(GL_TRIANGLES,
+                                       GL_UNSIGNED_INT,
+                                       0,
+                                       static_cast<int>(commands.size()),
+                                       static_cast<int>(sizeof(GLDrawElementsIndirectCommand)));
+}
+
+
+void MeshBuffer::reserve(unsigned numOfVertices, unsigned numOfElements) {
+    if (!_vao) {
+        _vao = std::make_shared<GLVertexArray>(_driver->createVertexArray(static_cast<const unsigned *>(nullptr), 0, GL_STATIC_DRAW));
+        _vertexBuffer = std::make_shared<GLBuffer>(_driver->createBuffer(GL_ARRAY_BUFFER, GL_STATIC_DRAW));
+    }
+
+    // interleaved vertices form one region, otherwise normals follow the position region
+    int positionSize = _format.isInterleaved ? _format.getVertexSize() : _format.getPositionSize();
+    int normalSize = _format.isInterleaved ? 0 : _format.getNormalSize();
+    if (numOfVertices > _vertexCapacity) {
+        unsigned capacity = std::max(INITIAL_VERTICES, _vertexCapacity);
+        while (capacity < numOfVertices)
+            capacity *= 2;
+
+        GLBuffer grown = _driver->createBuffer(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+        grown.bind();
+        grown.loadData(nullptr, static_cast<int>(capacity) * (positionSize + normalSize));
+        if (_numOfVertices > 0) {
+            grown.copySubData(*_vertexBuffer, 0, 0, static_cast<int>(_numOfVertices) * positionSize);
+            if (normalSize > 0) {
+                grown.copySubData(*_vertexBuffer,
+                                  static_cast<int>(_vertexCapacity) * positionSize,
+                                  static_cast<int>(capacity) * positionSize,
+                                  static_cast<int>(_numOfVertices) * normalSize);
+            }
+        }
+
+        // geometries share the buffer object, so swap the storage in place
+        *_vertexBuffer = std::move(grown);
+        _vertexCapacity = capacity;
+
+        auto positionAttribute = _format.getPositionAttribute();
+        auto normalAttribute = _format.getNormalAttribute();
+        int normalsBegin = static_cast<int>(capacity) * positionSize * (normalSize > 0);
+        _vao->bind();
+        _vertexBuffer->bind();
+        _vao->attribPointer(POSITION_LOCATION,
+                            positionAttribute.size,
+                            positionAttribute.dataType,
+                            positionAttribute.normalized,
+                            positionAttribute.stride,
+                            positionAttribute.offset);
+        _vao->enableAttrib(POSITION_LOCATION);
+        _vao->attribPointer(NORMAL_LOCATION,
+                            normalAttribute.size,
+                            normalAttribute.dataType,
+                            normalAttribute.normalized,
+                            normalAttribute.stride,
+                            normalsBegin + normalAttribute.offset);
+        _vao->enableAttrib(NORMAL_LOCATION);
+        _vao->unbind();
+    }
+
+    if (numOfElements > _elementCapacity) {
+        unsigned capacity = std::max(INITIAL_ELEMENTS, _elementCapacity);
+        while (capacity < numOfElements)
+            capacity *= 2;
+
+        GLBuffer grown = _driver->createBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+        _vao->bind();
+        grown.bind();
+        grown.loadData(nullptr, static_cast<int>(capacity * sizeof(unsigned)));
+        if (_numOfElements > 0)
+            grown.copySubData(_vao->getElementBuffer(), 0, 0, static_cast<int>(_numOfElements * sizeof(unsigned)));
+        _vao->unbind();
+
+        _vao->setElementBuffer(std::move(grown));
+        _elementCapacity = capacity;
+    }
+}
+
+
+void MeshBuffer::reserveDrawIds(unsigned numOfDrawIds) {
+    if (numOfDrawIds <= _numOfDrawIds)
+        return;
+
+    // draw ids are stored as floats, exact well beyond any realistic number of draws
+    unsigned capacity = std::max(1024u, _numOfDrawIds);
+    while (capacity < numOfDrawIds)
+        capacity *= 2;
+
+    std::vector<float> drawIds(capacity);
+    for (unsigned i = 0; i < capacity; ++i) {
+        drawIds[i] = static_cast<float>(i);
+    }
+
+    if (!_drawIdBuffer)
+        _drawIdBuffer = _driver->createBuffer(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+
+    // expects the vao to be bound
+    _drawIdBuffer->bind();
+    _drawIdBuffer->loadData(drawIds.data(), static_cast<int>(drawIds.size() * sizeof(float)));
+    _vao->attribPointer(DRAW_ID_LOCATION, 1, GL_FLOAT, false, 0, 0);
+    _vao->enableAttrib(DRAW_ID_LOCATION);
+    _vao->attribDivisor(DRAW_ID_LOCATION, 1);
+    _numOfDrawIds = capacity;
+}
@@ -0,0 +1,75 @@
+#ifndef MESHBUFFER_H
+#define MESHBUFFER_H
+
+#include <memory>
+#include <optional>
+#include <vector>
+#include "GLDriver.h"
+#include "VertexFormat.h"
+
+
+/***************************************************
+ * Packs static meshes with positions and normals into one shared
+ * vertex array so effects can submit them with multi draw indirect.
+ * Elements are rebased on upload so draws never need a base vertex
+ * and stay 32 bit. Vertices are stored in the vertex format, either
+ * interleaved or as two regions of one vertex buffer, and are moved
+ * on the GPU when the buffer grows
+ ***************************************************/
+class MeshBuffer {
+public:
+    struct Allocation {
+        std::shared_ptr<GLVertexArray> vao;
+        std::shared_ptr<GLBuffer> buffer;
+        unsigned elementOffset;
+        unsigned numOfElements;
+        glm::mat4 decodeMatrix;
+    };
+
+    MeshBuffer(GLDriver *driver);
+
+    MeshBuffer(const MeshBuffer &) = delete;
+
+    MeshBuffer &operator=(const MeshBuffer &) = delete;
+
+    // later allocations go to new buffers, geometries already allocated keep theirs
+    void setVertexFormat(const VertexFormat &format);
+
+    inline const VertexFormat &getVertexFormat() const { return _format; }
+
+    Allocation allocate(const std::vector<unsigned> &elements,
+                        const std::vector<glm::vec3> &positions,
+                        const std::vector<glm::vec3> &normals);
+
+    inline bool isPacked(const GLVertexArray *vao) const { return vao && vao == _vao.get(); }
+
+    // issues the commands against the shared vertex array. Every instance reads its
+    // draw id from an instanced attribute at DRAW_ID_LOCATION, offset by baseInstance
+    void multiDraw(const std::vector<GLDrawElementsIndirectCommand> &commands);
+
+    static const int POSITION_LOCATION;
+    static const int NORMAL_LOCATION;
+    static const int DRAW_ID_LOCATION;
+
+private:
+    void reserve(unsigned numOfVertices, unsigned numOfElements);
+
+    void reserveDrawIds(unsigned numOfDrawIds);
+
+    static const unsigned INITIAL_VERTICES;
+    static const unsigned INITIAL_ELEMENTS;
+
+    GLDriver *_driver;
+    VertexFormat _format;
+    std::shared_ptr<GLVertexArray> _vao;
+    std::shared_ptr<GLBuffer> _vertexBuffer;
+    std::optional<GLBuffer> _drawIdBuffer;
+    std::optional<GLBuffer> _indirectBuffer;
+    unsigned _numOfVertices;
+    unsigned _vertexCapacity;
+    unsigned _numOfElements;
+    unsigned _elementCapacity;
+    unsigned _numOfDrawIds;
+};
+
+#endif // MESHBUFFER_H
@@ -0,0 +1,296 @@
+#include <cassert>
+#include <cstring>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include "MeshCache.h"
+
+
+namespace {
+
+// bounds checked cursor over the mapped cache
+class BlobReader {
+public:
+    BlobReader(const unsigned char *data, std::size_t size)
+        : _current{data}, _end{data + size}
+    {}
+
+    bool read(void *dst, std::size_t size) {
+        if (static_cast<std::size_t>(_end - _current) < size)
+            return false;
+
+        std::memcpy(dst, _current, size);
+        _current += size;
+        return true;
+    }
+
+    template<typename T>
+    bool read(T &value) {
+        return read(&value, sizeof(T));
+    }
+
+    // counts read from the file are checked against the bytes left before anything is allocated
+    inline bool canRead(std::size_t count, std::size_t elementSize) const {
+        return count <= static_cast<std::size_t>(_end - _current) / elementSize;
+    }
+
+    template<typename T>
+    bool readArray(std::vector<T> &values, std::uint32_t count) {
+        if (!canRead(count, sizeof(T)))
+            return false;
+
+        values.resize(count);
+        return read(values.data(), count * sizeof(T));
+    }
+
+    bool readString(std::string &value) {
+        std::uint32_t size;
+        if (!read(size) || !canRead(size, 1))
+            return false;
+
+        value.resize(size);
+        return read(value.data(), size);
+    }
+
+private:
+    const unsigned char *_current;
+    const unsigned char *_end;
+};
+
+
+class BlobWriter {
+public:
+    BlobWriter(QSaveFile &file)
+        : _file{file}, _isGood{true}
+    {}
+
+    void write(const void *data, std::size_t size) {
+        if (_isGood && size > 0)
+            _isGood = _file.write(static_cast<const char*>(data), static_cast<qint64>(size)) == static_cast<qint64>(size);
+    }
+
+    template<typename T>
+    void write(const T &value) {
+        write(&value, sizeof(T));
+    }
+
+    template<typename T>
+    void writeArray(const std::vector<T> &values) {
+        write(values.data(), values.size() * sizeof(T));
+    }
+
+    void writeString(const std::string &value) {
+        write(static_cast<std::uint32_t>(value.size()));
+        write(value.data(), value.size());
+    }
+
+    inline bool isGood() const { return _isGood; }
+
+private:
+    QSaveFile &_file;
+    bool _isGood;
+};
+
+
+// smallest number of bytes a record takes in the file
+const std::size_t MIN_MATERIAL_SIZE = sizeof(std::uint32_t) + 3 * sizeof(glm::vec3) + sizeof(float);
+const std::size_t MIN_SHAPE_SIZE = 6 * sizeof(std::uint32_t);
+const std::size_t RANGE_SIZE = 3 * sizeof(std::uint32_t) + 2 * sizeof(glm::vec3);
+const std::size_t MIN_LEVEL_SIZE = sizeof(float) + sizeof(std::uint32_t);
+
+
+// a range without material has a negative id, any other must name a material of the file
+bool readRanges(BlobReader &reader, std::uint32_t count, std::size_t numOfMaterials, std::vector<MeshMaterialRange> &ranges) {
+    if (!reader.canRead(count, RANGE_SIZE))
+        return false;
+
+    ranges.resize(count);
+    bool isValid = true;
+    for (auto &range : ranges) {
+        isValid = isValid &&
+                  reader.read(range.materialId) &&
+                  reader.read(range.elementOffset) &&
+                  reader.read(range.numOfElements) &&
+                  reader.read(range.boundingBox.min) &&
+                  reader.read(range.boundingBox.max) &&
+                  (range.materialId < 0 || static_cast<std::size_t>(range.materialId) < numOfMaterials);
+    }
+
+    return isValid;
+}
+
+
+void writeRanges(BlobWriter &writer, const std::vector<MeshMaterialRange> &ranges) {
+    for (const auto &range : ranges) {
+        writer.write(range.materialId);
+        writer.write(range.elementOffset);
+        writer.write(range.numOfElements);
+        writer.write(range.boundingBox.min);
+        writer.write(range.boundingBox.max);
+    }
+}
+
+}
+
+
+/***************************************************
+ * MeshCache definitions
+ ***************************************************/
+const char MeshCache::MAGIC[8] = {'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H'};
+const std::uint32_t MeshCache::VERSION = 4;
+
+
+std::string MeshCache::getCachePath(const std::string &file) {
+    return file + ".meshcache";
+}
+
+
+bool MeshCache::read(const std::string &file, MeshData &meshData) {
+    QFile cacheFile(QString::fromStdString(getCachePath(file)));
+    if (!cacheFile.open(QIODevice::ReadOnly))
+        return false;
+
+    auto size = cacheFile.size();
+    auto data = cacheFile.map(0, size);
+    if (!data)
+        return false;
+
+    BlobReader reader(data, static_cast<std::size_t>(size));
+    Header header;
+    std::string sourcePath;
+    bool isValid = reader.read(header) && reader.readString(sourcePath) && isUpToDate(file, header, sourcePath);
+
+    MeshData cached;
+    if (isValid && reader.canRead(header.numOfMaterials, MIN_MATERIAL_SIZE)) {
+        cached.materials.resize(header.numOfMaterials);
+        for (auto &material : cached.materials) {
+            isValid = isValid &&
+                      reader.readString(material.name) &&
+                      reader.read(material.ambientColor) &&
+                      reader.read(material.diffuseColor) &&
+                      reader.read(material.specularColor) &&
+                      reader.read(material.shininess);
+        }
+    }
+    else {
+        isValid = false;
+    }
+
+    isValid = isValid && reader.canRead(header.numOfShapes, MIN_SHAPE_SIZE);
+    if (isValid) {
+        cached.shapes.resize(header.numOfShapes);
+        for (auto &shape : cached.shapes) {
+            std::uint32_t numOfVertices, numOfElements, numOfRanges;
+            isValid = isValid &&
+                      reader.readString(shape.name) &&
+                      reader.read(numOfVertices) &&
+                      reader.read(numOfElements) &&
+                      reader.read(numOfRanges) &&
+                      reader.readArray(shape.positions, numOfVertices) &&
+                      reader.readArray(shape.normals, numOfVertices) &&
+                      reader.readArray(shape.elements, numOfElements);
+
+            if (!isValid)
+                break;
+
+            isValid = readRanges(reader, numOfRanges, cached.materials.size(), shape.materialRanges);
+
+            std::uint32_t numOfClusters = 0;
+            isValid = isValid &&
+                      reader.read(numOfClusters) &&
+                      reader.readArray(shape.clusters, numOfClusters);
+
+            // levels of detail share the shape's material ranges
+            std::uint32_t numOfLevels = 0;
+            isValid = isValid && reader.read(numOfLevels) && reader.canRead(numOfLevels, MIN_LEVEL_SIZE);
+            shape.levelsOfDetail.resize(isValid ? numOfLevels : 0);
+            for (auto &levelOfDetail : shape.levelsOfDetail) {
+                std::uint32_t numOfLevelElements;
+                isValid = isValid &&
+                          reader.read(levelOfDetail.error) &&
+                          reader.read(numOfLevelElements) &&
+                          reader.readArray(levelOfDetail.elements, numOfLevelElements);
+
+                isValid = isValid && readRanges(reader, numOfRanges, cached.materials.size(), levelOfDetail.materialRanges);
+            }
+        }
+    }
+
+    cacheFile.unmap(data);
+    if (!isValid)
+        return false;
+
+    meshData = std::move(cached);
+    return true;
+}
+
+
+bool MeshCache::write(const std::string &file, const MeshData &meshData) {
+    QFileInfo sourceInfo(QString::fromStdString(file));
+    std::string sourcePath = sourceInfo.absoluteFilePath().toStdString();
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.numOfMaterials = static_cast<std::uint32_t>(meshData.materials.size());
+    header.numOfShapes = static_cast<std::uint32_t>(meshData.shapes.size());
+    header.sourceSize = static_cast<std::uint64_t>(sourceInfo.size());
+    header.sourceModified = sourceInfo.lastModified().toMSecsSinceEpoch();
+
+    // written to a temporary file and renamed on commit so readers never see a partial cache
+    QSaveFile cacheFile(QString::fromStdString(getCachePath(file)));
+    if (!cacheFile.open(QIODevice::WriteOnly))
+        return false;
+
+    BlobWriter writer(cacheFile);
+    writer.write(header);
+    writer.writeString(sourcePath);
+
+    for (const auto &material : meshData.materials) {
+        writer.writeString(material.name);
+        writer.write(material.ambientColor);
+        writer.write(material.diffuseColor);
+        writer.write(material.specularColor);
+        writer.write(material.shininess);
+    }
+
+    for (const auto &shape : meshData.shapes) {
+        writer.writeString(shape.name);
+        writer.write(static_cast<std::uint32_t>(shape.positions.size()));
+        writer.write(static_cast<std::uint32_t>(shape.elements.size()));
+        writer.write(static_cast<std::uint32_t>(shape.materialRanges.size()));
+        writer.writeArray(shape.positions);
+        writer.writeArray(shape.normals);
+        writer.writeArray(shape.elements);
+
+        writeRanges(writer, shape.materialRanges);
+
+        writer.write(static_cast<std::uint32_t>(shape.clusters.size()));
+        writer.writeArray(shape.clusters);
+
+        writer.write(static_cast<std::uint32_t>(shape.levelsOfDetail.size()));
+        for (const auto &levelOfDetail : shape.levelsOfDetail) {
+            assert(levelOfDetail.materialRanges.size() == shape.materialRanges.size());
+            writer.write(levelOfDetail.error);
+            writer.write(static_cast<std::uint32_t>(levelOfDetail.elements.size()));
+            writer.writeArray(levelOfDetail.elements);
+            writeRanges(writer, levelOfDetail.materialRanges);
+        }
+    }
+
+    return writer.isGood() && cacheFile.commit();
+}
+
+
+bool MeshCache::isUpToDate(const std::string &file, const Header &header, const std::string &sourcePath) {
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION)
+        return false;
+
+    // stale when the source was moved, resized or touched since the cache was written
+    QFileInfo sourceInfo(QString::fromStdString(file));
+    return sourceInfo.exists() &&
+           sourcePath == sourceInfo.absoluteFilePath().toStdString() &&
+           header.sourceSize == static_cast<std::uint64_t>(sourceInfo.size()) &&
+           header.sourceModified == sourceInfo.lastModified().toMSecsSinceEpoch();
+}
@@ -0,0 +1,41 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstdint>
+#include <string>
+#include "MeshLoader.h"
+
+
+/***************************************************
+ * Binary cache of imported meshes written next to the source file.
+ * The header keys the cache on the source path, size and modification
+ * time. Vertex and element arrays are stored as raw blobs in the
+ * layout they are uploaded with, so loading is a copy out of the
+ * memory mapped file
+ ***************************************************/
+class MeshCache {
+public:
+    static std::string getCachePath(const std::string &file);
+
+    // fails when the cache is missing, stale or malformed
+    static bool read(const std::string &file, MeshData &meshData);
+
+    static bool write(const std::string &file, const MeshData &meshData);
+
+private:
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t numOfMaterials;
+        std::uint32_t numOfShapes;
+        std::uint64_t sourceSize;
+        std::int64_t sourceModified;
+    };
+
+    static bool isUpToDate(const std::string &file, const Header &header, const std::string &sourcePath);
+
+    static const char MAGIC[8];
+    static const std::uint32_t VERSION;
+};
+
+#endif // MESHCACHE_H
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include "MeshCluster.h"
+
+
+/***************************************************
+ * MeshClusterBuilder definitions
+ ***************************************************/
+const unsigned MeshClusterBuilder::MAX_TRIANGLES = 128;
+const float MeshClusterBuilder::MIN_CONE_SPREAD = 0.1f;
+
+
+std::vector<MeshCluster> MeshClusterBuilder::build(std::vector<unsigned> &elements,
+                                                   const std::vector<glm::vec3> &positions,
+                                                   const std::vector<MeshOptimizer::ElementRange> &ranges)
+{
+    std::vector<MeshCluster> clusters;
+    std::vector<MeshOptimizer::ElementRange> wholeRange{{0, static_cast<unsigned>(elements.size())}};
+    std::vector<unsigned> offsets(positions.size() + 1);
+    std::vector<unsigned> adjacency;
+    std::vector<char> isUsed;
+    std::vector<unsigned> queue;
+    std::vector<unsigned> cluster;
+    std::vector<unsigned> output;
+    for (const auto &range : ranges.empty() ? wholeRange : ranges) {
+        assert(range.first + range.second <= elements.size());
+        unsigned *rangeElements = elements.data() + range.first;
+        std::size_t numOfTriangles = range.second / 3;
+
+        // triangles of the range around every vertex
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (std::size_t i = 0; i < numOfTriangles * 3; ++i) {
+            assert(rangeElements[i] < positions.size());
+            ++offsets[rangeElements[i] + 1];
+        }
+
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        adjacency.resize(numOfTriangles * 3);
+        {
+            std::vector<unsigned> cursors(offsets.begin(), offsets.end() - 1);
+            for (std::size_t i = 0; i < numOfTriangles * 3; ++i) {
+                adjacency[cursors[rangeElements[i]]++] = static_cast<unsigned>(i / 3);
+            }
+        }
+
+        // every cluster starts at the first triangle left and grows over shared vertices
+        isUsed.assign(numOfTriangles, 0);
+        output.clear();
+        std::size_t seed = 0;
+        while (true) {
+            while (seed < numOfTriangles && isUsed[seed])
+                ++seed;
+
+            if (seed == numOfTriangles)
+                break;
+
+            cluster.clear();
+            queue.assign(1, static_cast<unsigned>(seed));
+            for (std::size_t head = 0; head < queue.size() && cluster.size() < MAX_TRIANGLES; ++head) {
+                auto triangle = queue[head];
+                if (isUsed[triangle])
+                    continue;
+
+                isUsed[triangle] = 1;
+                cluster.push_back(triangle);
+                for (std::size_t k = 0; k < 3; ++k) {
+                    auto vertex = rangeElements[triangle * 3 + k];
+                    for (auto a = offsets[vertex]; a < offsets[vertex + 1]; ++a) {
+                        if (!isUsed[adjacency[a]])
+                            queue.push_back(adjacency[a]);
+                    }
+                }
+            }
+
+            std::sort(cluster.begin(), cluster.end());
+            auto clusterOffset = static_cast<unsigned>(output.size());
+            for (auto triangle : cluster) {
+                output.insert(output.end(), rangeElements + triangle * 3, rangeElements + triangle * 3 + 3);
+            }
+
+            clusters.push_back(computeBounds(output.data() + clusterOffset,
+                                             static_cast<unsigned>(cluster.size() * 3),
+                                             range.first + clusterOffset,
+                                             positions));
+        }
+
+        std::copy(output.begin(), output.end(), rangeElements);
+    }
+
+    return clusters;
+}
+
+
+MeshCluster MeshClusterBuilder::computeBounds(const unsigned *elements,
+                                              unsigned numOfElements,
+                                              unsigned elementOffset,
+                                              const std::vector<glm::vec3> &positions)
+{
+    MeshCluster cluster;
+    cluster.elementOffset = elementOffset;
+    cluster.numOfElements = numOfElements;
+
+    // sphere around the center of the bounding box
+    BoundingBox box;
+    for (unsigned i = 0; i < numOfElements; ++i) {
+        box.expand(positions[elements[i]]);
+    }
+
+    float radius = 0.0f;
+    for (unsigned i = 0; i < numOfElements; ++i) {
+        radius = std::max(radius, glm::length(positions[elements[i]] - box.center()));
+    }
+
+    cluster.boundingSphere = numOfElements > 0 ? BoundingSphere{box.center(), radius} : BoundingSphere{};
+
+    // the cone axis averages the unit normals, its spread is set by the normal furthest from it
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis{0.0f};
+    for (unsigned i = 0; i + 2 < numOfElements; i += 3) {
+        const auto &p0 = positions[elements[i]];
+        glm::vec3 normal = glm::cross(positions[elements[i + 1]] - p0, positions[elements[i + 2]] - p0);
+        float length = glm::length(normal);
+        if (length == 0.0f)
+            continue;
+
+        normals.push_back(normal / length);
+        axis += normals.back();
+    }
+
+    cluster.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    cluster.coneCutoff = 1.0f;
+    float axisLength = glm::length(axis);
+    if (axisLength == 0.0f)
+        return cluster;
+
+    axis /= axisLength;
+    float minDot = 1.0f;
+    for (const auto &normal : normals) {
+        minDot = std::min(minDot, glm::dot(normal, axis));
+    }
+
+    if (minDot <= MIN_CONE_SPREAD)
+        return cluster;
+
+    cluster.coneAxis = axis;
+    cluster.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    return cluster;
+}
@@ -0,0 +1,56 @@
+#ifndef MESHCLUSTER_H
+#define MESHCLUSTER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "BoundingVolume.h"
+#include "MeshOptimizer.h"
+
+
+// consecutive triangles culled as a unit. The offset is counted in elements
+struct MeshCluster {
+    unsigned elementOffset;
+    unsigned numOfElements;
+    BoundingSphere boundingSphere;
+
+    // average facing of the triangles. A cutoff of 1 or more never culls
+    glm::vec3 coneAxis;
+    float coneCutoff;
+
+    // true when every triangle faces away from the view position, given in the cluster's space
+    inline bool isBackfacing(glm::vec3 viewPosition) const {
+        glm::vec3 toCenter = boundingSphere.center - viewPosition;
+        return glm::dot(toCenter, coneAxis) >= coneCutoff * glm::length(toCenter) + boundingSphere.radius;
+    }
+};
+
+
+/***************************************************
+ * Splits the triangles of a mesh into clusters small enough
+ * to be culled individually. Clusters grow breadth first over
+ * shared vertices so they stay compact, and keep the order
+ * their triangles had before, so a cache optimized order
+ * survives inside every cluster. Each cluster carries a
+ * bounding sphere and a normal cone for backface culling
+ ***************************************************/
+class MeshClusterBuilder {
+public:
+    // reorders the triangles inside every range and returns the clusters in element order.
+    // An empty list is one range over all elements
+    static std::vector<MeshCluster> build(std::vector<unsigned> &elements,
+                                          const std::vector<glm::vec3> &positions,
+                                          const std::vector<MeshOptimizer::ElementRange> &ranges = {});
+
+    static MeshCluster computeBounds(const unsigned *elements,
+                                     unsigned numOfElements,
+                                     unsigned elementOffset,
+                                     const std::vector<glm::vec3> &positions);
+
+    static const unsigned MAX_TRIANGLES;
+
+private:
+    // cones this wide are too loose to ever cull
+    static const float MIN_CONE_SPREAD;
+};
+
+#endif // MESHCLUSTER_H
@@ -0,0 +1,114 @@
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "MeshCache.h"
+#include "MeshLoader.h"
+#include "MeshOptimizer.h"
+#include "ThreadPool.h"
+
+
+// times a cold OBJ import against a load from the binary mesh cache. Needs no GL context
+
+static double elapsedMilliseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static std::size_t countTriangles(const MeshData &meshData) {
+    std::size_t numOfTriangles = 0;
+    for (const auto &shape : meshData.shapes)
+        numOfTriangles += shape.elements.size() / 3;
+
+    return numOfTriangles;
+}
+
+
+// vertex cache statistics over all shapes, weighted by their triangles and referenced vertices
+static VertexCacheStatistics analyzeVertexCache(const MeshData &meshData) {
+    unsigned numOfTransformed = 0;
+    double numOfTriangles = 0.0;
+    double numOfReferenced = 0.0;
+    for (const auto &shape : meshData.shapes) {
+        auto statistics = MeshOptimizer::analyzeVertexCache(shape.elements, shape.positions.size());
+        numOfTransformed += statistics.numOfTransformedVertices;
+        numOfTriangles += static_cast<double>(shape.elements.size() / 3);
+        if (statistics.atvr > 0.0f)
+            numOfReferenced += statistics.numOfTransformedVertices / statistics.atvr;
+    }
+
+    return {numOfTransformed,
+            numOfTriangles > 0.0 ? static_cast<float>(numOfTransformed / numOfTriangles) : 0.0f,
+            numOfReferenced > 0.0 ? static_cast<float>(numOfTransformed / numOfReferenced) : 0.0f};
+}
+
+
+static bool runFile(const std::string &file, ThreadPool &threadPool) {
+    const int numOfReads = 10;
+
+    // the import includes optimization, clustering and level of detail generation
+    MeshData serialData;
+    auto start = std::chrono::steady_clock::now();
+    if (!MeshLoader::loadObj(file, serialData)) {
+        std::fprintf(stderr, "Failed to parse %s\n", file.c_str());
+        return false;
+    }
+
+    double serialParseTime = elapsedMilliseconds(start);
+
+    MeshData unoptimizedData;
+    start = std::chrono::steady_clock::now();
+    MeshLoader::loadObj(file, unoptimizedData, &threadPool, nullptr, false);
+    double unoptimizedParseTime = elapsedMilliseconds(start);
+
+    MeshData meshData;
+    start = std::chrono::steady_clock::now();
+    MeshLoader::loadObj(file, meshData, &threadPool);
+    double parallelParseTime = elapsedMilliseconds(start);
+
+    start = std::chrono::steady_clock::now();
+    if (!MeshCache::write(file, meshData)) {
+        std::fprintf(stderr, "Failed to write %s\n", MeshCache::getCachePath(file).c_str());
+        return false;
+    }
+
+    double writeTime = elapsedMilliseconds(start);
+
+    // the first read may still be served from the page cache the write filled, as in practice
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numOfReads; ++i) {
+        MeshData cachedData;
+        if (!MeshCache::read(file, cachedData)) {
+            std::fprintf(stderr, "Failed to read %s\n", MeshCache::getCachePath(file).c_str());
+            return false;
+        }
+    }
+
+    double readTime = elapsedMilliseconds(start) / numOfReads;
+
+    std::printf("%s shapes %zu triangles %zu parse %.1f ms parallel parse %.1f ms (%zu threads) cache write %.1f ms"
+                " cache read %.2f ms speedup %.1fx\n",
+                file.c_str(), meshData.shapes.size(), countTriangles(meshData), serialParseTime, parallelParseTime,
+                threadPool.size(), writeTime, readTime, parallelParseTime / readTime);
+
+    auto before = analyzeVertexCache(unoptimizedData);
+    auto after = analyzeVertexCache(meshData);
+    std::printf("%s parallel parse without optimization %.1f ms vertex cache ACMR %.3f -> %.3f ATVR %.3f -> %.3f\n",
+                file.c_str(), unoptimizedParseTime, before.acmr, after.acmr, before.atvr, after.atvr);
+
+    return true;
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <obj file>...\n", argv[0]);
+        return 1;
+    }
+
+    ThreadPool threadPool;
+    bool isGood = true;
+    for (int i = 1; i < argc; ++i)
+        isGood = runFile(argv[i], threadPool) && isGood;
+
+    return isGood ? 0 : 1;
+}
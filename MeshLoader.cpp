@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+#include <QDebug>
+#include "MeshLoader.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjParser.h"
+#include "ThreadPool.h"
+#include "Utility.h"
+
+
+/***************************************************
+ * MeshLoader definitions
+ ***************************************************/
+const std::size_t MeshLoader::MAX_LEVELS_OF_DETAIL = 4;
+const std::size_t MeshLoader::MIN_LEVEL_OF_DETAIL_ELEMENTS = 3 * 256;
+const float MeshLoader::MIN_LEVEL_OF_DETAIL_REDUCTION = 0.75f;
+
+
+bool MeshLoader::load(const std::string &file,
+                      MeshData &meshData,
+                      ThreadPool *threadPool,
+                      MeshLoadObserver *observer,
+                      bool isOptimizing)
+{
+    if (isOptimizing && MeshCache::read(file, meshData)) {
+        if (observer) {
+            observer->onMaterials(meshData.materials, meshData.shapes.size());
+            for (std::size_t i = 0; i < meshData.shapes.size(); ++i) {
+                if (observer->isCancelled())
+                    return false;
+
+                observer->onShape(i, meshData.shapes[i]);
+            }
+        }
+
+        return true;
+    }
+
+    if (!loadObj(file, meshData, threadPool, observer, isOptimizing))
+        return false;
+
+    if (isOptimizing && !MeshCache::write(file, meshData)) {
+#ifndef NDEBUG
+        qDebug() << "Failed to write mesh cache" << MeshCache::getCachePath(file).c_str();
+#endif
+    }
+
+    return true;
+}
+
+
+bool MeshLoader::loadObj(const std::string &file,
+                         MeshData &meshData,
+                         ThreadPool *threadPool,
+                         MeshLoadObserver *observer,
+                         bool isOptimizing)
+{
+    tinyobj::attrib_t attrib_t;
+    std::vector<tinyobj::shape_t> shape_ts;
+    std::vector<tinyobj::material_t> material_ts;
+    bool ret = ObjParser::parse(file, attrib_t, shape_ts, material_ts, threadPool, observer);
+
+    if (!ret || (observer && observer->isCancelled()))
+        return false;
+
+    meshData.materials.clear();
+    for (const auto &material_t : material_ts) {
+        meshData.materials.push_back(processMaterial(material_t));
+    }
+
+    if (observer)
+        observer->onMaterials(meshData.materials, shape_ts.size());
+
+    // shapes are independent, each writes only its own slot
+    meshData.shapes.clear();
+    meshData.shapes.resize(shape_ts.size());
+    auto processShapeAt = [&](std::size_t i) {
+        if (observer && observer->isCancelled())
+            return;
+
+        meshData.shapes[i] = processShape(shape_ts[i], attrib_t);
+        optimizeShape(meshData.shapes[i], isOptimizing);
+        generateLevelsOfDetail(meshData.shapes[i]);
+        if (observer)
+            observer->onShape(i, meshData.shapes[i]);
+    };
+
+    if (threadPool) {
+        threadPool->parallelFor(shape_ts.size(), processShapeAt);
+    }
+    else {
+        for (std::size_t i = 0; i < shape_ts.size(); ++i)
+            processShapeAt(i);
+    }
+
+    // a cancelled load leaves holes in the shapes
+    return !(observer && observer->isCancelled());
+}
+
+
+void MeshLoader::optimizeShape(MeshShape &shape, bool isOptimizing) {
+    // triangles stay inside their material range, so the ranges and their bounds remain valid
+    std::vector<MeshOptimizer::ElementRange> ranges;
+    for (const auto &range : shape.materialRanges) {
+        ranges.push_back({range.elementOffset, range.numOfElements});
+    }
+
+    if (isOptimizing)
+        MeshOptimizer::optimize(shape.elements, shape.positions, shape.normals, ranges);
+
+    shape.clusters = MeshClusterBuilder::build(shape.elements, shape.positions, ranges);
+}
+
+
+void MeshLoader::generateLevelsOfDetail(MeshShape &shape) {
+    // every level is simplified from the previous one, so the errors add up
+    shape.levelsOfDetail.clear();
+    shape.levelsOfDetail.reserve(MAX_LEVELS_OF_DETAIL);
+    const auto *elements = &shape.elements;
+    const auto *ranges = &shape.materialRanges;
+    float error = 0.0f;
+    while (shape.levelsOfDetail.size() < MAX_LEVELS_OF_DETAIL && elements->size() >= MIN_LEVEL_OF_DETAIL_ELEMENTS) {
+        MeshLevelOfDetail levelOfDetail;
+        float levelError = 0.0f;
+        for (const auto &range : *ranges) {
+            std::vector<unsigned> rangeElements(elements->begin() + range.elementOffset,
+                                                elements->begin() + range.elementOffset + range.numOfElements);
+
+            float rangeError = 0.0f;
+            auto simplified = MeshSimplifier::simplify(rangeElements,
+                                                       shape.positions,
+                                                       rangeElements.size() / 2,
+                                                       std::numeric_limits<float>::max(),
+                                                       &rangeError);
+
+            MeshOptimizer::optimizeVertexCache(simplified.data(), simplified.size(), shape.positions.size());
+
+            MeshMaterialRange levelRange = range;
+            levelRange.elementOffset = static_cast<unsigned>(levelOfDetail.elements.size());
+            levelRange.numOfElements = static_cast<unsigned>(simplified.size());
+            levelOfDetail.materialRanges.push_back(levelRange);
+            levelOfDetail.elements.insert(levelOfDetail.elements.end(), simplified.begin(), simplified.end());
+            levelError = std::max(levelError, rangeError);
+        }
+
+        // locked borders stall the simplification, a level barely coarser than the last is not worth drawing
+        if (levelOfDetail.elements.size() > MIN_LEVEL_OF_DETAIL_REDUCTION * elements->size())
+            break;
+
+        error += levelError;
+        levelOfDetail.error = error;
+        shape.levelsOfDetail.push_back(std::move(levelOfDetail));
+        elements = &shape.levelsOfDetail.back().elements;
+        ranges = &shape.levelsOfDetail.back().materialRanges;
+    }
+}
+
+
+MeshMaterial MeshLoader::processMaterial(const tinyobj::material_t &material_t) {
+    MeshMaterial material;
+    material.name = material_t.name;
+    material.ambientColor = glm::vec3(material_t.ambient[0], material_t.ambient[1], material_t.ambient[2]);
+    material.diffuseColor = glm::vec3(material_t.diffuse[0], material_t.diffuse[1], material_t.diffuse[2]);
+    material.specularColor = glm::vec3(material_t.specular[0], material_t.specular[1], material_t.specular[2]);
+    material.shininess = equals(material_t.shininess, 0.0f) ? 1.0f : material_t.shininess;
+    return material;
+}
+
+
+MeshShape MeshLoader::processShape(const tinyobj::shape_t &shape_t, const tinyobj::attrib_t &attrib_t) {
+    // find the size of position and normal
+    unsigned numOfElement = 0;
+    std::unordered_map<int, unsigned> posToElem;
+    std::unordered_set<int> uniqueNormal;
+    for (const auto &index_t : shape_t.mesh.indices) {
+        if (index_t.vertex_index >= 0 &&  (posToElem.find(index_t.vertex_index) == posToElem.end()))
+            posToElem.insert({index_t.vertex_index, numOfElement++});
+
+        if (index_t.normal_index >= 0)
+            uniqueNormal.insert(index_t.normal_index);
+    }
+
+    // find the position and normal
+    MeshShape shape;
+    shape.name = shape_t.name;
+    shape.positions.resize(posToElem.size());
+    shape.normals.resize(posToElem.size());
+
+    std::size_t indexOffset = 0;
+    for (auto vertPerFace : shape_t.mesh.num_face_vertices) {
+        for (auto i = indexOffset; i < indexOffset + vertPerFace; ++i) {
+            auto index_t = shape_t.mesh.indices[i];
+
+            auto element = posToElem.at(index_t.vertex_index);
+            shape.elements.push_back(element);
+
+            // position
+            shape.positions[element] = retrievePositionAttrib_t(attrib_t, index_t);
+
+            // normal
+            if (uniqueNormal.size() > 0)
+                shape.normals[element] += retrieveNormalAttrib_t(attrib_t, index_t);
+            else
+                shape.normals[element] += calcSurfaceNormal(attrib_t, shape_t, indexOffset);
+        }
+
+        indexOffset += vertPerFace;
+    }
+
+    std::for_each(shape.normals.begin(), shape.normals.end(), [](glm::vec3 &n){
+        if (!equals(glm::length(n), 0.0f))
+            n = glm::normalize(n);
+    });
+
+    // split the faces into runs sharing a material
+    const auto &materials_ids = shape_t.mesh.material_ids;
+    std::size_t idx = 0;
+    while (idx < materials_ids.size()) {
+        std::size_t right = idx+1;
+        while(right < materials_ids.size() && materials_ids[right] == materials_ids[idx]) {
+            ++right;
+        }
+
+        BoundingBox boundingBox;
+        for (std::size_t element = idx * 3; element < right * 3; ++element) {
+            boundingBox.expand(shape.positions[shape.elements[element]]);
+        }
+
+        shape.materialRanges.push_back({materials_ids[idx],
+                                        static_cast<unsigned>(idx * 3),
+                                        static_cast<unsigned>((right - idx) * 3),
+                                        boundingBox});
+        idx = right;
+    }
+
+    return shape;
+}
+
+
+glm::vec3 MeshLoader::calcSurfaceNormal(const tinyobj::attrib_t &attrib_t, const tinyobj::shape_t &shape_t, std::size_t beginPoint) {
+    auto beginIdx = shape_t.mesh.indices[beginPoint];
+    auto secIdx = shape_t.mesh.indices[beginPoint+1];
+    auto lastIdx = shape_t.mesh.indices[beginPoint+2];
+
+    glm::vec3 p1 = retrievePositionAttrib_t(attrib_t, beginIdx);
+    glm::vec3 p2 = retrievePositionAttrib_t(attrib_t, secIdx);
+    glm::vec3 p3 = retrievePositionAttrib_t(attrib_t, lastIdx);
+    glm::vec3 normal = glm::cross(p2-p1, p3-p1);
+
+    if (!equals(glm::length(normal), 0.0f))
+        return glm::normalize(normal);
+
+    return normal;
+}
+
+
+glm::vec3 MeshLoader::retrievePositionAttrib_t(const tinyobj::attrib_t &attrib_t, tinyobj::index_t idx) {
+    auto px = attrib_t.vertices[3 * idx.vertex_index + 0];
+    auto py = attrib_t.vertices[3 * idx.vertex_index + 1];
+    auto pz = attrib_t.vertices[3 * idx.vertex_index + 2];
+
+    return {px, py, pz};
+}
+
+
+glm::vec3 MeshLoader::retrieveNormalAttrib_t(const tinyobj::attrib_t &attrib_t, tinyobj::index_t idx) {
+    auto nx = attrib_t.normals[3 * idx.normal_index + 0];
+    auto ny = attrib_t.normals[3 * idx.normal_index + 1];
+    auto nz = attrib_t.normals[3 * idx.normal_index + 2];
+
+    return {nx, ny, nz};
+}
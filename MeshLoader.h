@@ -0,0 +1,128 @@
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "tiny_obj_loader.h"
+#include "BoundingVolume.h"
+#include "MeshCluster.h"
+
+class ThreadPool;
+
+
+struct MeshMaterial {
+    std::string name;
+    glm::vec3 ambientColor;
+    glm::vec3 diffuseColor;
+    glm::vec3 specularColor;
+    float shininess;
+};
+
+
+// consecutive triangles of a shape sharing a material. The offset is counted in elements
+struct MeshMaterialRange {
+    int materialId;
+    unsigned elementOffset;
+    unsigned numOfElements;
+    BoundingBox boundingBox;
+};
+
+
+// a simplified copy of a shape's elements indexing the same vertices, with one range per material range
+struct MeshLevelOfDetail {
+    std::vector<unsigned> elements;
+    std::vector<MeshMaterialRange> materialRanges;
+
+    // estimated distance between this level and the full shape in model space. The square roots of the
+    // largest quadric errors of every simplification are summed, an RMS plane distance rather than a bound
+    float error;
+};
+
+
+struct MeshShape {
+    std::string name;
+    std::vector<unsigned> elements;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<MeshMaterialRange> materialRanges;
+
+    // cover the full elements without crossing material ranges
+    std::vector<MeshCluster> clusters;
+
+    // ordered from fine to coarse
+    std::vector<MeshLevelOfDetail> levelsOfDetail;
+};
+
+
+struct MeshData {
+    std::vector<MeshMaterial> materials;
+    std::vector<MeshShape> shapes;
+};
+
+
+// receives the pieces of a load as they complete, called from worker threads
+class MeshLoadObserver {
+public:
+    virtual ~MeshLoadObserver() = default;
+
+    // called once before any shape
+    virtual void onMaterials(const std::vector<MeshMaterial> &materials, std::size_t numOfShapes) = 0;
+
+    // may be called concurrently and in any order
+    virtual void onShape(std::size_t index, const MeshShape &shape) = 0;
+
+    virtual bool isCancelled() const { return false; }
+};
+
+
+/***************************************************
+ * CPU side of importing mesh files. Produces MeshData ready
+ * to be uploaded and does not need a GL context. Shapes are
+ * processed in parallel when a thread pool is given
+ ***************************************************/
+class MeshLoader {
+public:
+    // reads the binary cache when it matches the file, otherwise parses it and refreshes the cache.
+    // The cache only holds optimized meshes, so it is bypassed without optimization.
+    // Returns false on failure or when the observer cancels
+    static bool load(const std::string &file,
+                     MeshData &meshData,
+                     ThreadPool *threadPool = nullptr,
+                     MeshLoadObserver *observer = nullptr,
+                     bool isOptimizing = true);
+
+    // without optimization the elements keep the order of the file
+    static bool loadObj(const std::string &file,
+                        MeshData &meshData,
+                        ThreadPool *threadPool = nullptr,
+                        MeshLoadObserver *observer = nullptr,
+                        bool isOptimizing = true);
+
+private:
+    static MeshMaterial processMaterial(const tinyobj::material_t &material_t);
+
+    static MeshShape processShape(const tinyobj::shape_t &shape_t, const tinyobj::attrib_t &attrib_t);
+
+    // reorders for the vertex cache, overdraw and vertex fetch when optimizing, then splits the ranges into clusters
+    static void optimizeShape(MeshShape &shape, bool isOptimizing);
+
+    // halves the triangles of every material range per level, the vertices must be final
+    static void generateLevelsOfDetail(MeshShape &shape);
+
+    static glm::vec3 calcSurfaceNormal(const tinyobj::attrib_t &attrib_t, const tinyobj::shape_t &shape_t, std::size_t beginPoint);
+
+    static glm::vec3 retrievePositionAttrib_t(const tinyobj::attrib_t &attrib_t, tinyobj::index_t idx);
+
+    static glm::vec3 retrieveNormalAttrib_t(const tinyobj::attrib_t &attrib_t, tinyobj::index_t idx);
+
+    static const std::size_t MAX_LEVELS_OF_DETAIL;
+
+    // shapes with fewer elements are not simplified further
+    static const std::size_t MIN_LEVEL_OF_DETAIL_ELEMENTS;
+
+    // a level must keep at most this fraction of the previous level's elements
+    static const float MIN_LEVEL_OF_DETAIL_REDUCTION;
+};
+
+#endif // MESHLOADER_H
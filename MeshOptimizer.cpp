@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include "MeshOptimizer.h"
+
+
+/***************************************************
+ * MeshOptimizer definitions
+ ***************************************************/
+const unsigned MeshOptimizer::INVALID = static_cast<unsigned>(-1);
+const unsigned MeshOptimizer::CACHE_SIZE = 16;
+const float MeshOptimizer::OVERDRAW_THRESHOLD = 1.05f;
+
+
+void MeshOptimizer::optimize(std::vector<unsigned> &elements,
+                             std::vector<glm::vec3> &positions,
+                             std::vector<glm::vec3> &normals,
+                             const std::vector<ElementRange> &ranges)
+{
+    if (elements.empty())
+        return;
+
+    std::vector<ElementRange> wholeRange{{0, static_cast<unsigned>(elements.size())}};
+    std::vector<std::size_t> clusters;
+    for (const auto &range : ranges.empty() ? wholeRange : ranges) {
+        assert(range.first + range.second <= elements.size());
+        optimizeVertexCache(elements.data() + range.first, range.second, positions.size(), &clusters);
+        optimizeOverdraw(elements.data() + range.first, range.second, positions, clusters);
+    }
+
+    auto remap = optimizeVertexFetch(elements, positions.size());
+    remapVertices(remap, positions);
+    if (!normals.empty())
+        remapVertices(remap, normals);
+}
+
+
+void MeshOptimizer::optimizeVertexCache(unsigned *elements,
+                                        std::size_t numOfElements,
+                                        std::size_t numOfVertices,
+                                        std::vector<std::size_t> *clusters)
+{
+    std::size_t numOfTriangles = numOfElements / 3;
+    if (clusters)
+        clusters->assign(1, 0);
+
+    if (numOfTriangles == 0)
+        return;
+
+    // vertices are renumbered in first use order, so the buffers below scale with the range and not
+    // with the whole shape. Workers optimize shapes in parallel, hence the lookup table is per thread
+    // and only the entries of this range are reset
+    thread_local std::vector<unsigned> localIndices;
+    if (localIndices.size() < numOfVertices)
+        localIndices.resize(numOfVertices, INVALID);
+
+    std::vector<unsigned> globalIndices;
+    std::vector<unsigned> localElements(numOfTriangles * 3);
+    for (std::size_t i = 0; i < numOfTriangles * 3; ++i) {
+        auto vertex = elements[i];
+        assert(vertex < numOfVertices);
+        if (localIndices[vertex] == INVALID) {
+            localIndices[vertex] = static_cast<unsigned>(globalIndices.size());
+            globalIndices.push_back(vertex);
+        }
+
+        localElements[i] = localIndices[vertex];
+    }
+
+    for (auto vertex : globalIndices)
+        localIndices[vertex] = INVALID;
+
+    std::size_t numOfLocalVertices = globalIndices.size();
+
+    // triangles around every vertex
+    std::vector<unsigned> offsets(numOfLocalVertices + 1, 0);
+    for (std::size_t i = 0; i < numOfTriangles * 3; ++i) {
+        ++offsets[localElements[i] + 1];
+    }
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<unsigned> adjacency(numOfTriangles * 3);
+    std::vector<unsigned> liveCounts(numOfLocalVertices);
+    {
+        std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < numOfTriangles * 3; ++i) {
+            adjacency[fill[localElements[i]]++] = static_cast<unsigned>(i / 3);
+        }
+
+        for (std::size_t v = 0; v < numOfLocalVertices; ++v) {
+            liveCounts[v] = offsets[v + 1] - offsets[v];
+        }
+    }
+
+    // a vertex is in the cache while fewer than CACHE_SIZE misses happened since it was loaded
+    std::vector<unsigned> cacheTimes(numOfLocalVertices, 0);
+    unsigned timestamp = CACHE_SIZE + 1;
+    std::vector<char> isEmitted(numOfTriangles, 0);
+    std::vector<unsigned> deadEnds;
+    std::vector<unsigned> candidates;
+    std::vector<unsigned> output;
+    output.reserve(numOfTriangles * 3);
+
+    std::size_t cursor = 0;
+    unsigned fanning = localElements[0];
+    while (fanning != INVALID) {
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (auto a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+            auto triangle = adjacency[a];
+            if (isEmitted[triangle])
+                continue;
+
+            for (std::size_t k = 0; k < 3; ++k) {
+                auto vertex = localElements[triangle * 3 + k];
+                output.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                --liveCounts[vertex];
+                if (timestamp - cacheTimes[vertex] > CACHE_SIZE)
+                    cacheTimes[vertex] = timestamp++;
+            }
+
+            isEmitted[triangle] = 1;
+        }
+
+        // prefer the oldest candidate that stays in the cache while its triangles are emitted
+        unsigned next = INVALID;
+        long bestPriority = -1;
+        for (auto vertex : candidates) {
+            if (liveCounts[vertex] == 0)
+                continue;
+
+            long priority = 0;
+            if (timestamp - cacheTimes[vertex] + 2 * liveCounts[vertex] <= CACHE_SIZE)
+                priority = timestamp - cacheTimes[vertex];
+
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+
+        if (next == INVALID) {
+            // dead end, fall back to recently used vertices and then to any vertex left
+            while (!deadEnds.empty() && next == INVALID) {
+                auto vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveCounts[vertex] > 0)
+                    next = vertex;
+            }
+
+            for (; cursor < numOfLocalVertices && next == INVALID; ++cursor) {
+                if (liveCounts[cursor] > 0)
+                    next = static_cast<unsigned>(cursor);
+            }
+
+            if (clusters && next != INVALID)
+                clusters->push_back(output.size() / 3);
+        }
+
+        fanning = next;
+    }
+
+    assert(output.size() == numOfTriangles * 3);
+    if (clusters)
+        findSoftBoundaries(output.data(), numOfTriangles, numOfLocalVertices, *clusters);
+
+    std::transform(output.begin(), output.end(), elements, [&globalIndices](unsigned vertex) {
+        return globalIndices[vertex];
+    });
+}
+
+
+void MeshOptimizer::optimizeOverdraw(unsigned *elements,
+                                     std::size_t numOfElements,
+                                     const std::vector<glm::vec3> &positions,
+                                     const std::vector<std::size_t> &clusters)
+{
+    std::size_t numOfTriangles = numOfElements / 3;
+    if (clusters.size() < 2)
+        return;
+
+    // area weighted centroid and normal of every cluster
+    struct Cluster {
+        std::size_t begin;
+        std::size_t end;
+        glm::vec3 centroid;
+        glm::vec3 normal;
+        float area;
+        float sortKey;
+    };
+
+    std::vector<Cluster> sortedClusters;
+    glm::vec3 meshCentroid{0.0f};
+    float meshArea = 0.0f;
+    for (std::size_t i = 0; i < clusters.size(); ++i) {
+        Cluster cluster{clusters[i], i + 1 < clusters.size() ? clusters[i + 1] : numOfTriangles,
+                        glm::vec3{0.0f}, glm::vec3{0.0f}, 0.0f, 0.0f};
+        for (auto triangle = cluster.begin; triangle < cluster.end; ++triangle) {
+            const auto &p0 = positions[elements[triangle * 3]];
+            const auto &p1 = positions[elements[triangle * 3 + 1]];
+            const auto &p2 = positions[elements[triangle * 3 + 2]];
+            auto normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            cluster.centroid += (p0 + p1 + p2) * (area / 3.0f);
+            cluster.normal += normal;
+            cluster.area += area;
+        }
+
+        meshCentroid += cluster.centroid;
+        meshArea += cluster.area;
+        if (cluster.area > 0.0f)
+            cluster.centroid /= cluster.area;
+
+        sortedClusters.push_back(cluster);
+    }
+
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // clusters facing away from the center are the most likely to occlude the rest
+    for (auto &cluster : sortedClusters) {
+        float length = glm::length(cluster.normal);
+        if (length > 0.0f)
+            cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, cluster.normal / length);
+    }
+
+    std::stable_sort(sortedClusters.begin(), sortedClusters.end(), [](const Cluster &a, const Cluster &b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<unsigned> output;
+    output.reserve(numOfTriangles * 3);
+    for (const auto &cluster : sortedClusters) {
+        output.insert(output.end(), elements + cluster.begin * 3, elements + cluster.end * 3);
+    }
+
+    std::copy(output.begin(), output.end(), elements);
+}
+
+
+std::vector<unsigned> MeshOptimizer::optimizeVertexFetch(std::vector<unsigned> &elements, std::size_t numOfVertices) {
+    std::vector<unsigned> remap(numOfVertices, INVALID);
+    unsigned numOfUsed = 0;
+    for (auto &element : elements) {
+        assert(element < numOfVertices);
+        if (remap[element] == INVALID)
+            remap[element] = numOfUsed++;
+
+        element = remap[element];
+    }
+
+    return remap;
+}
+
+
+VertexCacheStatistics MeshOptimizer::analyzeVertexCache(const std::vector<unsigned> &elements,
+                                                        std::size_t numOfVertices,
+                                                        unsigned cacheSize)
+{
+    std::vector<unsigned> cacheTimes(numOfVertices, 0);
+    std::vector<char> isReferenced(numOfVertices, 0);
+    unsigned timestamp = cacheSize + 1;
+    unsigned numOfMisses = 0;
+    unsigned numOfReferenced = 0;
+    for (auto element : elements) {
+        if (timestamp - cacheTimes[element] > cacheSize) {
+            cacheTimes[element] = timestamp++;
+            ++numOfMisses;
+        }
+
+        if (!isReferenced[element]) {
+            isReferenced[element] = 1;
+            ++numOfReferenced;
+        }
+    }
+
+    std::size_t numOfTriangles = elements.size() / 3;
+    return {numOfMisses,
+            numOfTriangles > 0 ? static_cast<float>(numOfMisses) / numOfTriangles : 0.0f,
+            numOfReferenced > 0 ? static_cast<float>(numOfMisses) / numOfReferenced : 0.0f};
+}
+
+
+void MeshOptimizer::findSoftBoundaries(const unsigned *elements,
+                                       std::size_t numOfTriangles,
+                                       std::size_t numOfVertices,
+                                       std::vector<std::size_t> &clusters)
+{
+    // split every cluster Tipsify ended on a dead end again where the cache was
+    // just refilled, so reordering clusters costs little extra vertex shading
+    std::vector<std::size_t> hardBoundaries;
+    hardBoundaries.swap(clusters);
+    hardBoundaries.push_back(numOfTriangles);
+
+    std::vector<unsigned> cacheTimes(numOfVertices, 0);
+    unsigned timestamp = CACHE_SIZE + 1;
+    auto countMisses = [&](std::size_t triangle) {
+        unsigned misses = 0;
+        for (std::size_t k = 0; k < 3; ++k) {
+            auto vertex = elements[triangle * 3 + k];
+            if (timestamp - cacheTimes[vertex] > CACHE_SIZE) {
+                cacheTimes[vertex] = timestamp++;
+                ++misses;
+            }
+        }
+
+        return misses;
+    };
+
+    auto flush = [&]() {
+        timestamp += CACHE_SIZE + 1;
+    };
+
+    for (std::size_t i = 0; i + 1 < hardBoundaries.size(); ++i) {
+        auto begin = hardBoundaries[i];
+        auto end = hardBoundaries[i + 1];
+
+        flush();
+        unsigned totalMisses = 0;
+        for (auto triangle = begin; triangle < end; ++triangle) {
+            totalMisses += countMisses(triangle);
+        }
+
+        float clusterAcmr = static_cast<float>(totalMisses) / static_cast<float>(end - begin);
+
+        flush();
+        clusters.push_back(begin);
+        unsigned misses = 0;
+        std::size_t clusterBegin = begin;
+        for (auto triangle = begin; triangle + 1 < end; ++triangle) {
+            misses += countMisses(triangle);
+            float acmr = static_cast<float>(misses) / static_cast<float>(triangle + 1 - clusterBegin);
+            if (acmr <= clusterAcmr * OVERDRAW_THRESHOLD) {
+                clusters.push_back(triangle + 1);
+                clusterBegin = triangle + 1;
+                misses = 0;
+                flush();
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+
+struct VertexCacheStatistics {
+    unsigned numOfTransformedVertices;
+
+    // transformed vertices per triangle, 0.5 is the best a regular grid can do
+    float acmr;
+
+    // transformed vertices per referenced vertex, 1.0 is optimal
+    float atvr;
+};
+
+
+/***************************************************
+ * Reorders indexed triangle lists before upload. Triangles are
+ * sorted for the post-transform vertex cache with Tipsify
+ * (Sander et al. 2007), clusters of them are then ordered
+ * front to back from the mesh center to cut overdraw, and
+ * finally vertices are renumbered in first use order so
+ * attribute fetches stream through memory
+ ***************************************************/
+class MeshOptimizer {
+public:
+    // element offset and count of a run that must stay contiguous, e.g. a material range
+    using ElementRange = std::pair<unsigned, unsigned>;
+
+    // runs every pass. Triangles never move between ranges, an empty list is one range over all elements
+    static void optimize(std::vector<unsigned> &elements,
+                         std::vector<glm::vec3> &positions,
+                         std::vector<glm::vec3> &normals,
+                         const std::vector<ElementRange> &ranges = {});
+
+    // reorders the triangles of the range. When clusters is given it receives the first
+    // triangle of every run that can be reordered without hurting the cache much
+    static void optimizeVertexCache(unsigned *elements,
+                                    std::size_t numOfElements,
+                                    std::size_t numOfVertices,
+                                    std::vector<std::size_t> *clusters = nullptr);
+
+    // sorts the clusters found by optimizeVertexCache so outward facing ones come first
+    static void optimizeOverdraw(unsigned *elements,
+                                 std::size_t numOfElements,
+                                 const std::vector<glm::vec3> &positions,
+                                 const std::vector<std::size_t> &clusters);
+
+    // renumbers vertices in order of first use and returns the old to new mapping.
+    // Vertices no triangle references map to INVALID and are dropped by remapVertices
+    static std::vector<unsigned> optimizeVertexFetch(std::vector<unsigned> &elements, std::size_t numOfVertices);
+
+    template<typename T>
+    static void remapVertices(const std::vector<unsigned> &remap, std::vector<T> &vertices) {
+        std::vector<T> remapped(vertices.size());
+        std::size_t numOfVertices = 0;
+        for (std::size_t i = 0; i < remap.size(); ++i) {
+            if (remap[i] != INVALID) {
+                remapped[remap[i]] = vertices[i];
+                numOfVertices = std::max<std::size_t>(numOfVertices, remap[i] + 1);
+            }
+        }
+
+        remapped.resize(numOfVertices);
+        vertices = std::move(remapped);
+    }
+
+    // simulates a FIFO cache of the given size
+    static VertexCacheStatistics analyzeVertexCache(const std::vector<unsigned> &elements,
+                                                    std::size_t numOfVertices,
+                                                    unsigned cacheSize = CACHE_SIZE);
+
+    static const unsigned INVALID;
+
+    // entries of the post-transform cache the ordering targets
+    static const unsigned CACHE_SIZE;
+
+private:
+    static void findSoftBoundaries(const unsigned *elements,
+                                   std::size_t numOfTriangles,
+                                   std::size_t numOfVertices,
+                                   std::vector<std::size_t> &clusters);
+
+    // a cluster ends when its running ACMR is within this factor of its final ACMR
+    static const float OVERDRAW_THRESHOLD;
+};
+
+#endif // MESHOPTIMIZER_H
@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include "MeshSimplifier.h"
+
+
+/***************************************************
+ * MeshSimplifier definitions
+ ***************************************************/
+const float MeshSimplifier::MAX_NORMAL_TURN = 0.25f;
+
+
+std::vector<unsigned> MeshSimplifier::simplify(const std::vector<unsigned> &elements,
+                                               const std::vector<glm::vec3> &positions,
+                                               std::size_t targetNumOfElements,
+                                               float maxError,
+                                               float *error)
+{
+    assert(elements.size() % 3 == 0);
+    std::vector<unsigned> result(elements);
+    targetNumOfElements -= targetNumOfElements % 3;
+    std::size_t numOfVertices = positions.size();
+    double maxCost = static_cast<double>(maxError) * static_cast<double>(maxError);
+    double resultCost = 0.0;
+
+    // edges are keyed by their sorted endpoints
+    auto edgeKey = [](unsigned a, unsigned b) {
+        return (static_cast<std::uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+    };
+
+    // vertices on open or non manifold edges never move
+    std::vector<std::uint64_t> edges;
+    edges.reserve(result.size());
+    for (std::size_t i = 0; i < result.size(); i += 3) {
+        edges.push_back(edgeKey(result[i], result[i + 1]));
+        edges.push_back(edgeKey(result[i + 1], result[i + 2]));
+        edges.push_back(edgeKey(result[i + 2], result[i]));
+    }
+
+    std::sort(edges.begin(), edges.end());
+    std::vector<char> isLocked(numOfVertices, 0);
+    for (std::size_t i = 0; i < edges.size();) {
+        std::size_t j = i + 1;
+        while (j < edges.size() && edges[j] == edges[i])
+            ++j;
+
+        if (j - i != 2) {
+            isLocked[edges[i] >> 32] = 1;
+            isLocked[edges[i] & 0xffffffffu] = 1;
+        }
+
+        i = j;
+    }
+
+    // planes of the original triangles, weighted by area so slivers count little
+    std::vector<Quadric> quadrics(numOfVertices);
+    for (std::size_t i = 0; i < result.size(); i += 3) {
+        const auto &p0 = positions[result[i]];
+        glm::dvec3 normal = glm::cross(glm::dvec3(positions[result[i + 1]] - p0), glm::dvec3(positions[result[i + 2]] - p0));
+        double length = glm::length(normal);
+        if (length == 0.0)
+            continue;
+
+        normal /= length;
+        double distance = -glm::dot(normal, glm::dvec3(p0));
+        for (int k = 0; k < 3; ++k) {
+            quadrics[result[i + k]].addPlane(normal, distance, 0.5 * length);
+        }
+    }
+
+    // every pass collapses the cheapest edges whose neighbourhoods do not overlap
+    std::vector<unsigned> remap(numOfVertices);
+    std::vector<char> isTouched(numOfVertices);
+    std::vector<unsigned> adjacencyOffsets(numOfVertices + 1);
+    std::vector<unsigned> adjacency;
+    std::vector<Collapse> collapses;
+    while (result.size() > targetNumOfElements) {
+        edges.clear();
+        for (std::size_t i = 0; i < result.size(); i += 3) {
+            edges.push_back(edgeKey(result[i], result[i + 1]));
+            edges.push_back(edgeKey(result[i + 1], result[i + 2]));
+            edges.push_back(edgeKey(result[i + 2], result[i]));
+        }
+
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        collapses.clear();
+        for (auto edge : edges) {
+            auto a = static_cast<unsigned>(edge >> 32);
+            auto b = static_cast<unsigned>(edge & 0xffffffffu);
+            if (isLocked[a] && isLocked[b])
+                continue;
+
+            Quadric quadric = quadrics[a];
+            quadric += quadrics[b];
+            double costToB = isLocked[a] ? std::numeric_limits<double>::max() : quadric.evaluate(positions[b]);
+            double costToA = isLocked[b] ? std::numeric_limits<double>::max() : quadric.evaluate(positions[a]);
+            Collapse collapse = costToB <= costToA ? Collapse{a, b, costToB} : Collapse{b, a, costToA};
+            if (collapse.cost <= maxCost)
+                collapses.push_back(collapse);
+        }
+
+        if (collapses.empty())
+            break;
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &lhs, const Collapse &rhs) {
+            return lhs.cost < rhs.cost;
+        });
+
+        // triangles around every vertex
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (auto element : result) {
+            ++adjacencyOffsets[element + 1];
+        }
+
+        std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+        adjacency.resize(result.size());
+        std::vector<unsigned> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (std::size_t i = 0; i < result.size(); ++i) {
+            adjacency[cursors[result[i]]++] = static_cast<unsigned>(i / 3);
+        }
+
+        std::iota(remap.begin(), remap.end(), 0u);
+        std::fill(isTouched.begin(), isTouched.end(), 0);
+        std::size_t numOfRemoved = 0;
+        std::size_t goal = (result.size() - targetNumOfElements) / 3;
+        for (const auto &collapse : collapses) {
+            if (isTouched[collapse.from] || isTouched[collapse.to])
+                continue;
+
+            if (flipsTriangles(result, positions, adjacencyOffsets, adjacency, collapse.from, collapse.to))
+                continue;
+
+            // neighbours keep their triangles unchanged for the rest of the pass
+            for (auto t = adjacencyOffsets[collapse.from]; t < adjacencyOffsets[collapse.from + 1]; ++t) {
+                const unsigned *triangle = result.data() + 3 * adjacency[t];
+                numOfRemoved += triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to;
+                for (int k = 0; k < 3; ++k) {
+                    isTouched[triangle[k]] = 1;
+                }
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            resultCost = std::max(resultCost, collapse.cost);
+            if (numOfRemoved >= goal)
+                break;
+        }
+
+        if (numOfRemoved == 0)
+            break;
+
+        // drop the triangles that became degenerate
+        std::size_t numOfElements = 0;
+        for (std::size_t i = 0; i < result.size(); i += 3) {
+            unsigned a = remap[result[i]];
+            unsigned b = remap[result[i + 1]];
+            unsigned c = remap[result[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+
+            result[numOfElements++] = a;
+            result[numOfElements++] = b;
+            result[numOfElements++] = c;
+        }
+
+        result.resize(numOfElements);
+    }
+
+    if (error)
+        *error = static_cast<float>(std::sqrt(resultCost));
+
+    return result;
+}
+
+
+bool MeshSimplifier::flipsTriangles(const std::vector<unsigned> &elements,
+                                    const std::vector<glm::vec3> &positions,
+                                    const std::vector<unsigned> &adjacencyOffsets,
+                                    const std::vector<unsigned> &adjacency,
+                                    unsigned from,
+                                    unsigned to)
+{
+    for (auto t = adjacencyOffsets[from]; t < adjacencyOffsets[from + 1]; ++t) {
+        const unsigned *triangle = elements.data() + 3 * adjacency[t];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+            continue;
+
+        // rejects flips and turns steep enough to flip over a few collapses
+        glm::vec3 corners[3];
+        glm::vec3 moved[3];
+        for (int k = 0; k < 3; ++k) {
+            corners[k] = positions[triangle[k]];
+            moved[k] = triangle[k] == from ? positions[to] : corners[k];
+        }
+
+        glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+        glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+        if (glm::dot(before, after) <= MAX_NORMAL_TURN * glm::length(before) * glm::length(after))
+            return true;
+    }
+
+    return false;
+}
+
+
+/***************************************************
+ * MeshSimplifier::Quadric definitions
+ ***************************************************/
+void MeshSimplifier::Quadric::addPlane(glm::dvec3 normal, double distance, double planeWeight) {
+    double a = normal.x, b = normal.y, c = normal.z, d = distance;
+    double values[10] = {a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d};
+    for (int i = 0; i < 10; ++i) {
+        q[i] += planeWeight * values[i];
+    }
+
+    weight += planeWeight;
+}
+
+
+MeshSimplifier::Quadric &MeshSimplifier::Quadric::operator+=(const Quadric &other) {
+    for (int i = 0; i < 10; ++i) {
+        q[i] += other.q[i];
+    }
+
+    weight += other.weight;
+    return *this;
+}
+
+
+double MeshSimplifier::Quadric::evaluate(glm::vec3 point) const {
+    if (weight == 0.0)
+        return 0.0;
+
+    double x = point.x, y = point.y, z = point.z;
+    double sum = q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x +
+                 q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y +
+                 q[7] * z * z + 2.0 * q[8] * z +
+                 q[9];
+
+    return std::max(sum / weight, 0.0);
+}
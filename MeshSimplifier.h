@@ -0,0 +1,60 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <array>
+#include <vector>
+#include <glm/glm.hpp>
+
+
+/***************************************************
+ * Reduces indexed triangle lists by collapsing edges in order
+ * of their quadric error (Garland and Heckbert 1997). Vertices
+ * collapse onto one of their neighbours instead of a new
+ * position, so simplified lists index the original vertex
+ * arrays and levels of detail can share one vertex buffer.
+ * Border vertices never move, which keeps neighbouring
+ * material ranges closed
+ ***************************************************/
+class MeshSimplifier {
+public:
+    // collapses edges until at most targetNumOfElements remain or the next collapse would
+    // move the surface further than maxError. error receives the largest collapse error
+    // as a distance in the units of the positions
+    static std::vector<unsigned> simplify(const std::vector<unsigned> &elements,
+                                          const std::vector<glm::vec3> &positions,
+                                          std::size_t targetNumOfElements,
+                                          float maxError,
+                                          float *error = nullptr);
+
+private:
+    // symmetric 4x4 matrix of summed squared plane distances, weighted by triangle area
+    struct Quadric {
+        std::array<double, 10> q{};
+        double weight = 0.0;
+
+        void addPlane(glm::dvec3 normal, double distance, double planeWeight);
+
+        Quadric &operator+=(const Quadric &other);
+
+        // weighted mean squared distance of the point to the planes
+        double evaluate(glm::vec3 point) const;
+    };
+
+    struct Collapse {
+        unsigned from;
+        unsigned to;
+        double cost;
+    };
+
+    static bool flipsTriangles(const std::vector<unsigned> &elements,
+                               const std::vector<glm::vec3> &positions,
+                               const std::vector<unsigned> &adjacencyOffsets,
+                               const std::vector<unsigned> &adjacency,
+                               unsigned from,
+                               unsigned to);
+
+    // cosine of the largest angle a collapse may turn a triangle normal by
+    static const float MAX_NORMAL_TURN;
+};
+
+#endif // MESHSIMPLIFIER_H
@@ -0,0 +1,589 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <QDebug>
+#include <QFile>
+#include "ObjParser.h"
+#include "MeshLoader.h"
+#include "ThreadPool.h"
+
+
+namespace {
+
+const double POWERS_OF_TEN[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+
+inline const char *skipSpaces(const char *p, const char *end) {
+    while (p < end && isSpace(*p))
+        ++p;
+
+    return p;
+}
+
+
+// keyword followed by whitespace or the end of the line
+inline bool startsWith(const char *p, const char *end, const char *keyword, std::size_t size) {
+    return static_cast<std::size_t>(end - p) >= size &&
+           std::memcmp(p, keyword, size) == 0 &&
+           (p + size == end || isSpace(p[size]));
+}
+
+
+// strtof on a copy of the token, for inf, nan and anything else unusual
+const char *parseFloatSlow(const char *p, const char *end, float &value) {
+    char buffer[64];
+    std::size_t size = 0;
+    while (p + size < end && !isSpace(p[size]) && size < sizeof(buffer) - 1) {
+        buffer[size] = p[size];
+        ++size;
+    }
+
+    buffer[size] = '\0';
+    char *parsedEnd;
+    value = std::strtof(buffer, &parsedEnd);
+    if (parsedEnd == buffer)
+        return nullptr;
+
+    return p + (parsedEnd - buffer);
+}
+
+
+// decimal mantissa and exponent gathered in integers, one multiplication at the end.
+// Exact for up to 15 significant digits and exponents within 10^22
+const char *parseFloat(const char *p, const char *end, float &value) {
+    const char *start = p;
+    bool isNegative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        isNegative = *p == '-';
+        ++p;
+    }
+
+    std::uint64_t mantissa = 0;
+    int exponent = 0;
+    int numOfDigits = 0;
+    bool hasDigits = false;
+    for (; p < end && isDigit(*p); ++p) {
+        hasDigits = true;
+        if (numOfDigits < 19) {
+            mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+            numOfDigits += mantissa != 0;
+        }
+        else
+            ++exponent;
+    }
+
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p) {
+            hasDigits = true;
+            if (numOfDigits < 19) {
+                mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+                numOfDigits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+
+    if (!hasDigits)
+        return parseFloatSlow(start, end, value);
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool isNegativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            isNegativeExponent = *q == '-';
+            ++q;
+        }
+
+        if (q < end && isDigit(*q)) {
+            int explicitExponent = 0;
+            for (; q < end && isDigit(*q); ++q) {
+                if (explicitExponent < 10000)
+                    explicitExponent = explicitExponent * 10 + (*q - '0');
+            }
+
+            exponent += isNegativeExponent ? -explicitExponent : explicitExponent;
+            p = q;
+        }
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (exponent < 0)
+        result = exponent >= -22 ? result / POWERS_OF_TEN[-exponent] : result * std::pow(10.0, exponent);
+    else if (exponent > 0)
+        result = exponent <= 22 ? result * POWERS_OF_TEN[exponent] : result * std::pow(10.0, exponent);
+
+    value = static_cast<float>(isNegative ? -result : result);
+    return p;
+}
+
+
+const char *parseInt(const char *p, const char *end, int &value) {
+    bool isNegative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        isNegative = *p == '-';
+        ++p;
+    }
+
+    if (p == end || !isDigit(*p))
+        return nullptr;
+
+    long long result = 0;
+    for (; p < end && isDigit(*p); ++p) {
+        if (result <= INT32_MAX)
+            result = result * 10 + (*p - '0');
+    }
+
+    if (result > INT32_MAX)
+        return nullptr;
+
+    value = static_cast<int>(isNegative ? -result : result);
+    return p;
+}
+
+
+// reads count floats into values, the first required ones must be present
+bool parseFloats(const char *p, const char *end, std::vector<float> &values, int count, int numOfRequired) {
+    for (int i = 0; i < count; ++i) {
+        float value = 0.0f;
+        p = skipSpaces(p, end);
+        if (p < end) {
+            p = parseFloat(p, end, value);
+            if (!p)
+                return false;
+        }
+        else if (i < numOfRequired)
+            return false;
+
+        values.push_back(value);
+    }
+
+    return true;
+}
+
+
+std::string trimmed(const char *begin, const char *end) {
+    begin = skipSpaces(begin, end);
+    while (end > begin && isSpace(end[-1]))
+        --end;
+
+    return std::string(begin, end);
+}
+
+}
+
+
+/***************************************************
+ * ObjParser definitions
+ ***************************************************/
+const std::size_t ObjParser::CHUNK_SIZE = 4 << 20;
+
+
+// everything a chunk contributes, with indices relative to the chunk where the
+// file uses negative indices. Event offsets are counted in triangles
+struct ObjParser::Chunk {
+    struct Event {
+        std::size_t faceOffset;
+        std::string name;
+    };
+
+    // index into indices plus which of its components still lack the chunk base
+    struct RelativeIndex {
+        std::size_t index;
+        unsigned char components;
+    };
+
+    enum Component : unsigned char {
+        VERTEX = 1,
+        NORMAL = 2,
+        TEXCOORD = 4
+    };
+
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    std::vector<tinyobj::index_t> indices;
+    std::vector<RelativeIndex> relativeIndices;
+    std::vector<Event> groups;
+    std::vector<Event> materialUses;
+    std::vector<std::string> materialLibs;
+
+    // current polygon before triangulation
+    std::vector<tinyobj::index_t> polygon;
+    std::vector<unsigned char> polygonComponents;
+
+    bool isGood = true;
+    std::size_t errorLine = 0;
+};
+
+
+bool ObjParser::parse(const std::string &file,
+                      tinyobj::attrib_t &attrib_t,
+                      std::vector<tinyobj::shape_t> &shape_ts,
+                      std::vector<tinyobj::material_t> &material_ts,
+                      ThreadPool *threadPool,
+                      const MeshLoadObserver *observer)
+{
+    QFile objFile(QString::fromStdString(file));
+    if (!objFile.open(QIODevice::ReadOnly))
+        return false;
+
+    auto size = static_cast<std::size_t>(objFile.size());
+    const char *data = nullptr;
+    uchar *mapped = nullptr;
+    if (size > 0) {
+        mapped = objFile.map(0, objFile.size());
+        if (!mapped)
+            return false;
+
+        data = reinterpret_cast<const char*>(mapped);
+    }
+
+    // chunk boundaries sit right after a line break so no line is split
+    std::vector<const char*> boundaries{data};
+    for (std::size_t offset = CHUNK_SIZE; offset < size; offset += CHUNK_SIZE) {
+        if (data + offset <= boundaries.back())
+            continue;
+
+        auto lineEnd = static_cast<const char*>(std::memchr(data + offset, '\n', size - offset));
+        if (!lineEnd)
+            break;
+
+        boundaries.push_back(lineEnd + 1);
+    }
+
+    boundaries.push_back(data + size);
+
+    std::vector<Chunk> chunks(boundaries.size() - 1);
+    auto parseChunkAt = [&](std::size_t i) {
+        if (observer && observer->isCancelled())
+            return;
+
+        parseChunk(boundaries[i], boundaries[i + 1], chunks[i]);
+    };
+
+    if (threadPool) {
+        threadPool->parallelFor(chunks.size(), parseChunkAt);
+    }
+    else {
+        for (std::size_t i = 0; i < chunks.size(); ++i)
+            parseChunkAt(i);
+    }
+
+    if (mapped)
+        objFile.unmap(mapped);
+
+    if (observer && observer->isCancelled())
+        return false;
+
+    for (const auto &chunk : chunks) {
+        if (!chunk.isGood) {
+#ifndef NDEBUG
+            qDebug() << "Failed to parse" << file.c_str() << "near line" << chunk.errorLine << "of a chunk";
+#endif
+            return false;
+        }
+    }
+
+    auto pos = file.find_last_of("\\/");
+    std::string baseDir = pos != std::string::npos ? file.substr(0, pos + 1) : "";
+    std::map<std::string, int> materialMap;
+    material_ts.clear();
+    loadMaterials(baseDir, chunks, material_ts, materialMap);
+
+    return mergeChunks(chunks, materialMap, attrib_t, shape_ts, threadPool);
+}
+
+
+void ObjParser::parseChunk(const char *begin, const char *end, Chunk &chunk) {
+    std::size_t line = 0;
+    const char *p = begin;
+    while (p < end) {
+        auto lineEnd = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        if (!lineEnd)
+            lineEnd = end;
+
+        ++line;
+        const char *q = skipSpaces(p, lineEnd);
+        const char *e = lineEnd;
+        while (e > q && isSpace(e[-1]))
+            --e;
+
+        bool isGood = true;
+        if (q == e || *q == '#') {
+            // empty line or comment
+        }
+        else if (startsWith(q, e, "v", 1)) {
+            isGood = parseFloats(q + 1, e, chunk.positions, 3, 3);
+        }
+        else if (startsWith(q, e, "vn", 2)) {
+            isGood = parseFloats(q + 2, e, chunk.normals, 3, 3);
+        }
+        else if (startsWith(q, e, "vt", 2)) {
+            isGood = parseFloats(q + 2, e, chunk.texcoords, 2, 1);
+        }
+        else if (startsWith(q, e, "f", 1)) {
+            isGood = parseFace(q + 1, e, chunk);
+        }
+        else if (startsWith(q, e, "o", 1) || startsWith(q, e, "g", 1)) {
+            chunk.groups.push_back({chunk.indices.size() / 3, trimmed(q + 1, e)});
+        }
+        else if (startsWith(q, e, "usemtl", 6)) {
+            chunk.materialUses.push_back({chunk.indices.size() / 3, trimmed(q + 6, e)});
+        }
+        else if (startsWith(q, e, "mtllib", 6)) {
+            chunk.materialLibs.push_back(trimmed(q + 6, e));
+        }
+
+        if (!isGood) {
+            chunk.isGood = false;
+            chunk.errorLine = line;
+            return;
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+
+bool ObjParser::parseFace(const char *begin, const char *end, Chunk &chunk) {
+    // 1 based indices count from the start of the file, negative ones back from the
+    // last attribute read. The latter are resolved against the chunk and patched on merge
+    auto resolve = [](int raw, std::size_t count, unsigned char component, unsigned char &components, int &index) {
+        if (raw > 0) {
+            index = raw - 1;
+        }
+        else if (raw < 0) {
+            index = static_cast<int>(count) + raw;
+            components |= component;
+        }
+        else
+            return false;
+
+        return true;
+    };
+
+    chunk.polygon.clear();
+    chunk.polygonComponents.clear();
+    const char *p = skipSpaces(begin, end);
+    while (p < end) {
+        tinyobj::index_t index_t{-1, -1, -1};
+        unsigned char components = 0;
+        int raw;
+        p = parseInt(p, end, raw);
+        if (!p || !resolve(raw, chunk.positions.size() / 3, Chunk::VERTEX, components, index_t.vertex_index))
+            return false;
+
+        if (p < end && *p == '/') {
+            ++p;
+            if (p < end && *p != '/') {
+                p = parseInt(p, end, raw);
+                if (!p || !resolve(raw, chunk.texcoords.size() / 2, Chunk::TEXCOORD, components, index_t.texcoord_index))
+                    return false;
+            }
+
+            if (p < end && *p == '/') {
+                ++p;
+                p = parseInt(p, end, raw);
+                if (!p || !resolve(raw, chunk.normals.size() / 3, Chunk::NORMAL, components, index_t.normal_index))
+                    return false;
+            }
+        }
+
+        if (p < end && !isSpace(*p))
+            return false;
+
+        chunk.polygon.push_back(index_t);
+        chunk.polygonComponents.push_back(components);
+        p = skipSpaces(p, end);
+    }
+
+    // points and lines are not drawn
+    if (chunk.polygon.size() < 3)
+        return true;
+
+    // fan triangulation
+    auto addVertex = [&chunk](std::size_t i) {
+        if (chunk.polygonComponents[i])
+            chunk.relativeIndices.push_back({chunk.indices.size(), chunk.polygonComponents[i]});
+
+        chunk.indices.push_back(chunk.polygon[i]);
+    };
+
+    for (std::size_t i = 1; i + 1 < chunk.polygon.size(); ++i) {
+        addVertex(0);
+        addVertex(i);
+        addVertex(i + 1);
+    }
+
+    return true;
+}
+
+
+void ObjParser::loadMaterials(const std::string &baseDir,
+                              const std::vector<Chunk> &chunks,
+                              std::vector<tinyobj::material_t> &material_ts,
+                              std::map<std::string, int> &materialMap)
+{
+    for (const auto &chunk : chunks) {
+        for (const auto &materialLib : chunk.materialLibs) {
+            std::ifstream stream(baseDir + materialLib);
+            if (!stream) {
+#ifndef NDEBUG
+                qDebug() << "Failed to open material library" << (baseDir + materialLib).c_str();
+#endif
+                continue;
+            }
+
+            std::string warn;
+            std::string error;
+            tinyobj::LoadMtl(&materialMap, &material_ts, &stream, &warn, &error);
+        }
+    }
+}
+
+
+bool ObjParser::mergeChunks(std::vector<Chunk> &chunks,
+                            const std::map<std::string, int> &materialMap,
+                            tinyobj::attrib_t &attrib_t,
+                            std::vector<tinyobj::shape_t> &shape_ts,
+                            ThreadPool *threadPool)
+{
+    // attribute offset of every chunk
+    std::vector<std::size_t> positionBases, normalBases, texcoordBases;
+    std::size_t numOfPositions = 0, numOfNormals = 0, numOfTexcoords = 0;
+    for (const auto &chunk : chunks) {
+        positionBases.push_back(numOfPositions);
+        normalBases.push_back(numOfNormals);
+        texcoordBases.push_back(numOfTexcoords);
+        numOfPositions += chunk.positions.size();
+        numOfNormals += chunk.normals.size();
+        numOfTexcoords += chunk.texcoords.size();
+    }
+
+    attrib_t.vertices.resize(numOfPositions);
+    attrib_t.normals.resize(numOfNormals);
+    attrib_t.texcoords.resize(numOfTexcoords);
+
+    // concatenate attributes and patch relative indices, each chunk writes only its own slice
+    std::vector<char> isChunkValid(chunks.size(), 1);
+    auto mergeChunkAt = [&](std::size_t i) {
+        auto &chunk = chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), attrib_t.vertices.begin() + positionBases[i]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), attrib_t.normals.begin() + normalBases[i]);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib_t.texcoords.begin() + texcoordBases[i]);
+
+        for (const auto &relativeIndex : chunk.relativeIndices) {
+            auto &index_t = chunk.indices[relativeIndex.index];
+            if (relativeIndex.components & Chunk::VERTEX)
+                index_t.vertex_index += static_cast<int>(positionBases[i] / 3);
+
+            if (relativeIndex.components & Chunk::NORMAL)
+                index_t.normal_index += static_cast<int>(normalBases[i] / 3);
+
+            if (relativeIndex.components & Chunk::TEXCOORD)
+                index_t.texcoord_index += static_cast<int>(texcoordBases[i] / 2);
+        }
+
+        for (const auto &index_t : chunk.indices) {
+            if (index_t.vertex_index < 0 || static_cast<std::size_t>(index_t.vertex_index) >= numOfPositions / 3 ||
+                index_t.normal_index < -1 || (index_t.normal_index >= 0 && static_cast<std::size_t>(index_t.normal_index) >= numOfNormals / 3) ||
+                index_t.texcoord_index < -1 || (index_t.texcoord_index >= 0 && static_cast<std::size_t>(index_t.texcoord_index) >= numOfTexcoords / 2))
+            {
+                isChunkValid[i] = 0;
+                return;
+            }
+        }
+
+        std::vector<float>().swap(chunk.positions);
+        std::vector<float>().swap(chunk.normals);
+        std::vector<float>().swap(chunk.texcoords);
+    };
+
+    if (threadPool) {
+        threadPool->parallelFor(chunks.size(), mergeChunkAt);
+    }
+    else {
+        for (std::size_t i = 0; i < chunks.size(); ++i)
+            mergeChunkAt(i);
+    }
+
+    if (std::find(isChunkValid.begin(), isChunkValid.end(), 0) != isChunkValid.end()) {
+#ifndef NDEBUG
+        qDebug() << "Face index out of range";
+#endif
+        return false;
+    }
+
+    // a new group or object starts a new shape, shapes without faces are dropped
+    shape_ts.clear();
+    tinyobj::shape_t shape_t;
+    int materialId = -1;
+    auto addFaces = [&](const Chunk &chunk, std::size_t first, std::size_t last) {
+        if (first == last)
+            return;
+
+        auto &mesh = shape_t.mesh;
+        mesh.indices.insert(mesh.indices.end(), chunk.indices.begin() + first * 3, chunk.indices.begin() + last * 3);
+        mesh.num_face_vertices.insert(mesh.num_face_vertices.end(), last - first, 3);
+        mesh.material_ids.insert(mesh.material_ids.end(), last - first, materialId);
+    };
+
+    for (auto &chunk : chunks) {
+        std::size_t numOfFaces = chunk.indices.size() / 3;
+        std::size_t face = 0;
+        auto group = chunk.groups.begin();
+        auto materialUse = chunk.materialUses.begin();
+        while (true) {
+            std::size_t next = numOfFaces;
+            if (group != chunk.groups.end())
+                next = std::min(next, group->faceOffset);
+
+            if (materialUse != chunk.materialUses.end())
+                next = std::min(next, materialUse->faceOffset);
+
+            addFaces(chunk, face, next);
+            face = next;
+
+            bool hasEvent = false;
+            for (; group != chunk.groups.end() && group->faceOffset == face; ++group) {
+                if (!shape_t.mesh.indices.empty())
+                    shape_ts.push_back(std::move(shape_t));
+
+                shape_t = tinyobj::shape_t();
+                shape_t.name = group->name;
+                hasEvent = true;
+            }
+
+            for (; materialUse != chunk.materialUses.end() && materialUse->faceOffset == face; ++materialUse) {
+                auto it = materialMap.find(materialUse->name);
+                materialId = it != materialMap.end() ? it->second : -1;
+                hasEvent = true;
+            }
+
+            if (!hasEvent && face == numOfFaces)
+                break;
+        }
+
+        std::vector<tinyobj::index_t>().swap(chunk.indices);
+    }
+
+    if (!shape_t.mesh.indices.empty())
+        shape_ts.push_back(std::move(shape_t));
+
+    return true;
+}
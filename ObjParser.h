@@ -0,0 +1,52 @@
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "tiny_obj_loader.h"
+
+class ThreadPool;
+class MeshLoadObserver;
+
+
+/***************************************************
+ * OBJ parser reading the memory mapped file in chunks split
+ * at line boundaries. Chunks are parsed independently on the
+ * thread pool and concatenated in file order, so the output
+ * matches a sequential parse. Faces are fan triangulated.
+ * Material libraries are still read by tinyobjloader, they
+ * are small compared to the geometry
+ ***************************************************/
+class ObjParser {
+public:
+    static bool parse(const std::string &file,
+                      tinyobj::attrib_t &attrib_t,
+                      std::vector<tinyobj::shape_t> &shape_ts,
+                      std::vector<tinyobj::material_t> &material_ts,
+                      ThreadPool *threadPool = nullptr,
+                      const MeshLoadObserver *observer = nullptr);
+
+private:
+    struct Chunk;
+
+    static void parseChunk(const char *begin, const char *end, Chunk &chunk);
+
+    static bool parseFace(const char *begin, const char *end, Chunk &chunk);
+
+    static void loadMaterials(const std::string &baseDir,
+                              const std::vector<Chunk> &chunks,
+                              std::vector<tinyobj::material_t> &material_ts,
+                              std::map<std::string, int> &materialMap);
+
+    static bool mergeChunks(std::vector<Chunk> &chunks,
+                            const std::map<std::string, int> &materialMap,
+                            tinyobj::attrib_t &attrib_t,
+                            std::vector<tinyobj::shape_t> &shape_ts,
+                            ThreadPool *threadPool);
+
+    // bytes per chunk before moving to the next line break
+    static const std::size_t CHUNK_SIZE;
+};
+
+#endif // OBJPARSER_H
@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include "OcclusionCuller.h"
+#include "ThreadPool.h"
+
+
+/***************************************************
+ * OccluderMesh definitions
+ ***************************************************/
+OccluderMesh OccluderMesh::fromElements(const unsigned *elements,
+                                        std::size_t numOfElements,
+                                        const std::vector<glm::vec3> &positions)
+{
+    OccluderMesh occluder;
+    std::unordered_map<unsigned, unsigned> remap;
+    occluder.elements.reserve(numOfElements);
+    for (std::size_t i = 0; i < numOfElements; ++i) {
+        auto inserted = remap.insert({elements[i], static_cast<unsigned>(occluder.positions.size())});
+        if (inserted.second)
+            occluder.positions.push_back(positions[elements[i]]);
+
+        occluder.elements.push_back(inserted.first->second);
+    }
+
+    return occluder;
+}
+
+
+/***************************************************
+ * OcclusionCuller definitions
+ ***************************************************/
+const int OcclusionCuller::DEFAULT_WIDTH = 256;
+const int OcclusionCuller::DEFAULT_HEIGHT = 128;
+const std::size_t OcclusionCuller::MAX_OCCLUDERS = 32;
+const float OcclusionCuller::MIN_OCCLUDER_SIZE = 0.1f;
+const std::size_t OcclusionCuller::MAX_OCCLUDER_TRIANGLES = 2048;
+const int OcclusionCuller::TILE_ROWS = 16;
+
+OcclusionCuller::OcclusionCuller(ThreadPool *threadPool, int width, int height)
+    : _width{width},
+    _height{height},
+    _viewProjMatrix{1.0f},
+    _numOfOccluders{0},
+    _threadPool{threadPool}
+{
+    assert(width > 0 && height > 0);
+    for (glm::ivec2 size{width, height};; size = glm::ivec2(std::max(1, size.x / 2), std::max(1, size.y / 2))) {
+        _levelSizes.push_back(size);
+        _pyramid.emplace_back(static_cast<std::size_t>(size.x * size.y), 1.0f);
+        if (size.x == 1 && size.y == 1)
+            break;
+    }
+}
+
+
+OcclusionCuller::~OcclusionCuller() = default;
+
+
+void OcclusionCuller::begin(const glm::mat4 &viewProjMatrix) {
+    _viewProjMatrix = viewProjMatrix;
+    _numOfOccluders = 0;
+    _triangles.clear();
+    for (auto &level : _pyramid) {
+        std::fill(level.begin(), level.end(), 1.0f);
+    }
+}
+
+
+void OcclusionCuller::addOccluder(const OccluderMesh &occluder, const glm::mat4 &transformation) {
+    glm::mat4 modelViewProjMatrix = _viewProjMatrix * transformation;
+    _clipPositions.resize(occluder.positions.size());
+    for (std::size_t i = 0; i < occluder.positions.size(); ++i) {
+        _clipPositions[i] = modelViewProjMatrix * glm::vec4(occluder.positions[i], 1.0f);
+    }
+
+    // clip against the near plane z >= -w, a triangle becomes at most a quad
+    for (std::size_t i = 0; i + 2 < occluder.elements.size(); i += 3) {
+        glm::vec4 input[3] = {_clipPositions[occluder.elements[i]],
+                              _clipPositions[occluder.elements[i + 1]],
+                              _clipPositions[occluder.elements[i + 2]]};
+
+        glm::vec4 polygon[4];
+        int numOfVertices = 0;
+        for (int k = 0; k < 3; ++k) {
+            const auto &current = input[k];
+            const auto &next = input[(k + 1) % 3];
+            float currentDistance = current.z + current.w;
+            float nextDistance = next.z + next.w;
+            if (currentDistance >= 0.0f)
+                polygon[numOfVertices++] = current;
+
+            if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+                polygon[numOfVertices++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+        }
+
+        if (numOfVertices >= 3)
+            addTriangle(polygon[0], polygon[1], polygon[2]);
+
+        if (numOfVertices == 4)
+            addTriangle(polygon[0], polygon[2], polygon[3]);
+    }
+
+    ++_numOfOccluders;
+}
+
+
+void OcclusionCuller::rasterize() {
+    // bands of rows are independent, every band walks all triangles
+    auto numOfTiles = static_cast<std::size_t>((_height + TILE_ROWS - 1) / TILE_ROWS);
+    auto rasterizeTile = [this](std::size_t tile) {
+        int beginRow = static_cast<int>(tile) * TILE_ROWS;
+        int endRow = std::min(_height, beginRow + TILE_ROWS);
+        for (const auto &triangle : _triangles) {
+            rasterizeRows(triangle, beginRow, endRow);
+        }
+    };
+
+    if (_threadPool) {
+        _threadPool->parallelFor(numOfTiles, rasterizeTile);
+    }
+    else {
+        for (std::size_t tile = 0; tile < numOfTiles; ++tile)
+            rasterizeTile(tile);
+    }
+
+    buildPyramid();
+}
+
+
+bool OcclusionCuller::isOccluded(const BoundingBox &box) const {
+    if (_triangles.empty() || box.isEmpty())
+        return false;
+
+    glm::vec2 minCorner{std::numeric_limits<float>::max()};
+    glm::vec2 maxCorner{-std::numeric_limits<float>::max()};
+    float minDepth = 1.0f;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 position{(corner & 1) ? box.max.x : box.min.x,
+                           (corner & 2) ? box.max.y : box.min.y,
+                           (corner & 4) ? box.max.z : box.min.z};
+
+        glm::vec4 clipPosition = _viewProjMatrix * glm::vec4(position, 1.0f);
+        if (clipPosition.w <= 0.0f || clipPosition.z < -clipPosition.w)
+            return false;
+
+        glm::vec3 ndc = glm::vec3(clipPosition) / clipPosition.w;
+        minCorner = glm::min(minCorner, glm::vec2(ndc.x, ndc.y));
+        maxCorner = glm::max(maxCorner, glm::vec2(ndc.x, ndc.y));
+        minDepth = std::min(minDepth, ndc.z * 0.5f + 0.5f);
+    }
+
+    // off screen boxes are left to frustum culling
+    if (maxCorner.x < -1.0f || maxCorner.y < -1.0f || minCorner.x > 1.0f || minCorner.y > 1.0f)
+        return false;
+
+    // occluders cover pixels by their centers, so pixels next to the box are tested too.
+    // Some of them are across any occluder silhouette crossing a pixel the box touches
+    auto toPixel = [](float ndc, int size, int margin) {
+        int pixel = static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * static_cast<float>(size))) + margin;
+        return glm::clamp(pixel, 0, size - 1);
+    };
+
+    int x0 = toPixel(minCorner.x, _width, -1);
+    int x1 = toPixel(maxCorner.x, _width, 1);
+    int y0 = toPixel(minCorner.y, _height, -1);
+    int y1 = toPixel(maxCorner.y, _height, 1);
+
+    // the coarsest level where the box spans at most two texels per axis
+    std::size_t level = 0;
+    while (level + 1 < _pyramid.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        ++level;
+
+    const auto &depth = _pyramid[level];
+    const auto &size = _levelSizes[level];
+    for (int y = std::min(y0 >> level, size.y - 1); y <= std::min(y1 >> level, size.y - 1); ++y) {
+        for (int x = std::min(x0 >> level, size.x - 1); x <= std::min(x1 >> level, size.x - 1); ++x) {
+            if (minDepth <= depth[static_cast<std::size_t>(y * size.x + x)])
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+void OcclusionCuller::addTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c) {
+    ScreenTriangle triangle;
+    float depths[3];
+    const glm::vec4 *clipPositions[3] = {&a, &b, &c};
+    for (int k = 0; k < 3; ++k) {
+        glm::vec3 ndc = glm::vec3(*clipPositions[k]) / clipPositions[k]->w;
+        triangle.vertices[k] = glm::vec2((ndc.x * 0.5f + 0.5f) * static_cast<float>(_width),
+                                         (ndc.y * 0.5f + 0.5f) * static_cast<float>(_height));
+        depths[k] = std::min(ndc.z * 0.5f + 0.5f, 1.0f);
+    }
+
+    glm::vec2 e1 = triangle.vertices[1] - triangle.vertices[0];
+    glm::vec2 e2 = triangle.vertices[2] - triangle.vertices[0];
+    float area = e1.x * e2.y - e2.x * e1.y;
+    if (std::abs(area) < 1e-6f)
+        return;
+
+    // both windings occlude, store them counter clockwise
+    if (area < 0.0f) {
+        std::swap(triangle.vertices[1], triangle.vertices[2]);
+        std::swap(depths[1], depths[2]);
+        std::swap(e1, e2);
+        area = -area;
+    }
+
+    glm::vec2 minCorner = glm::min(triangle.vertices[0], glm::min(triangle.vertices[1], triangle.vertices[2]));
+    glm::vec2 maxCorner = glm::max(triangle.vertices[0], glm::max(triangle.vertices[1], triangle.vertices[2]));
+    if (maxCorner.x < 0.0f || maxCorner.y < 0.0f ||
+        minCorner.x > static_cast<float>(_width) || minCorner.y > static_cast<float>(_height))
+    {
+        return;
+    }
+
+    float dz1 = depths[1] - depths[0];
+    float dz2 = depths[2] - depths[0];
+    triangle.depthX = (dz1 * e2.y - dz2 * e1.y) / area;
+    triangle.depthY = (dz2 * e1.x - dz1 * e2.x) / area;
+    triangle.depthOffset = depths[0] - triangle.depthX * triangle.vertices[0].x - triangle.depthY * triangle.vertices[0].y;
+    triangle.maxDepth = std::max(depths[0], std::max(depths[1], depths[2]));
+    _triangles.push_back(triangle);
+}
+
+
+void OcclusionCuller::rasterizeRows(const ScreenTriangle &triangle, int beginRow, int endRow) {
+    const auto *v = triangle.vertices;
+    float minY = std::min(v[0].y, std::min(v[1].y, v[2].y));
+    float maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+    int y0 = std::max(beginRow, static_cast<int>(std::floor(minY)));
+    int y1 = std::min(endRow - 1, static_cast<int>(std::ceil(maxY)));
+    if (y0 > y1)
+        return;
+
+    float minX = std::min(v[0].x, std::min(v[1].x, v[2].x));
+    float maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+    int x0 = std::max(0, static_cast<int>(std::floor(minX)));
+    int x1 = std::min(_width - 1, static_cast<int>(std::ceil(maxX)));
+
+    // the farthest depth inside a pixel is at most half a pixel along each gradient from its center
+    float depthBias = 0.5f * (std::abs(triangle.depthX) + std::abs(triangle.depthY));
+
+    auto &depth = _pyramid.front();
+    for (int y = y0; y <= y1; ++y) {
+        float py = static_cast<float>(y) + 0.5f;
+
+        // edge functions are linear in x along the row, written branch free so the loop vectorizes
+        float offsets[3], steps[3];
+        for (int k = 0; k < 3; ++k) {
+            const auto &a = v[k];
+            const auto &b = v[(k + 1) % 3];
+            offsets[k] = (b.x - a.x) * (py - a.y) + (b.y - a.y) * a.x;
+            steps[k] = -(b.y - a.y);
+        }
+
+        float rowDepth = triangle.depthY * py + triangle.depthOffset + depthBias;
+        float *row = depth.data() + static_cast<std::size_t>(y * _width);
+        for (int x = x0; x <= x1; ++x) {
+            float px = static_cast<float>(x) + 0.5f;
+            bool isInside = offsets[0] + steps[0] * px >= 0.0f &&
+                            offsets[1] + steps[1] * px >= 0.0f &&
+                            offsets[2] + steps[2] * px >= 0.0f;
+            float z = std::min(triangle.depthX * px + rowDepth, triangle.maxDepth);
+            row[x] = isInside ? std::min(row[x], z) : row[x];
+        }
+    }
+}
+
+
+void OcclusionCuller::buildPyramid() {
+    // every texel keeps the farthest depth below it, the last column and row also take an odd one left over
+    for (std::size_t level = 1; level < _pyramid.size(); ++level) {
+        const auto &source = _pyramid[level - 1];
+        const auto &sourceSize = _levelSizes[level - 1];
+        auto &target = _pyramid[level];
+        const auto &size = _levelSizes[level];
+        for (int y = 0; y < size.y; ++y) {
+            int endY = y == size.y - 1 ? sourceSize.y : std::min(2 * y + 2, sourceSize.y);
+            for (int x = 0; x < size.x; ++x) {
+                int endX = x == size.x - 1 ? sourceSize.x : std::min(2 * x + 2, sourceSize.x);
+                float farthest = 0.0f;
+                for (int sy = 2 * y; sy < endY; ++sy) {
+                    for (int sx = 2 * x; sx < endX; ++sx) {
+                        farthest = std::max(farthest, source[static_cast<std::size_t>(sy * sourceSize.x + sx)]);
+                    }
+                }
+
+                target[static_cast<std::size_t>(y * size.x + x)] = farthest;
+            }
+        }
+    }
+}
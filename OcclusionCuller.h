@@ -0,0 +1,105 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "BoundingVolume.h"
+
+class ThreadPool;
+
+
+// triangles kept on the CPU to be rasterized as an occluder, in model space
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned> elements;
+
+    // copies the referenced vertices only
+    static OccluderMesh fromElements(const unsigned *elements,
+                                     std::size_t numOfElements,
+                                     const std::vector<glm::vec3> &positions);
+};
+
+
+/***************************************************
+ * Software occlusion culling against a low resolution depth
+ * buffer. Occluders are transformed and clipped on the calling
+ * thread, then rasterized in bands of rows on a thread pool.
+ * Every covered pixel stores the farthest depth the triangle
+ * reaches inside it, and a max depth pyramid is built on top,
+ * so a box is only reported occluded when it is behind every
+ * occluder pixel it overlaps. Needs no GL context
+ ***************************************************/
+class OcclusionCuller {
+public:
+    // rows are rasterized on the calling thread alone without a thread pool
+    explicit OcclusionCuller(ThreadPool *threadPool = nullptr, int width = DEFAULT_WIDTH, int height = DEFAULT_HEIGHT);
+
+    OcclusionCuller(const OcclusionCuller &) = delete;
+
+    OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+    ~OcclusionCuller();
+
+    // clears the depth buffer and drops the occluders of the last view
+    void begin(const glm::mat4 &viewProjMatrix);
+
+    void addOccluder(const OccluderMesh &occluder, const glm::mat4 &transformation);
+
+    // rasterizes the added occluders and builds the depth pyramid
+    void rasterize();
+
+    // the box is in world space. Boxes crossing the near plane are never occluded
+    bool isOccluded(const BoundingBox &box) const;
+
+    inline int getWidth() const { return _width; }
+
+    inline int getHeight() const { return _height; }
+
+    inline std::size_t getNumOfOccluders() const { return _numOfOccluders; }
+
+    inline std::size_t getNumOfTriangles() const { return _triangles.size(); }
+
+    // normalized depth of level 0 in rows from the bottom, 1 where nothing was rasterized
+    inline const std::vector<float> &getDepthBuffer() const { return _pyramid.front(); }
+
+    static const int DEFAULT_WIDTH;
+    static const int DEFAULT_HEIGHT;
+
+    // occluder selection for callers: at most this many, and only when the bounding sphere
+    // radius over its distance reaches the minimum size
+    static const std::size_t MAX_OCCLUDERS;
+    static const float MIN_OCCLUDER_SIZE;
+    static const std::size_t MAX_OCCLUDER_TRIANGLES;
+
+private:
+    // in pixels with the depth plane z = depthX * x + depthY * y + depthOffset
+    struct ScreenTriangle {
+        glm::vec2 vertices[3];
+        float depthX;
+        float depthY;
+        float depthOffset;
+        float maxDepth;
+    };
+
+    void addTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+
+    void rasterizeRows(const ScreenTriangle &triangle, int beginRow, int endRow);
+
+    void buildPyramid();
+
+    static const int TILE_ROWS;
+
+    int _width;
+    int _height;
+    glm::mat4 _viewProjMatrix;
+    std::size_t _numOfOccluders;
+    std::vector<ScreenTriangle> _triangles;
+    std::vector<glm::vec4> _clipPositions;
+
+    // level 0 is the depth buffer, every level halves the previous one
+    std::vector<std::vector<float>> _pyramid;
+    std::vector<glm::ivec2> _levelSizes;
+    ThreadPool *_threadPool;
+};
+
+#endif // OCCLUSIONCULLER_H
@@ -1,9 +1,12 @@
 #include <glm/gtc/matrix_access.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <deque>
+#include <mutex>
+#include <QElapsedTimer>
 #include <QMimeData>
-#include <unordered_set>
 #include "Viewer.h"
 #include "Effects.h"
+#include "BasicGeometry.h"
 #include "Utility.h"
 
 /***************************************************
@@ -81,6 +84,31 @@ void OrbitCameraPlugin::mousePressEvent(QMouseEvent *event) {
         _isMousePress = true;
         _prevMousePos = glm::vec2(mousePos.x(), mousePos.y());
     }
+    else if (event->button() == Qt::MouseButton::LeftButton) {
+        auto mousePos = event->pos();
+        auto picked = pick(glm::vec2(mousePos.x(), mousePos.y()));
+
+#ifndef NDEBUG
+        if (picked)
+            qDebug() << "Picked drawable" << picked->getName().c_str();
+#endif
+    }
+}
+
+
+Drawable *OrbitCameraPlugin::pick(glm::vec2 mousePos) {
+    // unproject the cursor on the near and far planes
+    auto &context = _viewer->getDrawContext();
+    auto &camera = context.getCamera();
+    auto invViewProj = glm::inverse(camera.getProjMatrix() * camera.getViewMatrix());
+    glm::vec2 ndc{2.0f * mousePos.x / _viewer->width() - 1.0f,
+                  1.0f - 2.0f * mousePos.y / _viewer->height()};
+    glm::vec4 nearPoint = invViewProj * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+    glm::vec4 farPoint = invViewProj * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+    return context.pick(origin, direction);
 }
 
 
@@ -134,281 +162,273 @@ void PerspectiveCameraPlugin::setCameraProjMatrix(DrawContext &context) {
 
 
 /***************************************************
- * ImportMeshFilePlugin definitions
+ * OcclusionCullingPlugin definitions
  ***************************************************/
-ImportMeshFilePlugin::ImportMeshFilePlugin(Viewer *viewer)
+OcclusionCullingPlugin::OcclusionCullingPlugin(Viewer *viewer)
     : ViewerPlugin{viewer}
 {
-    connect(_viewer, &Viewer::onDragEnterEvent, this, &ImportMeshFilePlugin::dragEnterEvent);
-    connect(_viewer, &Viewer::onDropEvent, this, &ImportMeshFilePlugin::dropEvent);
+    connect(_viewer, &Viewer::onKeyPressEvent, this, &OcclusionCullingPlugin::keyPressEvent);
+}
+
+
+void OcclusionCullingPlugin::keyPressEvent(QKeyEvent *event) {
+    if (event->key() != Qt::Key_O)
+        return;
 
     auto &context = _viewer->getDrawContext();
-    auto forwardPhongEffect = context.getEffect(ForwardPhongEffect::EFFECT_NAME);
-    _defaultEffectProperty = std::make_shared<EffectProperty>(forwardPhongEffect->createEffectProperty());
-    _defaultEffectProperty->setParam(ForwardPhongEffect::AMBIENT_COLOR, glm::vec3(1.0f));
-    _defaultEffectProperty->setParam(ForwardPhongEffect::DIFFUSE_COLOR, glm::vec3(1.0f));
-    _defaultEffectProperty->setParam(ForwardPhongEffect::SPECULAR_COLOR, glm::vec3(1.0f));
-    _defaultEffectProperty->setParam(ForwardPhongEffect::SHININESS, 32.0f);
+    context.enableOcclusionCulling(!context.isOcclusionCullingEnabled());
 
+#ifndef NDEBUG
+    qDebug() << "Occlusion culling" << (context.isOcclusionCullingEnabled() ? "enabled" : "disabled");
+#endif
+
+    _viewer->renderLater();
 }
 
 
-void ImportMeshFilePlugin::dragEnterEvent(QDragEnterEvent *event) {
-    event->acceptProposedAction();
+/***************************************************
+ * DepthPrepassPlugin definitions
+ ***************************************************/
+DepthPrepassPlugin::DepthPrepassPlugin(Viewer *viewer)
+    : ViewerPlugin{viewer}
+{
+    connect(_viewer, &Viewer::onKeyPressEvent, this, &DepthPrepassPlugin::keyPressEvent);
 }
 
 
-void ImportMeshFilePlugin::dropEvent(QDropEvent *event) {
-    auto urls = event->mimeData()->urls();
-    for (const auto &url : urls) {
-        if (url.isLocalFile() && url.path().endsWith(".obj") ) {
-            loadMeshFile(url.path().toStdString());
-        }
-    }
+void DepthPrepassPlugin::keyPressEvent(QKeyEvent *event) {
+    if (event->key() != Qt::Key_P)
+        return;
+
+    // the prepass effect creates and releases GL objects
+    auto &context = _viewer->getDrawContext();
+    context.getDriver().makeCurrent(_viewer);
+    context.enableDepthPrepass(!context.isDepthPrepassEnabled());
+
+#ifndef NDEBUG
+    qDebug() << "Depth prepass" << (context.isDepthPrepassEnabled() ? "enabled" : "disabled");
+#endif
 
     _viewer->renderLater();
 }
 
 
-void ImportMeshFilePlugin::loadMeshFile(const std::string &file) {
-    std::string baseDir = getBaseDir(file);
-    if (baseDir.empty())
-        baseDir = ".";
-#ifdef _WIN32
-    baseDir += "\\";
-#else
-    baseDir += "/";
-#endif
-
-    std::string warn;
-    std::string error;
-    tinyobj::attrib_t attrib_t;
-    std::vector<tinyobj::shape_t> shape_ts;
-    std::vector<tinyobj::material_t> material_ts;
-    bool ret = tinyobj::LoadObj(&attrib_t,
-                                &shape_ts,
-                                &material_ts,
-                                &warn,
-                                &error,
-                                file.c_str(),
-                                baseDir.c_str(),
-                                true,
-                                true);
-
-    if (!ret) {
-        // TODO: display error message here
-        return;
+/***************************************************
+ * ImportMeshFilePlugin definitions
+ ***************************************************/
+// shared between the loading thread and the GUI thread which drains it
+struct ImportMeshFilePlugin::ImportJob : public MeshLoadObserver {
+    ImportJob(ImportMeshFilePlugin *plugin)
+        : plugin{plugin}, isCancelledFlag{false}, numOfShapes{0}, isNotified{false}, isDone{false}, isSuccessful{false}
+    {}
+
+    void onMaterials(const std::vector<MeshMaterial> &loadedMaterials, std::size_t count) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        materials = loadedMaterials;
+        numOfShapes = count;
+        notify();
     }
 
-    // clear existing mesh for now. TODO: develop UI so user will do it themselves
-    auto &context = _viewer->getDrawContext();
-    auto &rootNode = context.getRoot();
-    auto it = rootNode.childBegin();
-    while (it != rootNode.childEnd()) {
-        auto &drawable = it->getDrawable();
-        if (drawable->asPointLight()) {
-            ++it;
-        }
-        else
-            it = rootNode.removeChild(it);
+    void onShape(std::size_t, const MeshShape &shape) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        shapes.push_back(shape);
+        notify();
     }
 
-    // add imported mesh to the scene
-    std::vector<std::shared_ptr<EffectProperty>> effectProperties;
-    for (const auto &material_t : material_ts) {
-        std::shared_ptr<EffectProperty> effectProperty = processMaterial(material_t);
-        effectProperties.push_back(std::move(effectProperty));
+    bool isCancelled() const override {
+        return isCancelledFlag;
     }
 
-    for (const auto &shape_t : shape_ts) {
-        processShape(shape_t, attrib_t, effectProperties);
+    void finish(bool successful) {
+        std::lock_guard<std::mutex> lock(mutex);
+        isDone = true;
+        isSuccessful = successful;
+        notify();
     }
-}
 
+    // expects the mutex to be locked. Only one queued notification is pending at a time
+    void notify() {
+        if (isNotified)
+            return;
 
-std::string ImportMeshFilePlugin::getBaseDir(const std::string &file) {
-    auto pos = file.find_last_of("\\/");
-    if (pos != std::string::npos)
-        return file.substr(0, pos);
+        isNotified = true;
+        emit plugin->onImportDataReady();
+    }
 
-    return "";
-}
+    ImportMeshFilePlugin *plugin;
+    std::atomic<bool> isCancelledFlag;
+    std::mutex mutex;
+    std::optional<std::vector<MeshMaterial>> materials;
+    std::deque<MeshShape> shapes;
+    std::size_t numOfShapes;
+    bool isNotified;
+    bool isDone;
+    bool isSuccessful;
+};
 
 
-std::shared_ptr<EffectProperty> ImportMeshFilePlugin::processMaterial(const tinyobj::material_t &material_t) {
-    glm::vec3 ambientColor = glm::vec3(material_t.ambient[0], material_t.ambient[1], material_t.ambient[2]);
-    glm::vec3 diffuseColor = glm::vec3(material_t.diffuse[0], material_t.diffuse[1], material_t.diffuse[2]);
-    glm::vec3 specularColor = glm::vec3(material_t.specular[0], material_t.specular[1], material_t.specular[2]);
-    float shininess = equals(material_t.shininess, 0.0f) ? 1.0f : material_t.shininess;
+ImportMeshFilePlugin::ImportMeshFilePlugin(Viewer *viewer)
+    : ViewerPlugin{viewer}, _numOfImportedShapes{0}
+{
+    connect(_viewer, &Viewer::onDragEnterEvent, this, &ImportMeshFilePlugin::dragEnterEvent);
+    connect(_viewer, &Viewer::onDropEvent, this, &ImportMeshFilePlugin::dropEvent);
+    connect(_viewer, &Viewer::onKeyPressEvent, this, &ImportMeshFilePlugin::keyPressEvent);
+
+    // the loading thread only signals, scene and GL work happens on the GUI thread
+    connect(this, &ImportMeshFilePlugin::onImportDataReady, this, &ImportMeshFilePlugin::processImportQueue, Qt::QueuedConnection);
 
-    // set phong property for imported mesh
     auto &context = _viewer->getDrawContext();
     auto forwardPhongEffect = context.getEffect(ForwardPhongEffect::EFFECT_NAME);
-    auto effectProperty = forwardPhongEffect->createEffectProperty();
-    effectProperty.setParam(ForwardPhongEffect::AMBIENT_COLOR, ambientColor);
-    effectProperty.setParam(ForwardPhongEffect::DIFFUSE_COLOR, diffuseColor);
-    effectProperty.setParam(ForwardPhongEffect::SPECULAR_COLOR, specularColor);
-    effectProperty.setParam(ForwardPhongEffect::SHININESS, shininess);
+    _defaultEffectProperty = std::make_shared<EffectProperty>(forwardPhongEffect->createEffectProperty());
+    _defaultEffectProperty->setParam(ForwardPhongEffect::AMBIENT_COLOR, glm::vec3(1.0f));
+    _defaultEffectProperty->setParam(ForwardPhongEffect::DIFFUSE_COLOR, glm::vec3(1.0f));
+    _defaultEffectProperty->setParam(ForwardPhongEffect::SPECULAR_COLOR, glm::vec3(1.0f));
+    _defaultEffectProperty->setParam(ForwardPhongEffect::SHININESS, 32.0f);
 
-    return std::make_shared<EffectProperty>(std::move(effectProperty));
 }
 
 
-void ImportMeshFilePlugin::processShape(const tinyobj::shape_t &shape_t,
-                                        const tinyobj::attrib_t &attrib_t,
-                                        const std::vector<std::shared_ptr<EffectProperty>> &effectProperties)
-{
-    // find the size of position, color, normal, and texCoord
-    unsigned numOfElement = 0;
-    std::unordered_map<int, unsigned> posToElem;
-    std::unordered_set<int> uniqueNormal, uniqueTexCoord;
-    for (const auto &index_t : shape_t.mesh.indices) {
-        if (index_t.vertex_index >= 0 &&  (posToElem.find(index_t.vertex_index) == posToElem.end()))
-            posToElem.insert({index_t.vertex_index, numOfElement++});
-
-        if (index_t.normal_index >= 0)
-            uniqueNormal.insert(index_t.normal_index);
-
-        if (index_t.texcoord_index >= 0)
-            uniqueTexCoord.insert(index_t.texcoord_index);
-    }
+ImportMeshFilePlugin::~ImportMeshFilePlugin() {
+    cancelImport();
+}
 
-    // find the position, color, normal, and texCoord
-    std::vector<unsigned> elements;
-    std::vector<glm::vec3> positions(posToElem.size());
-    std::vector<glm::vec3> normals(posToElem.size());
-    std::vector<glm::vec2> texCoords;
-    if (uniqueTexCoord.size() > 0)
-        texCoords.resize(posToElem.size());
 
-    std::size_t indexOffset = 0;
-    for (auto vertPerFace : shape_t.mesh.num_face_vertices) {
-        for (auto i = indexOffset; i < indexOffset + vertPerFace; ++i) {
-            auto index_t = shape_t.mesh.indices[i];
+void ImportMeshFilePlugin::dragEnterEvent(QDragEnterEvent *event) {
+    event->acceptProposedAction();
+}
 
-            auto element = posToElem.at(index_t.vertex_index);
-            elements.push_back(element);
 
-            // position
-            positions[element] = retrievePositionAttrib_t(attrib_t, index_t);
+void ImportMeshFilePlugin::dropEvent(QDropEvent *event) {
+    auto urls = event->mimeData()->urls();
+    for (const auto &url : urls) {
+        if (url.isLocalFile() && url.path().endsWith(".obj") ) {
+            loadMeshFile(url.path().toStdString());
+        }
+    }
+}
 
-            // normal
-            if (uniqueNormal.size() > 0)
-                normals[element] += retrieveNormalAttrib_t(attrib_t, index_t);
-            else
-                normals[element] += calcSurfaceNormal(attrib_t, shape_t, indexOffset);
 
-            // texture coordinate
-            if (uniqueTexCoord.size() > 0) {
-                texCoords[element] = retrieveTexCoordAttrib_t(attrib_t, index_t);
-            }
-        }
+void ImportMeshFilePlugin::keyPressEvent(QKeyEvent *event) {
+    if (event->key() == Qt::Key_Escape)
+        cancelImport();
+}
 
-        indexOffset += vertPerFace;
-    }
 
-    std::for_each(normals.begin(), normals.end(), [](glm::vec3 &n){
-        if (!equals(glm::length(n), 0.0f))
-            n = glm::normalize(n);
-    });
+void ImportMeshFilePlugin::cancelImport() {
+    if (!_importJob)
+        return;
 
+    // shapes already in the scene stay, the loading thread stops at the next shape
+    _importJob->isCancelledFlag = true;
+    _importJob.reset();
+    emit onImportFinished(false);
+}
 
-    // create VAO and Buffer
-    int positionCount = static_cast<int>(positions.size() * sizeof(glm::vec3));
-    int normalCount = static_cast<int>(normals.size() * sizeof(glm::vec3));
-    int positionOffset = -1;
-    int normalOffset = -1;
 
-    auto &context = _viewer->getDrawContext();
-    GLVertexArray vao = context.getDriver().createVertexArray(elements.data(), elements.size(), GL_STATIC_DRAW);
-    GLBuffer buffer = context.getDriver().createBuffer(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-    buffer.bind();
-    buffer.loadData(nullptr, positionCount + normalCount);
-    if (!positions.empty()) {
-        positionOffset = 0;
-        buffer.loadSubData(positionOffset, positions.data(), positionCount);
-    }
+void ImportMeshFilePlugin::processImportQueue() {
+    if (!_importJob)
+        return;
 
-    if (!normals.empty()) {
-        normalOffset = positionCount;
-        buffer.loadSubData(normalOffset, normals.data(), normalCount);
+    auto job = _importJob;
+    std::optional<std::vector<MeshMaterial>> materials;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->isNotified = false;
+        materials.swap(job->materials);
     }
 
-
-    // create geometries
-    std::shared_ptr<GLVertexArray> vaoptr = std::make_shared<GLVertexArray>(std::move(vao));
-    std::shared_ptr<GLBuffer> bufferptr = std::make_shared<GLBuffer>(std::move(buffer));
-    auto &rootNode = context.getRoot();
-    const auto &materials_ids = shape_t.mesh.material_ids;
-    std::size_t idx = 0;
-    while (idx < materials_ids.size()) {
-        std::size_t right = idx+1;
-        while(right < materials_ids.size() && materials_ids[right] == materials_ids[idx]) {
-            ++right;
+    if (materials) {
+        // clear existing mesh for now. TODO: develop UI so user will do it themselves
+        auto &context = _viewer->getDrawContext();
+        auto &rootNode = context.getRoot();
+        auto it = rootNode.childBegin();
+        while (it != rootNode.childEnd()) {
+            auto &drawable = it->getDrawable();
+            if (drawable->asPointLight()) {
+                ++it;
+            }
+            else
+                it = rootNode.removeChild(it);
         }
 
-        std::shared_ptr<EffectProperty> effectProperty;
-        if (materials_ids[idx] >= 0) {
-            effectProperty = effectProperties[materials_ids[idx]];
-        }
-        else {
-            effectProperty = _defaultEffectProperty;
+        _importEffectProperties.clear();
+        for (const auto &material : *materials) {
+            _importEffectProperties.push_back(createMaterialEffectProperty(&context, material));
         }
-
-        auto drawable = context.createDrawable<Geometry>(std::move(effectProperty),
-                                                         vaoptr,
-                                                         bufferptr,
-                                                         (right - idx) * 3,
-                                                         idx * 3 * sizeof(unsigned),
-                                                         positionOffset,
-                                                         normalOffset);
-
-        drawable->setName(shape_t.name + "_mat" + std::to_string(idx));
-
-        rootNode.emplaceChild(std::move(drawable));
-        idx = right;
     }
-}
-
-
-glm::vec3 ImportMeshFilePlugin::calcSurfaceNormal(const tinyobj::attrib_t &attrib_t, const tinyobj::shape_t &shape_t, std::size_t beginPoint) {
-    auto beginIdx = shape_t.mesh.indices[beginPoint];
-    auto secIdx = shape_t.mesh.indices[beginPoint+1];
-    auto lastIdx = shape_t.mesh.indices[beginPoint+2];
-
-    glm::vec3 p1 = retrievePositionAttrib_t(attrib_t, beginIdx);
-    glm::vec3 p2 = retrievePositionAttrib_t(attrib_t, secIdx);
-    glm::vec3 p3 = retrievePositionAttrib_t(attrib_t, lastIdx);
-    glm::vec3 normal = glm::cross(p2-p1, p3-p1);
-
-    if (!equals(glm::length(normal), 0.0f))
-        return glm::normalize(normal);
-
-    return normal;
-}
 
+    // upload within a time budget so rendering keeps up with large files
+    auto &context = _viewer->getDrawContext();
+    QElapsedTimer timer;
+    timer.start();
+    bool hasMore = false;
+    while (true) {
+        MeshShape shape;
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            if (job->shapes.empty())
+                break;
+
+            if (timer.elapsed() >= IMPORT_TIME_BUDGET) {
+                hasMore = true;
+                break;
+            }
 
-glm::vec3 ImportMeshFilePlugin::retrievePositionAttrib_t(const tinyobj::attrib_t &attrib_t, tinyobj::index_t idx) {
-    auto px = attrib_t.vertices[3 * idx.vertex_index + 0];
-    auto py = attrib_t.vertices[3 * idx.vertex_index + 1];
-    auto pz = attrib_t.vertices[3 * idx.vertex_index + 2];
+            shape = std::move(job->shapes.front());
+            job->shapes.pop_front();
+        }
 
-    return {px, py, pz};
-}
+        for (auto &drawable : createShapeGeometries(&context, shape, _importEffectProperties, _defaultEffectProperty)) {
+            context.getRoot().emplaceChild(std::move(drawable));
+        }
+        ++_numOfImportedShapes;
+    }
 
+    std::size_t numOfShapes;
+    bool isDone, isSuccessful;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        numOfShapes = job->numOfShapes;
+        isDone = job->isDone && job->shapes.empty();
+        isSuccessful = job->isSuccessful;
+    }
 
-glm::vec3 ImportMeshFilePlugin::retrieveNormalAttrib_t(const tinyobj::attrib_t &attrib_t, tinyobj::index_t idx) {
-    auto nx = attrib_t.normals[3 * idx.normal_index + 0];
-    auto ny = attrib_t.normals[3 * idx.normal_index + 1];
-    auto nz = attrib_t.normals[3 * idx.normal_index + 2];
+    emit onImportProgress(static_cast<int>(_numOfImportedShapes), static_cast<int>(numOfShapes));
+    _viewer->renderLater();
 
-    return {nx, ny, nz};
+    if (hasMore) {
+        emit onImportDataReady();
+    }
+    else if (isDone) {
+        _importJob.reset();
+        emit onImportFinished(isSuccessful);
+    }
 }
 
 
-glm::vec2 ImportMeshFilePlugin::retrieveTexCoordAttrib_t(const tinyobj::attrib_t &attrib_t, tinyobj::index_t idx) {
-    auto tx = attrib_t.texcoords[2 * idx.texcoord_index + 0];
-    auto ty = attrib_t.texcoords[2 * idx.texcoord_index + 1];
+void ImportMeshFilePlugin::loadMeshFile(const std::string &file) {
+    cancelImport();
+
+    auto job = std::make_shared<ImportJob>(this);
+    _importJob = job;
+    _numOfImportedShapes = 0;
+    emit onImportStarted(QString::fromStdString(file));
+
+    // the future is dropped, so a throwing load must still finish the job or the import never ends
+    _threadPool.submit([this, job, file]() {
+        bool isSuccessful = false;
+        try {
+            MeshData meshData;
+            isSuccessful = MeshLoader::load(file, meshData, &_threadPool, job.get());
+        }
+        catch (const std::exception &e) {
+#ifndef NDEBUG
+            qDebug() << "Failed to import" << file.c_str() << e.what();
+#endif
+        }
+        catch (...) {
+        }
 
-    return {tx, ty};
+        job->finish(isSuccessful);
+    });
 }
@@ -4,8 +4,9 @@
 #include <QWindow>
 #include <QResizeEvent>
 #include <glm/glm.hpp>
-#include "tiny_obj_loader.h"
 #include "DrawContext.h"
+#include "MeshLoader.h"
+#include "ThreadPool.h"
 
 class Viewer;
 
@@ -40,6 +41,8 @@ public slots:
     void wheelEvent(QWheelEvent *event);
 
 private:
+    Drawable *pick(glm::vec2 mousePos);
+
     glm::vec2 _prevMousePos;
     bool _isMousePress;
 };
@@ -63,39 +66,76 @@ private:
 };
 
 
+// toggles occlusion culling of the draw context with the O key
+class OcclusionCullingPlugin : public ViewerPlugin {
+    Q_OBJECT
+
+public:
+    OcclusionCullingPlugin(Viewer *viewer);
+
+public slots:
+    void keyPressEvent(QKeyEvent *event);
+};
+
+
+// toggles the depth prepass of the draw context with the P key
+class DepthPrepassPlugin : public ViewerPlugin {
+    Q_OBJECT
+
+public:
+    DepthPrepassPlugin(Viewer *viewer);
+
+public slots:
+    void keyPressEvent(QKeyEvent *event);
+};
+
+
 class ImportMeshFilePlugin : public ViewerPlugin {
     Q_OBJECT
 
 public:
     ImportMeshFilePlugin(Viewer *viewer);
 
-public slots:
-    void dragEnterEvent(QDragEnterEvent *event);
+    ~ImportMeshFilePlugin() override;
 
-    void dropEvent(QDropEvent *event);
+signals:
+    void onImportStarted(const QString &file);
 
-private:
-    void loadMeshFile(const std::string &file);
+    // number of shapes added to the scene out of the total in the file
+    void onImportProgress(int numOfLoaded, int numOfShapes);
 
-    std::string getBaseDir(const std::string &file);
+    void onImportFinished(bool isSuccessful);
 
-    void processShape(const tinyobj::shape_t &shape_t,
-                      const tinyobj::attrib_t &attrib_t,
-                      const std::vector<std::shared_ptr<EffectProperty>> &effectProperties);
+    // emitted from the loading thread whenever new data is queued
+    void onImportDataReady();
 
-    std::shared_ptr<EffectProperty> processMaterial(const tinyobj::material_t &material_t);
+public slots:
+    void dragEnterEvent(QDragEnterEvent *event);
 
-    glm::vec3 calcSurfaceNormal(const tinyobj::attrib_t &attrib_t, const tinyobj::shape_t &shape_t, std::size_t beginPoint);
+    void dropEvent(QDropEvent *event);
 
-    glm::vec3 retrievePositionAttrib_t(const tinyobj::attrib_t &attrib_t, tinyobj::index_t idx);
+    void keyPressEvent(QKeyEvent *event);
 
-    glm::vec3 retrieveNormalAttrib_t(const tinyobj::attrib_t &attrib_t, tinyobj::index_t idx);
+    void cancelImport();
 
-    glm::vec2 retrieveTexCoordAttrib_t(const tinyobj::attrib_t &attrib_t, tinyobj::index_t idx);
+private slots:
+    void processImportQueue();
 
-    std::string correctTexturePath(std::string filePath);
+private:
+    struct ImportJob;
+
+    void loadMeshFile(const std::string &file);
 
     std::shared_ptr<EffectProperty> _defaultEffectProperty;
+    std::shared_ptr<ImportJob> _importJob;
+    std::vector<std::shared_ptr<EffectProperty>> _importEffectProperties;
+    std::size_t _numOfImportedShapes;
+
+    // milliseconds spent inserting queued shapes per event loop iteration
+    const qint64 IMPORT_TIME_BUDGET = 8;
+
+    // declared last so the loading thread is joined before the other members are destroyed
+    ThreadPool _threadPool;
 };
 
 
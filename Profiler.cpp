@@ -0,0 +1,204 @@
+#include <cassert>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <QSaveFile>
+#include "Profiler.h"
+#include "GLDriver.h"
+
+
+namespace {
+
+const std::size_t NO_SCOPE = std::numeric_limits<std::size_t>::max();
+
+void writeString(std::ostringstream &stream, const std::string &text) {
+    stream << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            stream << '\\';
+        stream << c;
+    }
+
+    stream << '"';
+}
+
+
+// trace timestamps are in microseconds
+void writeTraceEvent(std::ostringstream &stream, const std::string &name, int threadId, double begin, double duration) {
+    stream << ",\n{\"name\":";
+    writeString(stream, name);
+    stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId << ",\"ts\":" << begin * 1000.0 << ",\"dur\":" << duration * 1000.0 << "}";
+}
+
+}
+
+
+/***************************************************
+ * Profiler definitions
+ ***************************************************/
+const std::size_t Profiler::MAX_FRAMES = 300;
+
+Profiler::Profiler(GLDriver *driver)
+    : _driver{driver},
+    _isEnabled{false},
+    _isInFrame{false},
+    _start{std::chrono::steady_clock::now()},
+    _nextFrameIndex{0},
+    _gpuScope{NO_SCOPE},
+    _pendingPool{0}
+{}
+
+
+void Profiler::setEnabled(bool enabled) {
+    assert(!_isInFrame && "TOGGLE THE PROFILER BETWEEN FRAMES");
+    _isEnabled = enabled;
+
+    // queries issued before the profiler was disabled no longer match any event
+    for (auto &pending : _pendingQueries) {
+        pending.events.clear();
+    }
+}
+
+
+void Profiler::beginFrame() {
+    if (!_isEnabled)
+        return;
+
+    assert(!_isInFrame);
+    _isInFrame = true;
+    _frame = ProfilerFrame{_nextFrameIndex++, now(), 0.0, {}, {}};
+    _driver->resetStatistics();
+
+    // the pool becoming current holds the queries of two frames ago
+    auto elapsedTimes = _driver->swapTimerQueryPools();
+    _pendingPool = 1 - _pendingPool;
+    resolveGpuTimes(elapsedTimes);
+    _pendingQueries[_pendingPool] = PendingQueries{_frame.index, {}};
+}
+
+
+void Profiler::endFrame() {
+    if (!_isInFrame)
+        return;
+
+    assert(_openScopes.empty() && "EVERY SCOPE ENDS IN ITS FRAME");
+    _isInFrame = false;
+    _frame.cpuTime = now() - _frame.begin;
+    _frames.push_back(std::move(_frame));
+    if (_frames.size() > MAX_FRAMES)
+        _frames.pop_front();
+}
+
+
+void Profiler::beginScope(const char *name, bool isGpuTimed) {
+    if (!_isInFrame)
+        return;
+
+    auto eventIdx = _frame.events.size();
+    _frame.events.push_back({name, static_cast<int>(_openScopes.size()), now(), 0.0, -1.0});
+    _openScopes.push_back(eventIdx);
+    if (isGpuTimed && _gpuScope == NO_SCOPE) {
+        _driver->beginTimerQuery();
+        _pendingQueries[_pendingPool].events.push_back(eventIdx);
+        _gpuScope = eventIdx;
+    }
+}
+
+
+void Profiler::endScope() {
+    if (!_isInFrame)
+        return;
+
+    assert(!_openScopes.empty());
+    auto eventIdx = _openScopes.back();
+    _openScopes.pop_back();
+    if (eventIdx == _gpuScope) {
+        _driver->endTimerQuery();
+        _gpuScope = NO_SCOPE;
+    }
+
+    auto &event = _frame.events[eventIdx];
+    event.cpuTime = now() - event.begin;
+}
+
+
+void Profiler::setCounter(const char *name, double value) {
+    if (!_isInFrame)
+        return;
+
+    for (auto &counter : _frame.counters) {
+        if (counter.first == name) {
+            counter.second = value;
+            return;
+        }
+    }
+
+    _frame.counters.emplace_back(name, value);
+}
+
+
+bool Profiler::exportChromeTrace(const std::string &file) const {
+    // CPU scopes are on one thread, GPU times on another starting where their scope began
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(3);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+           << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n"
+           << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+    for (const auto &frame : _frames) {
+        writeTraceEvent(stream, "frame " + std::to_string(frame.index), 1, frame.begin, frame.cpuTime);
+        for (const auto &event : frame.events) {
+            writeTraceEvent(stream, event.name, 1, event.begin, event.cpuTime);
+            if (event.gpuTime >= 0.0)
+                writeTraceEvent(stream, event.name, 2, event.begin, event.gpuTime);
+        }
+
+        if (frame.counters.empty())
+            continue;
+
+        stream << ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":" << frame.begin * 1000.0 << ",\"args\":{";
+        for (std::size_t i = 0; i < frame.counters.size(); ++i) {
+            stream << (i > 0 ? "," : "");
+            writeString(stream, frame.counters[i].first);
+            stream << ":" << frame.counters[i].second;
+        }
+
+        stream << "}}";
+    }
+
+    stream << "\n]}\n";
+
+    QSaveFile output(QString::fromStdString(file));
+    if (!output.open(QIODevice::WriteOnly))
+        return false;
+
+    auto text = stream.str();
+    if (output.write(text.data(), static_cast<qint64>(text.size())) != static_cast<qint64>(text.size()))
+        return false;
+
+    return output.commit();
+}
+
+
+double Profiler::now() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+}
+
+
+void Profiler::resolveGpuTimes(const std::vector<std::uint64_t> &elapsedTimes) {
+    const auto &pending = _pendingQueries[_pendingPool];
+    if (pending.events.size() != elapsedTimes.size())
+        return;
+
+    for (auto frame = _frames.rbegin(); frame != _frames.rend(); ++frame) {
+        if (frame->index != pending.frameIndex)
+            continue;
+
+        // scopes whose result was not ready keep a negative GPU time
+        for (std::size_t i = 0; i < elapsedTimes.size(); ++i) {
+            if (elapsedTimes[i] != GLDriver::TIMER_QUERY_UNAVAILABLE)
+                frame->events[pending.events[i]].gpuTime = static_cast<double>(elapsedTimes[i]) * 1e-6;
+        }
+
+        return;
+    }
+}
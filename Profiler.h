@@ -0,0 +1,131 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+class GLDriver;
+
+
+// times are in milliseconds, begins are measured from the creation of the profiler
+struct ProfilerEvent {
+    std::string name;
+    int depth;
+    double begin;
+    double cpuTime;
+
+    // negative until the timer query is read, or when the scope was not timed on the GPU
+    double gpuTime;
+};
+
+
+struct ProfilerFrame {
+    std::size_t index;
+    double begin;
+    double cpuTime;
+
+    // in the order the scopes began
+    std::vector<ProfilerEvent> events;
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+
+/***************************************************
+ * Records nested CPU scopes, GPU times of scopes measured
+ * with timer queries and named counters per frame. GPU
+ * times arrive two frames late and are filled into the
+ * frames kept in the history, a result not ready by then
+ * is left out rather than waited for. Disabled profilers
+ * record nothing, and scopes outside a frame are ignored
+ ***************************************************/
+class Profiler {
+public:
+    explicit Profiler(GLDriver *driver);
+
+    Profiler(const Profiler &) = delete;
+
+    Profiler &operator=(const Profiler &) = delete;
+
+    void setEnabled(bool enabled);
+
+    inline bool isEnabled() const { return _isEnabled; }
+
+    inline bool isInFrame() const { return _isInFrame; }
+
+    // also resets the driver statistics so counters taken from them cover the frame
+    void beginFrame();
+
+    void endFrame();
+
+    // GPU scopes cannot nest, a GPU scope inside another is timed on the CPU only.
+    // Names are copied only while a frame is recorded
+    void beginScope(const char *name, bool isGpuTimed = false);
+
+    void endScope();
+
+    // the last value set in a frame is kept
+    void setCounter(const char *name, double value);
+
+    // completed frames, oldest first
+    inline const std::deque<ProfilerFrame> &getFrames() const { return _frames; }
+
+    // writes the frames in the history as a trace for chrome://tracing or Perfetto
+    bool exportChromeTrace(const std::string &file) const;
+
+    static const std::size_t MAX_FRAMES;
+
+private:
+    double now() const;
+
+    void resolveGpuTimes(const std::vector<std::uint64_t> &elapsedTimes);
+
+    // events timed by the queries of a pool, in issue order
+    struct PendingQueries {
+        std::size_t frameIndex = 0;
+        std::vector<std::size_t> events;
+    };
+
+    GLDriver *_driver;
+    bool _isEnabled;
+    bool _isInFrame;
+    std::chrono::steady_clock::time_point _start;
+    std::size_t _nextFrameIndex;
+    ProfilerFrame _frame;
+    std::vector<std::size_t> _openScopes;
+    std::size_t _gpuScope;
+    std::array<PendingQueries, 2> _pendingQueries;
+    std::size_t _pendingPool;
+    std::deque<ProfilerFrame> _frames;
+};
+
+
+// profiles the enclosing block, does nothing outside a recorded frame
+class ProfilerScope {
+public:
+    ProfilerScope(Profiler &profiler, const char *name, bool isGpuTimed = false)
+        : _profiler{profiler}, _isRecorded{profiler.isInFrame()}
+    {
+        if (_isRecorded)
+            _profiler.beginScope(name, isGpuTimed);
+    }
+
+    ProfilerScope(const ProfilerScope &) = delete;
+
+    ProfilerScope &operator=(const ProfilerScope &) = delete;
+
+    ~ProfilerScope() {
+        if (_isRecorded)
+            _profiler.endScope();
+    }
+
+private:
+    Profiler &_profiler;
+    bool _isRecorded;
+};
+
+#endif // PROFILER_H
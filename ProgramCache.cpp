@@ -0,0 +1,91 @@
+#include <cstring>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include "ProgramCache.h"
+
+
+/***************************************************
+ * ProgramCache definitions
+ ***************************************************/
+const char ProgramCache::MAGIC[8] = {'P', 'R', 'O', 'G', 'B', 'I', 'N', 'S'};
+const std::uint32_t ProgramCache::VERSION = 1;
+
+
+std::string ProgramCache::createKey(const std::string &driverIdentity,
+                                    const std::vector<std::pair<unsigned, std::string>> &shaders)
+{
+    // sizes separate the fields, so no two inputs hash the same bytes
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    auto addField = [&hash](const void *data, std::size_t size) {
+        auto fieldSize = static_cast<std::uint64_t>(size);
+        hash.addData(reinterpret_cast<const char*>(&fieldSize), static_cast<int>(sizeof(fieldSize)));
+        hash.addData(static_cast<const char*>(data), static_cast<int>(size));
+    };
+
+    addField(driverIdentity.data(), driverIdentity.size());
+    for (const auto &shader : shaders) {
+        addField(&shader.first, sizeof(shader.first));
+        addField(shader.second.data(), shader.second.size());
+    }
+
+    return hash.result().toHex().toStdString();
+}
+
+
+bool ProgramCache::read(const std::string &key, unsigned &binaryFormat, std::vector<char> &binary) const {
+    QFile cacheFile(QString::fromStdString(getCachePath(key)));
+    if (!cacheFile.open(QIODevice::ReadOnly))
+        return false;
+
+    auto size = cacheFile.size();
+    auto data = cacheFile.map(0, size);
+    if (!data)
+        return false;
+
+    Header header;
+    bool isValid = static_cast<std::size_t>(size) >= sizeof(Header);
+    if (isValid) {
+        std::memcpy(&header, data, sizeof(Header));
+        isValid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                  header.version == VERSION &&
+                  header.binarySize == static_cast<std::uint64_t>(size) - sizeof(Header);
+    }
+
+    if (isValid) {
+        binaryFormat = header.binaryFormat;
+        binary.assign(data + sizeof(Header), data + size);
+    }
+
+    cacheFile.unmap(data);
+    return isValid;
+}
+
+
+bool ProgramCache::write(const std::string &key, unsigned binaryFormat, const std::vector<char> &binary) const {
+    if (!QDir().mkpath(QString::fromStdString(_directory)))
+        return false;
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.binaryFormat = binaryFormat;
+    header.binarySize = static_cast<std::uint64_t>(binary.size());
+
+    // written to a temporary file and renamed on commit so readers never see a partial binary
+    QSaveFile cacheFile(QString::fromStdString(getCachePath(key)));
+    if (!cacheFile.open(QIODevice::WriteOnly))
+        return false;
+
+    auto binarySize = static_cast<qint64>(binary.size());
+    bool isGood = cacheFile.write(reinterpret_cast<const char*>(&header), sizeof(Header)) == static_cast<qint64>(sizeof(Header)) &&
+                  cacheFile.write(binary.data(), binarySize) == binarySize;
+
+    return isGood && cacheFile.commit();
+}
+
+
+std::string ProgramCache::getCachePath(const std::string &key) const {
+    return QDir(QString::fromStdString(_directory)).filePath(QString::fromStdString(key + ".programcache")).toStdString();
+}
@@ -0,0 +1,49 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/***************************************************
+ * On disk cache of linked program binaries, one file per
+ * program in the cache directory. Files are named after a
+ * hash of the driver vendor, renderer and version and of
+ * the shader stages and sources, so a driver update or an
+ * edited shader misses the cache. A binary the driver
+ * rejects is replaced by the next compilation
+ ***************************************************/
+class ProgramCache {
+public:
+    // an empty directory disables the cache
+    inline void setDirectory(const std::string &directory) { _directory = directory; }
+
+    inline bool isEnabled() const { return !_directory.empty(); }
+
+    static std::string createKey(const std::string &driverIdentity,
+                                 const std::vector<std::pair<unsigned, std::string>> &shaders);
+
+    // fails when the binary is missing or malformed
+    bool read(const std::string &key, unsigned &binaryFormat, std::vector<char> &binary) const;
+
+    bool write(const std::string &key, unsigned binaryFormat, const std::vector<char> &binary) const;
+
+private:
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t binaryFormat;
+        std::uint64_t binarySize;
+    };
+
+    std::string getCachePath(const std::string &key) const;
+
+    static const char MAGIC[8];
+    static const std::uint32_t VERSION;
+
+    std::string _directory;
+};
+
+#endif // PROGRAMCACHE_H
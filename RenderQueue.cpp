@@ -0,0 +1,139 @@
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <QDebug>
+#include "RenderQueue.h"
+
+
+/***************************************************
+ * SortKeyIdPool definitions
+ ***************************************************/
+SortKeyIdPool::SortKeyIdPool(unsigned limit)
+    : _limit{limit}, _next{0}, _numOfOverflows{0}
+{
+    assert(limit > 0 && "SORT KEY ID LIMIT MUST BE POSITIVE");
+}
+
+
+unsigned SortKeyIdPool::acquire() {
+    if (!_freeIds.empty()) {
+        auto id = _freeIds.back();
+        _freeIds.pop_back();
+        return id;
+    }
+
+    // the last id is kept back for sharing, so release can tell it apart
+    if (_next < _limit - 1)
+        return _next++;
+
+#ifndef NDEBUG
+    if (_numOfOverflows == 0)
+        qDebug() << "Sort key ids exhausted, further holders share id" << _limit - 1;
+#endif
+
+    ++_numOfOverflows;
+    return _limit - 1;
+}
+
+
+void SortKeyIdPool::release(unsigned id) {
+    if (id == _limit - 1) {
+        assert(_numOfOverflows > 0 && "SHARED SORT KEY ID RELEASED TOO OFTEN");
+        --_numOfOverflows;
+        return;
+    }
+
+    _freeIds.push_back(id);
+}
+
+
+/***************************************************
+ * RenderQueue definitions
+ ***************************************************/
+const unsigned RenderQueue::OPAQUE_PASS = 0;
+const unsigned RenderQueue::MAX_EFFECTS = 1u << 8;
+const unsigned RenderQueue::MAX_EFFECT_PROPERTIES = 1u << 16;
+
+
+std::uint64_t RenderQueue::createKey(unsigned pass,
+                                     unsigned effectId,
+                                     unsigned effectPropertyId,
+                                     unsigned vaoId,
+                                     float viewDepth)
+{
+    // positive floats keep their order when compared as integers.
+    // Drop the sign bit and keep the 20 most significant bits
+    std::uint32_t depthBits = 0;
+    if (viewDepth > 0.0f)
+        std::memcpy(&depthBits, &viewDepth, sizeof(depthBits));
+
+    std::uint64_t key = 0;
+    key |= static_cast<std::uint64_t>(pass & 0xF) << 60;
+    key |= static_cast<std::uint64_t>(effectId & 0xFF) << 52;
+    key |= static_cast<std::uint64_t>(vaoId & 0xFFFF) << 36;
+    key |= static_cast<std::uint64_t>(effectPropertyId & 0xFFFF) << 20;
+    key |= static_cast<std::uint64_t>(depthBits >> 11) & 0xFFFFF;
+    return key;
+}
+
+
+void RenderQueue::clear() {
+    _entries.clear();
+    _pointLights.clear();
+}
+
+
+void RenderQueue::pushDrawable(std::uint64_t key, Effect *effect, Drawable *drawable) {
+    _entries.push_back({key, effect, drawable});
+}
+
+
+void RenderQueue::pushPointLight(PointLight *pointLight) {
+    _pointLights.push_back(pointLight);
+}
+
+
+void RenderQueue::sort() {
+    // LSD radix sort on 8 bits digits. All histograms are built in one sweep
+    // and passes where every key shares the same digit are skipped
+    constexpr std::size_t NUM_OF_PASSES = sizeof(std::uint64_t);
+    constexpr std::size_t NUM_OF_BUCKETS = 256;
+    std::array<std::array<std::size_t, NUM_OF_BUCKETS>, NUM_OF_PASSES> histograms{};
+
+    for (const auto &entry : _entries) {
+        for (std::size_t pass = 0; pass < NUM_OF_PASSES; ++pass) {
+            ++histograms[pass][(entry.key >> (pass * 8)) & 0xFF];
+        }
+    }
+
+    _sortBuffer.resize(_entries.size());
+    for (std::size_t pass = 0; pass < NUM_OF_PASSES; ++pass) {
+        auto &histogram = histograms[pass];
+        std::size_t firstDigit = (_entries.empty() ? 0 : (_entries.front().key >> (pass * 8)) & 0xFF);
+        if (histogram[firstDigit] == _entries.size())
+            continue;
+
+        std::size_t offset = 0;
+        for (auto &count : histogram) {
+            std::size_t bucketSize = count;
+            count = offset;
+            offset += bucketSize;
+        }
+
+        for (const auto &entry : _entries) {
+            _sortBuffer[histogram[(entry.key >> (pass * 8)) & 0xFF]++] = entry;
+        }
+
+        _entries.swap(_sortBuffer);
+    }
+}
+
+
+const std::vector<Drawable *> &RenderQueue::getBatch(std::size_t begin, std::size_t end) {
+    _batch.clear();
+    for (std::size_t i = begin; i < end; ++i) {
+        _batch.push_back(_entries[i].drawable);
+    }
+
+    return _batch;
+}
@@ -0,0 +1,91 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+class Effect;
+class Drawable;
+class PointLight;
+
+
+/***************************************************
+ * Hands out ids below a limit and reuses released ones, so
+ * the ids packed into sort keys stay unique while effects
+ * and materials come and go. Once exhausted the last id is
+ * shared, which only costs their holders the batching
+ ***************************************************/
+class SortKeyIdPool {
+public:
+    explicit SortKeyIdPool(unsigned limit);
+
+    SortKeyIdPool(const SortKeyIdPool &) = delete;
+
+    SortKeyIdPool &operator=(const SortKeyIdPool &) = delete;
+
+    unsigned acquire();
+
+    void release(unsigned id);
+
+    // holders of the shared id
+    inline unsigned getNumOfOverflows() const { return _numOfOverflows; }
+
+private:
+    unsigned _limit;
+    unsigned _next;
+    unsigned _numOfOverflows;
+    std::vector<unsigned> _freeIds;
+};
+
+
+
+/***************************************************
+ * Flat list of draw requests ordered by 64 bits sort key:
+ * | pass 4 | effect 8 | vao 16 | effect property 16 | depth 20 |
+ * The vao comes before the effect property so meshes packed
+ * into one shared vertex array stay contiguous for multi draw.
+ * Storage is kept between frames so that filling and sorting
+ * the queue does not allocate once warmed up
+ ***************************************************/
+class RenderQueue {
+public:
+    struct Entry {
+        std::uint64_t key;
+        Effect *effect;
+        Drawable *drawable;
+    };
+
+    static const unsigned OPAQUE_PASS;
+
+    // number of ids the sort key has room for
+    static const unsigned MAX_EFFECTS;
+    static const unsigned MAX_EFFECT_PROPERTIES;
+
+    static std::uint64_t createKey(unsigned pass,
+                                   unsigned effectId,
+                                   unsigned effectPropertyId,
+                                   unsigned vaoId,
+                                   float viewDepth);
+
+    void clear();
+
+    void pushDrawable(std::uint64_t key, Effect *effect, Drawable *drawable);
+
+    void pushPointLight(PointLight *pointLight);
+
+    void sort();
+
+    inline const std::vector<Entry> &getEntries() const { return _entries; }
+
+    inline const std::vector<PointLight *> &getPointLights() const { return _pointLights; }
+
+    const std::vector<Drawable *> &getBatch(std::size_t begin, std::size_t end);
+
+private:
+    std::vector<Entry> _entries;
+    std::vector<Entry> _sortBuffer;
+    std::vector<Drawable *> _batch;
+    std::vector<PointLight *> _pointLights;
+};
+
+#endif // RENDERQUEUE_H
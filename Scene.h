@@ -3,18 +3,26 @@
 
 #include <variant>
 #include <vector>
+#include <limits>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <QObject>
 #include <GLDriver.h>
 
 
-/***************************************************************
- * BasicNode definitions
- ***************************************************************/
+// per drawable type hook invoked by Node::draw and NodeHandle::draw
 template<typename T>
 class NodeAction;
 
+
+/***************************************************************
+ * Node definitions
+ *
+ * Pointer tree scene store, selected over FlatScene by building
+ * with SCENE_NODE_TREE. Local and world transformations are cached
+ * and only rebuilt when a node or one of its ancestors changed
+ ***************************************************************/
 template <class T>
 class Node {
 public:
@@ -26,12 +34,23 @@ public:
     {}
 
     explicit Node(T drawable)
-        : _position{0.0f}, _scale{1.0f}, _rotation{1.0f, 0.0f, 0.0f, 0.0f}, _drawable{std::move(drawable)}, _parent{nullptr}
+        : _position{0.0f}, _scale{1.0f}, _rotation{1.0f, 0.0f, 0.0f, 0.0f},
+        _localTransformation{1.0f}, _worldTransformation{1.0f},
+        _isLocalDirty{true}, _isWorldDirty{true},
+        _drawable{std::move(drawable)}, _parent{nullptr}
     {}
 
     Node(const Node &other) = delete;
 
-    Node(Node &&other) = default;
+    // children point back to the moved node, which also keeps them valid when a child vector reallocates
+    Node(Node &&other) noexcept
+        : _position{other._position}, _scale{other._scale}, _rotation{other._rotation},
+        _localTransformation{other._localTransformation}, _worldTransformation{other._worldTransformation},
+        _isLocalDirty{other._isLocalDirty}, _isWorldDirty{other._isWorldDirty},
+        _drawable{std::move(other._drawable)}, _children{std::move(other._children)}, _parent{other._parent}
+    {
+        adoptChildren();
+    }
 
     Node &operator=(const Node &other) = delete;
 
@@ -48,6 +67,12 @@ public:
         swap(_rotation, other._rotation);
         swap(_position, other._position);
         swap(_scale, other._scale);
+        swap(_localTransformation, other._localTransformation);
+        swap(_worldTransformation, other._worldTransformation);
+        swap(_isLocalDirty, other._isLocalDirty);
+        swap(_isWorldDirty, other._isWorldDirty);
+        adoptChildren();
+        other.adoptChildren();
     }
 
     inline T &getDrawable() { return _drawable; }
@@ -60,14 +85,50 @@ public:
 
     inline glm::quat rotation() const { return _rotation; }
 
-    inline glm::vec3 &position() { return _position; }
+    // non const accessors are treated as mutations and invalidate the cached transformation
+    inline glm::vec3 &position() {
+        _isLocalDirty = true;
+        return _position;
+    }
+
+    inline glm::vec3 &scale() {
+        _isLocalDirty = true;
+        return _scale;
+    }
 
-    inline glm::vec3 &scale() { return _scale; }
+    inline glm::quat &rotation() {
+        _isLocalDirty = true;
+        return _rotation;
+    }
+
+    inline const glm::mat4 &getLocalTransformation() {
+        if (_isLocalDirty) {
+            _localTransformation = glm::scale(glm::mat4(1.0f), _scale) * glm::mat4_cast(_rotation);
+            _localTransformation = glm::translate(_localTransformation, _position);
+            _isLocalDirty = false;
+            _isWorldDirty = true;
+        }
 
-    inline glm::quat &rotation() { return _rotation; }
+        return _localTransformation;
+    }
+
+    inline const glm::mat4 &getWorldTransformation() const { return _worldTransformation; }
+
+    // recompute the world transformation if this node or one of its ancestors changed.
+    // The return value is passed down to the children as isParentChanged
+    inline bool updateWorldTransformation(const glm::mat4 &parentTransformation, bool isParentChanged) {
+        const auto &localTransformation = getLocalTransformation();
+        if (!isParentChanged && !_isWorldDirty)
+            return false;
+
+        _worldTransformation = parentTransformation * localTransformation;
+        _isWorldDirty = false;
+        return true;
+    }
 
     inline void setParent(Node *parent) {
         _parent = parent;
+        _isWorldDirty = true;
     }
 
     inline Node *getParent() { return _parent; }
@@ -112,12 +173,394 @@ public:
     }
 
 private:
+    inline void adoptChildren() {
+        for (auto &child : _children) {
+            child._parent = this;
+        }
+    }
+
     glm::vec3 _position;
     glm::vec3 _scale;
     glm::quat _rotation;
+    glm::mat4 _localTransformation;
+    glm::mat4 _worldTransformation;
+    bool _isLocalDirty;
+    bool _isWorldDirty;
     T _drawable;
     std::vector<Node> _children;
     Node *_parent;
 };
 
+
+/***************************************************************
+ * FlatScene definitions
+ *
+ * Default scene store keeping node data in contiguous arrays ordered by
+ * depth, so that parents always come before their children and the
+ * world transformation update is a single linear sweep. Nodes are
+ * referenced through NodeHandle.
+ * References returned by a handle are invalidated when nodes are
+ * added or removed
+ ***************************************************************/
+template<typename T>
+class FlatScene {
+public:
+    static constexpr unsigned INVALID = std::numeric_limits<unsigned>::max();
+
+    class ChildIterator;
+
+    class NodeHandle {
+    public:
+        NodeHandle()
+            : _scene{nullptr}, _id{INVALID}, _generation{0}
+        {}
+
+        NodeHandle(FlatScene *scene, unsigned id)
+            : _scene{scene}, _id{id}, _generation{scene->_generations[id]}
+        {}
+
+        // ids are recycled, the generation tells apart handles to removed nodes
+        inline bool isValid() const {
+            return _scene && _id != INVALID && _scene->_generations[_id] == _generation && _scene->_idToIndex[_id] != INVALID;
+        }
+
+        inline unsigned getId() const { return _id; }
+
+        inline T &getDrawable() { return _scene->_drawables[index()]; }
+
+        inline const T &getDrawable() const { return _scene->_drawables[index()]; }
+
+        inline glm::vec3 position() const { return _scene->_positions[index()]; }
+
+        inline glm::vec3 scale() const { return _scene->_scales[index()]; }
+
+        inline glm::quat rotation() const { return _scene->_rotations[index()]; }
+
+        // non const accessors are treated as mutations and invalidate the cached transformation
+        inline glm::vec3 &position() {
+            auto idx = index();
+            _scene->_isLocalDirty[idx] = true;
+            return _scene->_positions[idx];
+        }
+
+        inline glm::vec3 &scale() {
+            auto idx = index();
+            _scene->_isLocalDirty[idx] = true;
+            return _scene->_scales[idx];
+        }
+
+        inline glm::quat &rotation() {
+            auto idx = index();
+            _scene->_isLocalDirty[idx] = true;
+            return _scene->_rotations[idx];
+        }
+
+        inline const glm::mat4 &getWorldTransformation() const { return _scene->_worldTransformations[index()]; }
+
+        inline NodeHandle getParent() const {
+            auto parentIdx = _scene->_parents[index()];
+            if (parentIdx == INVALID)
+                return {};
+
+            return {_scene, _scene->_indexToId[parentIdx]};
+        }
+
+        inline ChildIterator childBegin() { return {_scene, _scene->_children[_id].begin()}; }
+
+        inline ChildIterator childEnd() { return {_scene, _scene->_children[_id].end()}; }
+
+        inline NodeHandle emplaceChild(T drawable) {
+            return _scene->createNode(_id, std::move(drawable));
+        }
+
+        inline ChildIterator removeChild(ChildIterator pos) {
+            return _scene->removeChild(_id, pos);
+        }
+
+        inline void clearChild() {
+            auto child = childBegin();
+            while (child != childEnd())
+                child = removeChild(child);
+        }
+
+        template<typename... Args>
+        void draw(Args&&... args) {
+            NodeAction<T>::draw(*this, std::forward<Args>(args)...);
+        }
+
+    private:
+        friend class FlatScene;
+
+        inline unsigned index() const { return _scene->_idToIndex[_id]; }
+
+        FlatScene *_scene;
+        unsigned _id;
+        unsigned _generation;
+    };
+
+    class ChildIterator {
+    public:
+        struct ArrowProxy {
+            NodeHandle handle;
+            inline NodeHandle *operator->() { return &handle; }
+        };
+
+        ChildIterator(FlatScene *scene, std::vector<unsigned>::iterator it)
+            : _scene{scene}, _it{it}
+        {}
+
+        inline NodeHandle operator*() const { return {_scene, *_it}; }
+
+        inline ArrowProxy operator->() const { return {**this}; }
+
+        inline ChildIterator &operator++() {
+            ++_it;
+            return *this;
+        }
+
+        inline bool operator==(const ChildIterator &other) const { return _it == other._it; }
+
+        inline bool operator!=(const ChildIterator &other) const { return _it != other._it; }
+
+    private:
+        friend class FlatScene;
+
+        FlatScene *_scene;
+        std::vector<unsigned>::iterator _it;
+    };
+
+    FlatScene()
+        : _numOfRoots{0}, _structureVersion{0}, _isOrderDirty{false}
+    {}
+
+    FlatScene(const FlatScene &) = delete;
+
+    FlatScene &operator=(const FlatScene &) = delete;
+
+    inline NodeHandle createRoot(T drawable) {
+        ++_numOfRoots;
+        return createNode(INVALID, std::move(drawable));
+    }
+
+    inline std::size_t size() const { return _drawables.size(); }
+
+    inline std::size_t getNumOfRoots() const { return _numOfRoots; }
+
+    // incremented whenever nodes are created or removed, array indices stay valid while it does not change
+    inline std::size_t getStructureVersion() const { return _structureVersion; }
+
+    inline T &drawableAt(std::size_t idx) { return _drawables[idx]; }
+
+    inline const glm::mat4 &worldTransformationAt(std::size_t idx) const { return _worldTransformations[idx]; }
+
+    inline bool isChangedAt(std::size_t idx) const { return _isChanged[idx]; }
+
+    // indices whose world transformation changed in the last updateTransformations()
+    inline const std::vector<unsigned> &getChangedIndices() const { return _changedIndices; }
+
+    // sweep the arrays once, parents are guaranteed to be updated before their children
+    void updateTransformations() {
+        if (_isOrderDirty)
+            reorder();
+
+        _changedIndices.clear();
+        for (std::size_t i = 0; i < _drawables.size(); ++i) {
+            bool isChanged = _isLocalDirty[i];
+            if (isChanged) {
+                _localTransformations[i] = glm::scale(glm::mat4(1.0f), _scales[i]) * glm::mat4_cast(_rotations[i]);
+                _localTransformations[i] = glm::translate(_localTransformations[i], _positions[i]);
+                _isLocalDirty[i] = false;
+            }
+
+            auto parent = _parents[i];
+            if (parent == INVALID) {
+                if (isChanged)
+                    _worldTransformations[i] = _localTransformations[i];
+            }
+            else if (isChanged || _isChanged[parent]) {
+                _worldTransformations[i] = _worldTransformations[parent] * _localTransformations[i];
+                isChanged = true;
+            }
+
+            _isChanged[i] = isChanged;
+            if (isChanged)
+                _changedIndices.push_back(static_cast<unsigned>(i));
+        }
+    }
+
+    // visit the array index of every node in the subtree, parents before children
+    template<typename Func>
+    void forEachInSubtree(const NodeHandle &node, Func &&func) {
+        if (_isOrderDirty)
+            reorder();
+
+        if (_numOfRoots == 1 && _parents[node.index()] == INVALID) {
+            for (std::size_t i = 0; i < _drawables.size(); ++i)
+                func(i);
+            return;
+        }
+
+        _traversalStack.clear();
+        _traversalStack.push_back(node.getId());
+        while (!_traversalStack.empty()) {
+            auto id = _traversalStack.back();
+            _traversalStack.pop_back();
+            func(static_cast<std::size_t>(_idToIndex[id]));
+
+            const auto &children = _children[id];
+            _traversalStack.insert(_traversalStack.end(), children.rbegin(), children.rend());
+        }
+    }
+
+private:
+    NodeHandle createNode(unsigned parentId, T drawable) {
+        unsigned parentIdx = parentId == INVALID ? INVALID : _idToIndex[parentId];
+        unsigned depth = parentIdx == INVALID ? 0 : _depths[parentIdx] + 1;
+        if (!_depths.empty() && depth < _depths.back())
+            _isOrderDirty = true;
+        ++_structureVersion;
+
+        unsigned id;
+        if (!_freeIds.empty()) {
+            id = _freeIds.back();
+            _freeIds.pop_back();
+        }
+        else {
+            id = static_cast<unsigned>(_idToIndex.size());
+            _idToIndex.push_back(INVALID);
+            _generations.push_back(0);
+            _children.emplace_back();
+        }
+
+        _idToIndex[id] = static_cast<unsigned>(_drawables.size());
+        _positions.emplace_back(0.0f);
+        _scales.emplace_back(1.0f);
+        _rotations.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+        _localTransformations.emplace_back(1.0f);
+        _worldTransformations.emplace_back(1.0f);
+        _parents.push_back(parentIdx);
+        _depths.push_back(depth);
+        _isLocalDirty.push_back(true);
+        _isChanged.push_back(true);
+        _indexToId.push_back(id);
+        _drawables.push_back(std::move(drawable));
+
+        if (parentId != INVALID)
+            _children[parentId].push_back(id);
+
+        return {this, id};
+    }
+
+    ChildIterator removeChild(unsigned parentId, ChildIterator pos) {
+        // release the whole subtree. Array slots are compacted on the next reorder
+        _traversalStack.clear();
+        _traversalStack.push_back(*pos._it);
+        while (!_traversalStack.empty()) {
+            auto id = _traversalStack.back();
+            _traversalStack.pop_back();
+
+            auto idx = _idToIndex[id];
+            _drawables[idx] = T{};
+            _indexToId[idx] = INVALID;
+            _idToIndex[id] = INVALID;
+            ++_generations[id];
+            _freeIds.push_back(id);
+
+            auto &children = _children[id];
+            _traversalStack.insert(_traversalStack.end(), children.begin(), children.end());
+            children.clear();
+        }
+
+        _isOrderDirty = true;
+        ++_structureVersion;
+        return {this, _children[parentId].erase(pos._it)};
+    }
+
+    template<typename U>
+    static void permute(std::vector<U> &values, const std::vector<unsigned> &newIndices, std::size_t newSize) {
+        std::vector<U> permuted(newSize);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            if (newIndices[i] != INVALID)
+                permuted[newIndices[i]] = std::move(values[i]);
+        }
+
+        values.swap(permuted);
+    }
+
+    // drop removed slots and stable sort the remaining nodes by depth
+    void reorder() {
+        // depth of live nodes is still valid because a node is removed together with its subtree
+        std::vector<std::size_t> depthOffsets;
+        for (std::size_t i = 0; i < _depths.size(); ++i) {
+            if (_indexToId[i] == INVALID)
+                continue;
+
+            if (_depths[i] >= depthOffsets.size())
+                depthOffsets.resize(_depths[i] + 1, 0);
+            ++depthOffsets[_depths[i]];
+        }
+
+        std::size_t newSize = 0;
+        for (auto &offset : depthOffsets) {
+            std::size_t count = offset;
+            offset = newSize;
+            newSize += count;
+        }
+
+        std::vector<unsigned> newIndices(_depths.size(), INVALID);
+        for (std::size_t i = 0; i < _depths.size(); ++i) {
+            if (_indexToId[i] != INVALID)
+                newIndices[i] = static_cast<unsigned>(depthOffsets[_depths[i]]++);
+        }
+
+        for (auto &parent : _parents) {
+            if (parent != INVALID)
+                parent = newIndices[parent];
+        }
+
+        permute(_positions, newIndices, newSize);
+        permute(_scales, newIndices, newSize);
+        permute(_rotations, newIndices, newSize);
+        permute(_localTransformations, newIndices, newSize);
+        permute(_worldTransformations, newIndices, newSize);
+        permute(_parents, newIndices, newSize);
+        permute(_depths, newIndices, newSize);
+        permute(_isLocalDirty, newIndices, newSize);
+        permute(_isChanged, newIndices, newSize);
+        permute(_indexToId, newIndices, newSize);
+        permute(_drawables, newIndices, newSize);
+
+        for (std::size_t i = 0; i < newSize; ++i) {
+            _idToIndex[_indexToId[i]] = static_cast<unsigned>(i);
+        }
+
+        _isOrderDirty = false;
+    }
+
+    // hot data indexed by depth order
+    std::vector<glm::vec3> _positions;
+    std::vector<glm::vec3> _scales;
+    std::vector<glm::quat> _rotations;
+    std::vector<glm::mat4> _localTransformations;
+    std::vector<glm::mat4> _worldTransformations;
+    std::vector<unsigned> _parents;
+    std::vector<unsigned> _depths;
+    std::vector<unsigned char> _isLocalDirty;
+    std::vector<unsigned char> _isChanged;
+    std::vector<unsigned> _indexToId;
+    std::vector<T> _drawables;
+
+    // cold data indexed by handle id
+    std::vector<unsigned> _idToIndex;
+    std::vector<unsigned> _generations;
+    std::vector<std::vector<unsigned>> _children;
+    std::vector<unsigned> _freeIds;
+
+    std::vector<unsigned> _changedIndices;
+    std::vector<unsigned> _traversalStack;
+    std::size_t _numOfRoots;
+    std::size_t _structureVersion;
+    bool _isOrderDirty;
+};
+
 #endif // SCENE_H
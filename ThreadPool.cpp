@@ -0,0 +1,46 @@
+#include "ThreadPool.h"
+
+
+/***************************************************
+ * ThreadPool definitions
+ ***************************************************/
+ThreadPool::ThreadPool(std::size_t numOfThreads)
+    : _isStopping{false}
+{
+    for (std::size_t i = 0; i < numOfThreads; ++i) {
+        _threads.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _isStopping = true;
+    }
+
+    _condition.notify_all();
+    for (auto &thread : _threads) {
+        thread.join();
+    }
+}
+
+
+void ThreadPool::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this]() { return _isStopping || !_tasks.empty(); });
+
+            // queued tasks are drained before stopping so their futures are satisfied
+            if (_tasks.empty())
+                return;
+
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+
+        task();
+    }
+}
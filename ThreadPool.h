@@ -0,0 +1,109 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+/***************************************************
+ * Fixed set of worker threads consuming a FIFO task queue.
+ * Tasks must not touch GL, the context is owned by the GUI thread
+ ***************************************************/
+class ThreadPool {
+public:
+    explicit ThreadPool(std::size_t numOfThreads = std::max(1u, std::thread::hardware_concurrency()));
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool();
+
+    inline std::size_t size() const { return _threads.size(); }
+
+    template<typename Func>
+    std::future<std::invoke_result_t<Func>> submit(Func &&func) {
+        using Result = std::invoke_result_t<Func>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+        auto future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.emplace_back([task]() { (*task)(); });
+        }
+
+        _condition.notify_one();
+        return future;
+    }
+
+    // calls func(i) for every i in [0, count) and waits for all of them. Indices are handed
+    // out one at a time so uneven work balances. The calling thread works too and only waits
+    // for indices already taken, so it is safe to call from a task of the same pool
+    template<typename Func>
+    void parallelFor(std::size_t count, Func &&func) {
+        if (count == 0)
+            return;
+
+        struct State {
+            std::atomic<std::size_t> next{0};
+            std::size_t numOfDone = 0;
+            std::exception_ptr exception;
+            std::mutex mutex;
+            std::condition_variable condition;
+        };
+
+        // helpers starting after every index is taken return without touching func
+        auto state = std::make_shared<State>();
+        auto work = [state, count, &func]() {
+            std::size_t i;
+            while ((i = state->next.fetch_add(1)) < count) {
+                std::exception_ptr exception;
+                try {
+                    func(i);
+                }
+                catch (...) {
+                    exception = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (exception && !state->exception)
+                    state->exception = exception;
+
+                if (++state->numOfDone == count)
+                    state->condition.notify_all();
+            }
+        };
+
+        std::size_t numOfHelpers = std::min(size(), count - 1);
+        for (std::size_t i = 0; i < numOfHelpers; ++i) {
+            submit(work);
+        }
+
+        work();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->condition.wait(lock, [&]() { return state->numOfDone == count; });
+        if (state->exception)
+            std::rethrow_exception(state->exception);
+    }
+
+private:
+    void run();
+
+    std::vector<std::thread> _threads;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    bool _isStopping;
+};
+
+#endif // THREADPOOL_H
@@ -1,5 +1,4 @@
 #include <fstream>
-#include <sstream>
 #include <glm/gtc/epsilon.hpp>
 #include "Utility.h"
 
@@ -10,8 +9,14 @@ bool equals(float x, float y) {
 
 
 std::string readTextFile(const std::string &file) {
-    std::ifstream t(file);
-    std::stringstream buffer;
-    buffer << t.rdbuf();
-    return buffer.str();
+    // read straight into a string of the file size instead of going through a stream buffer
+    std::ifstream t(file, std::ios::binary | std::ios::ate);
+    if (!t)
+        return "";
+
+    std::string content(static_cast<std::size_t>(t.tellg()), '\0');
+    t.seekg(0);
+    t.read(content.data(), static_cast<std::streamsize>(content.size()));
+    content.resize(static_cast<std::size_t>(t.gcount()));
+    return content;
 }
@@ -0,0 +1,215 @@
+#include <cstring>
+#include <QOpenGLFunctions_4_2_Core>
+#include "VertexFormat.h"
+
+
+/***************************************************
+ * VertexFormat definitions
+ ***************************************************/
+int VertexFormat::getPositionSize() const {
+    switch (position) {
+    case Position::FLOAT:
+        return 3 * sizeof(float);
+    case Position::HALF_FLOAT:
+    case Position::UNORM16:
+        return 4 * sizeof(std::uint16_t);
+    }
+
+    return 0;
+}
+
+
+int VertexFormat::getNormalSize() const {
+    switch (normal) {
+    case Normal::FLOAT:
+        return 3 * sizeof(float);
+    case Normal::OCTAHEDRAL:
+        return 2 * sizeof(std::int16_t);
+    }
+
+    return 0;
+}
+
+
+int VertexFormat::getVertexSize() const {
+    return getPositionSize() + getNormalSize();
+}
+
+
+VertexAttribute VertexFormat::getPositionAttribute() const {
+    int stride = isInterleaved ? getVertexSize() : getPositionSize();
+    switch (position) {
+    case Position::FLOAT:
+        return {3, GL_FLOAT, false, stride, 0};
+    case Position::HALF_FLOAT:
+        return {3, GL_HALF_FLOAT, false, stride, 0};
+    case Position::UNORM16:
+        return {3, GL_UNSIGNED_SHORT, true, stride, 0};
+    }
+
+    return {};
+}
+
+
+VertexAttribute VertexFormat::getNormalAttribute() const {
+    int stride = isInterleaved ? getVertexSize() : getNormalSize();
+    int offset = isInterleaved ? getPositionSize() : 0;
+    switch (normal) {
+    case Normal::FLOAT:
+        return {3, GL_FLOAT, false, stride, offset};
+    case Normal::OCTAHEDRAL:
+        return {2, GL_SHORT, true, stride, offset};
+    }
+
+    return {};
+}
+
+
+EncodedVertices VertexFormat::encode(const std::vector<glm::vec3> &positions,
+                                     const std::vector<glm::vec3> &normals,
+                                     const BoundingBox &boundingBox) const
+{
+    EncodedVertices encoded;
+    encoded.decodeMatrix = glm::mat4(1.0f);
+
+    // quantization grid spans the bounding box
+    glm::vec3 origin{0.0f};
+    glm::vec3 extent{0.0f};
+    if (position == Position::UNORM16 && !boundingBox.isEmpty()) {
+        origin = boundingBox.min;
+        extent = boundingBox.max - boundingBox.min;
+        encoded.decodeMatrix[0][0] = extent.x;
+        encoded.decodeMatrix[1][1] = extent.y;
+        encoded.decodeMatrix[2][2] = extent.z;
+        encoded.decodeMatrix[3] = glm::vec4(origin, 1.0f);
+    }
+
+    bool hasNormals = normals.size() == positions.size();
+    int positionSize = getPositionSize();
+    int normalSize = getNormalSize();
+    int positionStride = isInterleaved ? getVertexSize() : positionSize;
+    encoded.positions.resize(positions.size() * static_cast<std::size_t>(positionStride), 0);
+    if (!isInterleaved && hasNormals)
+        encoded.normals.resize(positions.size() * static_cast<std::size_t>(normalSize), 0);
+
+    for (std::size_t i = 0; i < positions.size(); ++i) {
+        unsigned char *vertex = encoded.positions.data() + i * static_cast<std::size_t>(positionStride);
+        const auto &p = positions[i];
+        switch (position) {
+        case Position::FLOAT:
+            std::memcpy(vertex, &p, sizeof(glm::vec3));
+            break;
+        case Position::HALF_FLOAT: {
+            std::uint16_t half[3] = {toHalf(p.x), toHalf(p.y), toHalf(p.z)};
+            std::memcpy(vertex, half, sizeof(half));
+            break;
+        }
+        case Position::UNORM16: {
+            std::uint16_t quantized[3];
+            for (int axis = 0; axis < 3; ++axis) {
+                float t = extent[axis] > 0.0f ? (p[axis] - origin[axis]) / extent[axis] : 0.0f;
+                quantized[axis] = static_cast<std::uint16_t>(glm::round(glm::clamp(t, 0.0f, 1.0f) * 65535.0f));
+            }
+
+            std::memcpy(vertex, quantized, sizeof(quantized));
+            break;
+        }
+        }
+
+        if (!hasNormals)
+            continue;
+
+        unsigned char *normal = isInterleaved ? vertex + positionSize
+                                              : encoded.normals.data() + i * static_cast<std::size_t>(normalSize);
+        const auto &n = normals[i];
+        switch (this->normal) {
+        case Normal::FLOAT:
+            std::memcpy(normal, &n, sizeof(glm::vec3));
+            break;
+        case Normal::OCTAHEDRAL: {
+            glm::vec2 octahedral = encodeOctahedral(n);
+            std::int16_t packed[2] = {static_cast<std::int16_t>(glm::round(octahedral.x * 32767.0f)),
+                                      static_cast<std::int16_t>(glm::round(octahedral.y * 32767.0f))};
+            std::memcpy(normal, packed, sizeof(packed));
+            break;
+        }
+        }
+    }
+
+    return encoded;
+}
+
+
+std::string VertexFormat::preprocessShader(const std::string &source) const {
+    std::string defines;
+    if (normal == Normal::OCTAHEDRAL)
+        defines += "#define OCTAHEDRAL_NORMALS\n";
+
+    if (defines.empty())
+        return source;
+
+    auto versionEnd = source.find('\n', source.find("#version"));
+    if (versionEnd == std::string::npos)
+        return defines + source;
+
+    return source.substr(0, versionEnd + 1) + defines + source.substr(versionEnd + 1);
+}
+
+
+std::uint16_t VertexFormat::toHalf(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    std::uint16_t sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+    std::uint32_t mantissa = bits & 0x007fffffu;
+    int exponent = static_cast<int>((bits >> 23) & 0xffu) - 127 + 15;
+
+    // nan and infinity
+    if (((bits >> 23) & 0xffu) == 0xffu)
+        return sign | 0x7c00u | (mantissa ? 0x200u : 0u);
+
+    // overflow becomes infinity
+    if (exponent >= 0x1f)
+        return sign | 0x7c00u;
+
+    // subnormal or zero, shift the implicit bit in and round to nearest
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return sign;
+
+        mantissa |= 0x00800000u;
+        int shift = 14 - exponent;
+        std::uint32_t half = mantissa >> shift;
+        std::uint32_t remainder = mantissa & ((1u << shift) - 1);
+        std::uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1u)))
+            ++half;
+
+        return sign | static_cast<std::uint16_t>(half);
+    }
+
+    // round to nearest even, a carry into the exponent is still correct
+    std::uint32_t half = (static_cast<std::uint32_t>(exponent) << 10) | (mantissa >> 13);
+    std::uint32_t remainder = mantissa & 0x1fffu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+        ++half;
+
+    return sign | static_cast<std::uint16_t>(half);
+}
+
+
+glm::vec2 VertexFormat::encodeOctahedral(glm::vec3 normal) {
+    float norm = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+    if (norm == 0.0f)
+        return glm::vec2(0.0f);
+
+    // project on the octahedron and fold the lower hemisphere over the diagonals
+    glm::vec2 projected = glm::vec2(normal.x, normal.y) / norm;
+    if (normal.z < 0.0f) {
+        glm::vec2 folded{(1.0f - glm::abs(projected.y)) * (projected.x >= 0.0f ? 1.0f : -1.0f),
+                         (1.0f - glm::abs(projected.x)) * (projected.y >= 0.0f ? 1.0f : -1.0f)};
+        projected = folded;
+    }
+
+    return projected;
+}
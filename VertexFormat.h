@@ -0,0 +1,84 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "BoundingVolume.h"
+
+
+struct VertexAttribute {
+    int size;
+    unsigned dataType;
+    bool normalized;
+    int stride;
+
+    // from the start of the vertex when interleaved, otherwise from the start of the attribute block
+    int offset;
+};
+
+
+// vertex data ready for upload. Interleaved formats only fill positions
+struct EncodedVertices {
+    std::vector<unsigned char> positions;
+    std::vector<unsigned char> normals;
+
+    // maps stored positions back to model space, identity unless positions are quantized
+    glm::mat4 decodeMatrix;
+};
+
+
+/***************************************************
+ * Storage of the position and normal attributes of a geometry.
+ * Quantized positions are unsigned normalized 16 bit values
+ * inside the bounding box of the mesh and are decoded through
+ * the model matrix. Octahedral normals are two signed normalized
+ * 16 bit values decoded in the vertex shader, which needs the
+ * defines from preprocessShader
+ ***************************************************/
+struct VertexFormat {
+    enum class Position {
+        FLOAT,
+        HALF_FLOAT,
+        UNORM16
+    };
+
+    enum class Normal {
+        FLOAT,
+        OCTAHEDRAL
+    };
+
+    // lossless by default, quantization is chosen with --vertex-format
+    Position position = Position::FLOAT;
+    Normal normal = Normal::FLOAT;
+    bool isInterleaved = true;
+
+    // 16 bit elements for standalone geometries with at most 65536 vertices
+    bool useShortElements = true;
+
+    // bytes per vertex, padded to 4 byte alignment
+    int getPositionSize() const;
+
+    int getNormalSize() const;
+
+    int getVertexSize() const;
+
+    VertexAttribute getPositionAttribute() const;
+
+    VertexAttribute getNormalAttribute() const;
+
+    // a missing normal is stored as zero
+    EncodedVertices encode(const std::vector<glm::vec3> &positions,
+                           const std::vector<glm::vec3> &normals,
+                           const BoundingBox &boundingBox) const;
+
+    // inserts the decoding defines after the #version line
+    std::string preprocessShader(const std::string &source) const;
+
+    static std::uint16_t toHalf(float value);
+
+    static glm::vec2 encodeOctahedral(glm::vec3 normal);
+};
+
+#endif // VERTEXFORMAT_H
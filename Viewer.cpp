@@ -37,11 +37,13 @@ void Viewer::initialize() {
     _cameraControlPlugin = std::make_unique<OrbitCameraPlugin>(this);
     _cameraProjectionPlugin = std::make_unique<PerspectiveCameraPlugin>(this);
     _importMeshFilePlugin = std::make_unique<ImportMeshFilePlugin>(this);
+    _occlusionCullingPlugin = std::make_unique<OcclusionCullingPlugin>(this);
+    _depthPrepassPlugin = std::make_unique<DepthPrepassPlugin>(this);
 
     // initialize scene
     auto &root = _context.getRoot();
     auto pointLight = _context.createDrawable<PointLight>(glm::vec3(2.0f), 1000.0f);
-    auto &lightNode = root.emplaceChild(std::move(pointLight));
+    auto &&lightNode = root.emplaceChild(std::move(pointLight));
     lightNode.position() = glm::vec3{250.0f, 250.0f, 250.0f};
 }
 
@@ -56,11 +58,12 @@ void Viewer::setAnimating(bool animating) {
 void Viewer::render(QPainter *) {
     // reset drivers
     auto &driver = _context.getDriver();
+    driver.enableDepthMask(true);
     driver.clearBufferBit(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     driver.clearColor({0.23f, 0.23f, 0.23f, 1.0f});
     driver.setViewport(0, 0, width(), height());
 
-    _context.getRoot().draw();
+    _context.getRoot().draw(_context);
 }
 
 
@@ -70,6 +73,9 @@ void Viewer::render() {
     driver.setDevicePixelRatio(devicePixelRatio());
 
     QPainter painter = driver.createPainter();
+
+    // the paint engine touches GL state behind the driver's back
+    driver.invalidateState();
     render(&painter);
 }
 
@@ -93,8 +99,19 @@ void Viewer::renderNow() {
     }
 
     driver.makeCurrent(this);
-    render();
-    driver.swapBuffers(this);
+    auto &profiler = _context.getProfiler();
+    profiler.beginFrame();
+    {
+        ProfilerScope scope(profiler, "render");
+        render();
+    }
+
+    {
+        ProfilerScope scope(profiler, "swap");
+        driver.swapBuffers(this);
+    }
+
+    profiler.endFrame();
 
     if (_animating)
         renderLater();
@@ -65,6 +65,8 @@ private:
     std::unique_ptr<ViewerPlugin> _cameraControlPlugin;
     std::unique_ptr<ViewerPlugin> _cameraProjectionPlugin;
     std::unique_ptr<ViewerPlugin> _importMeshFilePlugin;
+    std::unique_ptr<ViewerPlugin> _occlusionCullingPlugin;
+    std::unique_ptr<ViewerPlugin> _depthPrepassPlugin;
 
 
     DrawContext _context;
@@ -0,0 +1,8 @@
+#version 420 core
+
+layout(location = 0) in vec3 vPosition;
+layout(location = 2) in mat4 iModelViewProjMat;
+
+void main() {
+    gl_Position = iModelViewProjMat * vec4(vPosition, 1.0);
+}
@@ -1,6 +1,6 @@
 #version 420 core
 
-in vec3 vPosition;
+layout(location = 0) in vec3 vPosition;
 
 uniform mat4 modelViewProjMat;
 
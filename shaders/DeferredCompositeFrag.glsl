@@ -0,0 +1,25 @@
+#version 420 core
+
+out vec4 outColor;
+
+uniform sampler2D lightAccumulation;
+uniform sampler2D viewDepths;
+
+// lower left corner of the viewport in the target framebuffer
+uniform vec2 viewportOrigin;
+
+// third and fourth column of the projection z row, turn view depth into window depth
+uniform vec2 depthProjection;
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy - viewportOrigin);
+    float depth = texelFetch(viewDepths, texel, 0).x;
+
+    // nothing was drawn into the G-buffer here
+    if (depth <= 0.0)
+        discard;
+
+    float ndcDepth = (depthProjection.y - depthProjection.x * depth) / depth;
+    gl_FragDepth = ndcDepth * 0.5 + 0.5;
+    outColor = vec4(texelFetch(lightAccumulation, texel, 0).rgb, 1.0);
+}
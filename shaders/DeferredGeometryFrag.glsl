@@ -0,0 +1,36 @@
+#version 420 core
+
+layout(std140) uniform FrameUniforms {
+    mat4 viewMat;
+    mat4 projMat;
+    vec3 lightAmbient;
+    int clusterTilesX;
+    int clusterTilesY;
+    int clusterSlices;
+    float clusterDepthScale;
+    float clusterDepthBias;
+};
+
+
+in vec3 fViewVertex;
+in vec3 fNormal;
+
+// G-buffer, the ambient term starts the light accumulation
+layout(location = 0) out vec4 outNormalShininess;
+layout(location = 1) out vec4 outDiffuseColor;
+layout(location = 2) out vec4 outSpecularColor;
+layout(location = 3) out float outViewDepth;
+layout(location = 4) out vec4 outLight;
+
+uniform vec3 ambientColor;
+uniform vec3 diffuseColor;
+uniform vec3 specularColor;
+uniform float shininess;
+
+void main() {
+    outNormalShininess = vec4(normalize(fNormal), shininess);
+    outDiffuseColor = vec4(diffuseColor, 1.0);
+    outSpecularColor = vec4(specularColor, 1.0);
+    outViewDepth = -fViewVertex.z;
+    outLight = vec4(lightAmbient * ambientColor, 1.0);
+}
@@ -0,0 +1,35 @@
+#version 420 core
+
+layout(std140) uniform FrameUniforms {
+    mat4 viewMat;
+    mat4 projMat;
+    vec3 lightAmbient;
+    int clusterTilesX;
+    int clusterTilesY;
+    int clusterSlices;
+    float clusterDepthScale;
+    float clusterDepthBias;
+};
+
+
+in vec3 fViewVertex;
+in vec3 fNormal;
+flat in vec3 fAmbientColor;
+flat in vec3 fDiffuseColor;
+flat in vec3 fSpecularColor;
+flat in float fShininess;
+
+// G-buffer, the ambient term starts the light accumulation
+layout(location = 0) out vec4 outNormalShininess;
+layout(location = 1) out vec4 outDiffuseColor;
+layout(location = 2) out vec4 outSpecularColor;
+layout(location = 3) out float outViewDepth;
+layout(location = 4) out vec4 outLight;
+
+void main() {
+    outNormalShininess = vec4(normalize(fNormal), fShininess);
+    outDiffuseColor = vec4(fDiffuseColor, 1.0);
+    outSpecularColor = vec4(fSpecularColor, 1.0);
+    outViewDepth = -fViewVertex.z;
+    outLight = vec4(lightAmbient * fAmbientColor, 1.0);
+}
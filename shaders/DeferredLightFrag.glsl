@@ -0,0 +1,42 @@
+#version 420 core
+
+out vec4 outColor;
+
+uniform sampler2D normalShininess;
+uniform sampler2D diffuseColors;
+uniform sampler2D specularColors;
+uniform sampler2D viewDepths;
+
+// maps NDC xy to view xy at unit depth: scale in xy, offset in zw
+uniform vec4 unprojection;
+
+// in view space
+uniform vec3 lightPosition;
+uniform vec3 lightColor;
+uniform float lightRadius;
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(viewDepths, texel, 0).x;
+    vec2 ndc = gl_FragCoord.xy / vec2(textureSize(viewDepths, 0)) * 2.0 - 1.0;
+    vec3 viewVertex = vec3((ndc * unprojection.xy + unprojection.zw) * depth, -depth);
+
+    vec4 normalAndShininess = texelFetch(normalShininess, texel, 0);
+    vec3 normal = normalAndShininess.xyz;
+    float shininess = normalAndShininess.w;
+    vec3 diffuseColor = texelFetch(diffuseColors, texel, 0).rgb;
+    vec3 specularColor = texelFetch(specularColors, texel, 0).rgb;
+
+    vec3 lightDirection = normalize(lightPosition - viewVertex);
+    vec3 diffuse = lightColor * diffuseColor * max(0.0, dot(normal, lightDirection));
+
+    vec3 viewDirection = normalize(-viewVertex);
+    vec3 H = normalize(lightDirection + viewDirection);
+    vec3 specular = lightColor * specularColor * pow(max(0.0, dot(normal, H)), shininess);
+
+    float dist = length(lightPosition - viewVertex);
+    float attenuation = clamp(1.0 - dist * dist / (lightRadius * lightRadius), 0.0, 1.0);
+    attenuation *= attenuation;
+
+    outColor = vec4(attenuation * (diffuse + specular), 1.0);
+}
@@ -0,0 +1,9 @@
+#version 420 core
+
+layout(location = 0) in vec3 vPosition;
+
+uniform mat4 modelViewProjMat;
+
+void main() {
+    gl_Position = modelViewProjMat * vec4(vPosition, 1.0);
+}
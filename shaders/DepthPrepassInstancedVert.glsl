@@ -0,0 +1,14 @@
+#version 420 core
+
+layout(location = 0) in vec3 vPosition;
+layout(location = 2) in mat4 iModelViewMat;
+
+uniform mat4 projMat;
+
+// computed like the shading pass, so the shaded fragments pass its depth
+invariant gl_Position;
+
+void main() {
+    vec4 viewVertex = iModelViewMat * vec4(vPosition, 1.0);
+    gl_Position = projMat * viewVertex;
+}
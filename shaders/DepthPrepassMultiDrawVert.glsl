@@ -0,0 +1,25 @@
+#version 420 core
+
+#define DRAW_DATA_TEXELS 4
+
+layout(location = 0) in vec3 vPosition;
+layout(location = 10) in float iDrawId;
+
+uniform mat4 projMat;
+
+// per draw model view matrix
+uniform samplerBuffer drawData;
+
+// computed like the shading pass, so the shaded fragments pass its depth
+invariant gl_Position;
+
+void main() {
+    int base = int(iDrawId) * DRAW_DATA_TEXELS;
+    mat4 modelViewMat = mat4(texelFetch(drawData, base + 0),
+                             texelFetch(drawData, base + 1),
+                             texelFetch(drawData, base + 2),
+                             texelFetch(drawData, base + 3));
+
+    vec4 viewVertex = modelViewMat * vec4(vPosition, 1.0);
+    gl_Position = projMat * viewVertex;
+}
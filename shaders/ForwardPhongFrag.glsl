@@ -1,23 +1,30 @@
 #version 420 core
 
-#define MAX_LIGHTS 10
-
-struct PointLight {
-    vec3 position;
-    vec3 color;
-    float radius;
+layout(std140) uniform FrameUniforms {
+    mat4 viewMat;
+    mat4 projMat;
+    vec3 lightAmbient;
+    int clusterTilesX;
+    int clusterTilesY;
+    int clusterSlices;
+    float clusterDepthScale;
+    float clusterDepthBias;
 };
 
 
+// two texels per light: view position and radius, color
+uniform samplerBuffer pointLights;
+
+// offset into the light indices and number of lights per cluster
+uniform usamplerBuffer lightClusters;
+uniform usamplerBuffer lightIndices;
+
+
 in vec3 fViewVertex;
 in vec3 fNormal;
 
 out vec4 outColor;
 
-uniform vec3 lightAmbient;
-
-uniform PointLight pointLights[MAX_LIGHTS];
-
 uniform vec3 ambientColor;
 uniform vec3 diffuseColor;
 uniform vec3 specularColor;
@@ -26,18 +33,31 @@ uniform float shininess;
 void main() {
     vec3 ambient = lightAmbient * ambientColor;
 
+    // tiles split the screen, slices grow exponentially with the view depth
+    vec4 clipVertex = projMat * vec4(fViewVertex, 1.0);
+    ivec2 tile = clamp(ivec2((clipVertex.xy / clipVertex.w * 0.5 + 0.5) * vec2(clusterTilesX, clusterTilesY)),
+                       ivec2(0), ivec2(clusterTilesX - 1, clusterTilesY - 1));
+    int slice = clamp(int(floor(log(-fViewVertex.z) * clusterDepthScale + clusterDepthBias)), 0, clusterSlices - 1);
+    uvec2 cluster = texelFetch(lightClusters, tile.x + clusterTilesX * (tile.y + clusterTilesY * slice)).xy;
+
+    vec3 normal = normalize(fNormal);
+    vec3 viewDirection = normalize(-fViewVertex);
     vec3 diffuseSpecular = vec3(0.0f);
-    for (int i = 0; i < MAX_LIGHTS; ++i) {
-        vec3 lightDirection = normalize(pointLights[i].position - fViewVertex);
-        vec3 normal = normalize(fNormal);
-        vec3 diffuse = pointLights[i].color * diffuseColor * max(0.0, dot(normal, lightDirection));
+    for (uint i = cluster.x; i < cluster.x + cluster.y; ++i) {
+        int light = int(texelFetch(lightIndices, int(i)).x);
+        vec4 lightPositionRadius = texelFetch(pointLights, 2 * light);
+        vec3 lightColor = texelFetch(pointLights, 2 * light + 1).xyz;
+        vec3 lightPosition = lightPositionRadius.xyz;
+        float lightRadius = lightPositionRadius.w;
+
+        vec3 lightDirection = normalize(lightPosition - fViewVertex);
+        vec3 diffuse = lightColor * diffuseColor * max(0.0, dot(normal, lightDirection));
 
-        vec3 viewDirection = normalize(-fViewVertex);
         vec3 H = normalize(lightDirection + viewDirection);
-        vec3 specular = pointLights[i].color * specularColor * pow(max(0.0, dot(normal, H)), shininess);
+        vec3 specular = lightColor * specularColor * pow(max(0.0, dot(normal, H)), shininess);
 
-        float dist = length(pointLights[i].position - fViewVertex);
-        float attenuation = clamp(1.0 - dist * dist / (pointLights[i].radius  * pointLights[i].radius), 0.0, 1.0);
+        float dist = length(lightPosition - fViewVertex);
+        float attenuation = clamp(1.0 - dist * dist / (lightRadius * lightRadius), 0.0, 1.0);
         attenuation *= attenuation;
 
         diffuseSpecular += attenuation * (diffuse + specular);
@@ -0,0 +1,50 @@
+#version 420 core
+
+layout(std140) uniform FrameUniforms {
+    mat4 viewMat;
+    mat4 projMat;
+    vec3 lightAmbient;
+    int clusterTilesX;
+    int clusterTilesY;
+    int clusterSlices;
+    float clusterDepthScale;
+    float clusterDepthBias;
+};
+
+
+layout(location = 0) in vec3 vPosition;
+#ifdef OCTAHEDRAL_NORMALS
+layout(location = 1) in vec2 vNormal;
+#else
+layout(location = 1) in vec3 vNormal;
+#endif
+layout(location = 2) in mat4 iModelViewMat;
+layout(location = 6) in mat4 iNormalMat;
+
+out vec3 fNormal;
+out vec3 fViewVertex;
+
+// matches the depth prepass, which the shading then depth tests against with GL_LEQUAL
+invariant gl_Position;
+
+vec3 decodeNormal() {
+#ifdef OCTAHEDRAL_NORMALS
+    // unfold the lower hemisphere of the octahedron
+    vec3 normal = vec3(vNormal, 1.0 - abs(vNormal.x) - abs(vNormal.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+#else
+    return vNormal;
+#endif
+}
+
+void main() {
+    vec4 viewVertex = iModelViewMat * vec4(vPosition, 1.0);
+    vec4 normal = iNormalMat * vec4(decodeNormal(), 0.0);
+    gl_Position = projMat * viewVertex;
+
+    fNormal = normal.xyz;
+    fViewVertex = viewVertex.xyz;
+}
@@ -0,0 +1,70 @@
+#version 420 core
+
+layout(std140) uniform FrameUniforms {
+    mat4 viewMat;
+    mat4 projMat;
+    vec3 lightAmbient;
+    int clusterTilesX;
+    int clusterTilesY;
+    int clusterSlices;
+    float clusterDepthScale;
+    float clusterDepthBias;
+};
+
+
+// two texels per light: view position and radius, color
+uniform samplerBuffer pointLights;
+
+// offset into the light indices and number of lights per cluster
+uniform usamplerBuffer lightClusters;
+uniform usamplerBuffer lightIndices;
+
+
+in vec3 fViewVertex;
+in vec3 fNormal;
+flat in vec3 fAmbientColor;
+flat in vec3 fDiffuseColor;
+flat in vec3 fSpecularColor;
+flat in float fShininess;
+
+out vec4 outColor;
+
+void main() {
+    vec3 ambientColor = fAmbientColor;
+    vec3 diffuseColor = fDiffuseColor;
+    vec3 specularColor = fSpecularColor;
+    float shininess = fShininess;
+    vec3 ambient = lightAmbient * ambientColor;
+
+    // tiles split the screen, slices grow exponentially with the view depth
+    vec4 clipVertex = projMat * vec4(fViewVertex, 1.0);
+    ivec2 tile = clamp(ivec2((clipVertex.xy / clipVertex.w * 0.5 + 0.5) * vec2(clusterTilesX, clusterTilesY)),
+                       ivec2(0), ivec2(clusterTilesX - 1, clusterTilesY - 1));
+    int slice = clamp(int(floor(log(-fViewVertex.z) * clusterDepthScale + clusterDepthBias)), 0, clusterSlices - 1);
+    uvec2 cluster = texelFetch(lightClusters, tile.x + clusterTilesX * (tile.y + clusterTilesY * slice)).xy;
+
+    vec3 normal = normalize(fNormal);
+    vec3 viewDirection = normalize(-fViewVertex);
+    vec3 diffuseSpecular = vec3(0.0f);
+    for (uint i = cluster.x; i < cluster.x + cluster.y; ++i) {
+        int light = int(texelFetch(lightIndices, int(i)).x);
+        vec4 lightPositionRadius = texelFetch(pointLights, 2 * light);
+        vec3 lightColor = texelFetch(pointLights, 2 * light + 1).xyz;
+        vec3 lightPosition = lightPositionRadius.xyz;
+        float lightRadius = lightPositionRadius.w;
+
+        vec3 lightDirection = normalize(lightPosition - fViewVertex);
+        vec3 diffuse = lightColor * diffuseColor * max(0.0, dot(normal, lightDirection));
+
+        vec3 H = normalize(lightDirection + viewDirection);
+        vec3 specular = lightColor * specularColor * pow(max(0.0, dot(normal, H)), shininess);
+
+        float dist = length(lightPosition - fViewVertex);
+        float attenuation = clamp(1.0 - dist * dist / (lightRadius * lightRadius), 0.0, 1.0);
+        attenuation *= attenuation;
+
+        diffuseSpecular += attenuation * (diffuse + specular);
+    }
+
+    outColor = vec4(ambient + diffuseSpecular, 1.0);
+}
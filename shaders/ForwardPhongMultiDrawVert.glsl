@@ -0,0 +1,71 @@
+#version 420 core
+
+#define DRAW_DATA_TEXELS 10
+
+layout(std140) uniform FrameUniforms {
+    mat4 viewMat;
+    mat4 projMat;
+    vec3 lightAmbient;
+    int clusterTilesX;
+    int clusterTilesY;
+    int clusterSlices;
+    float clusterDepthScale;
+    float clusterDepthBias;
+};
+
+
+layout(location = 0) in vec3 vPosition;
+#ifdef OCTAHEDRAL_NORMALS
+layout(location = 1) in vec2 vNormal;
+#else
+layout(location = 1) in vec3 vNormal;
+#endif
+layout(location = 10) in float iDrawId;
+
+out vec3 fNormal;
+out vec3 fViewVertex;
+flat out vec3 fAmbientColor;
+flat out vec3 fDiffuseColor;
+flat out vec3 fSpecularColor;
+flat out float fShininess;
+
+// per draw model view matrix, normal matrix and material
+uniform samplerBuffer drawData;
+
+// matches the depth prepass, which the shading then depth tests against with GL_LEQUAL
+invariant gl_Position;
+
+vec3 decodeNormal() {
+#ifdef OCTAHEDRAL_NORMALS
+    // unfold the lower hemisphere of the octahedron
+    vec3 normal = vec3(vNormal, 1.0 - abs(vNormal.x) - abs(vNormal.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+#else
+    return vNormal;
+#endif
+}
+
+void main() {
+    int base = int(iDrawId) * DRAW_DATA_TEXELS;
+    mat4 modelViewMat = mat4(texelFetch(drawData, base + 0),
+                             texelFetch(drawData, base + 1),
+                             texelFetch(drawData, base + 2),
+                             texelFetch(drawData, base + 3));
+    mat3 normalMat = mat3(texelFetch(drawData, base + 4).xyz,
+                          texelFetch(drawData, base + 5).xyz,
+                          texelFetch(drawData, base + 6).xyz);
+    vec4 ambientShininess = texelFetch(drawData, base + 7);
+
+    vec4 viewVertex = modelViewMat * vec4(vPosition, 1.0);
+    gl_Position = projMat * viewVertex;
+
+    fNormal = normalMat * decodeNormal();
+    fViewVertex = viewVertex.xyz;
+    fAmbientColor = ambientShininess.xyz;
+    fShininess = ambientShininess.w;
+    fDiffuseColor = texelFetch(drawData, base + 8).xyz;
+    fSpecularColor = texelFetch(drawData, base + 9).xyz;
+}